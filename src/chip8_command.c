@@ -0,0 +1,240 @@
+/* chip8_command.c
+* Lock-free single producer / single consumer command queue. The UI thread
+* posts edits to a machine; the thread that runs the machine applies them.
+* GitHub: https:\\github.com\tommojphillips
+*/
+
+#include <stdint.h>
+#include <string.h>
+
+#include "chip8_command.h"
+#include "chip8_machine.h"
+#include "chip8_decode.h"
+#include "chip8_movie.h"
+#include "chip8_debug.h"
+#include "chip8_profile.h"
+#include "thread.h"
+#include "chip8.h" // chip8 cpu core
+
+#define CHIP8_COMMAND_QUEUE_MASK (CHIP8_COMMAND_QUEUE_SIZE - 1)
+
+static void set_register(CHIP8* cpu, uint16_t reg, uint32_t value);
+static int apply_debug(CHIP8_MACHINE* machine, const CHIP8_COMMAND* command);
+
+void chip8_command_queue_init(CHIP8_COMMAND_QUEUE* queue) {
+	memset(queue, 0, sizeof(CHIP8_COMMAND_QUEUE));
+}
+
+int chip8_command_push(CHIP8_COMMAND_QUEUE* queue, const CHIP8_COMMAND* command) {
+	const long tail = queue->tail; // only the producer writes tail
+	if (tail - thread_atomic_load(&queue->head) >= CHIP8_COMMAND_QUEUE_SIZE) {
+		return 1;
+	}
+	queue->commands[tail & CHIP8_COMMAND_QUEUE_MASK] = *command;
+
+	/* publish the slot after it is written */
+	thread_atomic_exchange(&queue->tail, tail + 1);
+	return 0;
+}
+int chip8_command_pop(CHIP8_COMMAND_QUEUE* queue, CHIP8_COMMAND* command) {
+	const long head = queue->head; // only the consumer writes head
+	if (head == thread_atomic_load(&queue->tail)) {
+		return 0;
+	}
+	*command = queue->commands[head & CHIP8_COMMAND_QUEUE_MASK];
+
+	/* release the slot after it is read */
+	thread_atomic_exchange(&queue->head, head + 1);
+	return 1;
+}
+
+int chip8_command_apply(CHIP8_MACHINE* machine, const CHIP8_COMMAND* command) {
+
+	CHIP8* cpu = &machine->cpu;
+
+	switch (command->type) {
+
+		case CHIP8_COMMAND_RESET:
+			chip8_machine_reset(machine);
+			return 0;
+
+		case CHIP8_COMMAND_SET_STATE:
+			cpu->cpu_state = (CHIP8_CPU_STATE)command->value;
+			return 0;
+
+		case CHIP8_COMMAND_SINGLE_STEP:
+			if (cpu->cpu_state == CHIP8_STATE_EXE)
+				return 1;
+			chip8_machine_single_step(machine);
+			return 0;
+
+		case CHIP8_COMMAND_SET_REGISTER:
+			set_register(cpu, command->arg, command->value);
+			return 0;
+
+		case CHIP8_COMMAND_SET_KEY:
+			if (machine->movie != NULL && machine->movie->mode == CHIP8_MOVIE_PLAYING)
+				return 1; // the movie has the keypad
+			CHIP8_KEYPAD_SET(cpu->keypad, command->arg & 0xF, command->value);
+			if (machine->movie != NULL) {
+				chip8_movie_record_keypad(machine->movie, machine);
+			}
+			return 0;
+
+		case CHIP8_COMMAND_SET_QUIRKS:
+			chip8_machine_set_quirks(machine, (uint8_t)command->value);
+			return 0;
+
+		case CHIP8_COMMAND_TOGGLE_QUIRKS:
+			chip8_machine_set_quirks(machine, cpu->quirks ^ (uint8_t)command->value);
+			return 0;
+
+		case CHIP8_COMMAND_WRITE_RAM:
+			if (command->arg >= CHIP8_MEMORY_BYTES)
+				return 1;
+			chip8_decode_write_ram(machine, command->arg, (uint8_t)command->value);
+			return 0;
+
+		case CHIP8_COMMAND_WRITE_DISPLAY:
+			if (command->arg >= sizeof(cpu->display))
+				return 1;
+			cpu->display[command->arg] = (uint8_t)command->value;
+			return 0;
+
+		case CHIP8_COMMAND_TOGGLE_PIXEL:
+			if (machine->platform != CHIP8_PLATFORM_CHIP8) {
+				/* plane 0 of the frame */
+				CHIP8_FRAME* frame = &machine->screen;
+				if (command->arg >= frame->width * frame->height)
+					return 1;
+				const int x = command->arg % frame->width;
+				const int y = command->arg / frame->width;
+				frame->rows[0][y][x / 64] ^= (uint64_t)1 << (63 - (x & 63));
+				return 0;
+			}
+			if (command->arg >= CHIP8_NUM_PIXELS)
+				return 1;
+			CHIP8_DISPLAY_TOGGLE_PX(cpu->display, command->arg);
+			return 0;
+
+		case CHIP8_COMMAND_DEBUG_BREAKPOINT:
+		case CHIP8_COMMAND_DEBUG_WATCH:
+		case CHIP8_COMMAND_DEBUG_CONDITION:
+		case CHIP8_COMMAND_DEBUG_REMOVE:
+		case CHIP8_COMMAND_DEBUG_CLEAR:
+		case CHIP8_COMMAND_DEBUG_RUN_TO:
+		case CHIP8_COMMAND_DEBUG_STEP_OVER:
+		case CHIP8_COMMAND_DEBUG_RUN_COUNT:
+			if (machine->debug == NULL)
+				return 1;
+			return apply_debug(machine, command);
+
+		case CHIP8_COMMAND_PROFILE_ENABLE:
+			if (machine->profile == NULL)
+				return 1;
+			machine->profile->enabled = (command->value != 0);
+			return 0;
+
+		case CHIP8_COMMAND_PROFILE_RESET:
+			if (machine->profile == NULL)
+				return 1;
+			chip8_profile_reset(machine->profile);
+			return 0;
+
+		default:
+			return 1;
+	}
+}
+
+static void set_register(CHIP8* cpu, uint16_t reg, uint32_t value) {
+	if (reg < CHIP8_REGISTER_COUNT) {
+		cpu->v[reg] = value % 256;
+		return;
+	}
+
+	switch (reg) {
+		case CHIP8_COMMAND_REGISTER_I:
+			cpu->i = value % 65536;
+			break;
+		case CHIP8_COMMAND_REGISTER_SP:
+			cpu->sp = value % 65536;
+			break;
+		case CHIP8_COMMAND_REGISTER_DT:
+			cpu->delay_timer = value % 256;
+			break;
+		case CHIP8_COMMAND_REGISTER_ST:
+			cpu->sound_timer = value % 256;
+			break;
+		case CHIP8_COMMAND_REGISTER_PC:
+			if (value < CHIP8_MEMORY_BYTES)
+				cpu->pc = (uint16_t)value;
+			break;
+	}
+}
+static int apply_debug(CHIP8_MACHINE* machine, const CHIP8_COMMAND* command) {
+
+	CHIP8* cpu = &machine->cpu;
+	CHIP8_DEBUG* debug = machine->debug;
+
+	switch (command->type) {
+
+		case CHIP8_COMMAND_DEBUG_BREAKPOINT:
+			if (command->arg >= CHIP8_MEMORY_BYTES)
+				return 1;
+			chip8_debug_set_breakpoint(debug, command->arg, command->value != 0);
+			return 0;
+
+		case CHIP8_COMMAND_DEBUG_WATCH:
+			if (command->text == NULL)
+				return 1;
+			return chip8_debug_add_watch(debug, cpu, command->text);
+
+		case CHIP8_COMMAND_DEBUG_CONDITION:
+			if (command->text == NULL)
+				return 1;
+			return chip8_debug_add_condition(debug, command->text);
+
+		case CHIP8_COMMAND_DEBUG_REMOVE:
+			if (command->arg == CHIP8_COMMAND_DEBUG_WATCH)
+				chip8_debug_remove_watch(debug, (int)command->value);
+			else if (command->arg == CHIP8_COMMAND_DEBUG_CONDITION)
+				chip8_debug_remove_condition(debug, (int)command->value);
+			else
+				return 1;
+			return 0;
+
+		case CHIP8_COMMAND_DEBUG_CLEAR:
+			chip8_debug_clear(debug);
+			return 0;
+
+		case CHIP8_COMMAND_DEBUG_RUN_TO:
+			if (cpu->cpu_state == CHIP8_STATE_ERROR_OPCODE || command->arg >= CHIP8_MEMORY_BYTES)
+				return 1;
+			chip8_debug_run_to(debug, command->arg, -1);
+			cpu->cpu_state = CHIP8_STATE_EXE;
+			return 0;
+
+		case CHIP8_COMMAND_DEBUG_STEP_OVER:
+			if (cpu->cpu_state != CHIP8_STATE_HLT)
+				return 1;
+			if ((cpu->ram[cpu->pc & CHIP8_ADDR_MASK] & 0xF0) == 0x20) {
+				/* 2NNN; run to the instruction after it at this stack depth */
+				chip8_debug_run_to(debug, cpu->pc + 2, cpu->sp);
+				cpu->cpu_state = CHIP8_STATE_EXE;
+				return 0;
+			}
+			chip8_machine_single_step(machine);
+			chip8_debug_sync(debug, cpu);
+			return 0;
+
+		case CHIP8_COMMAND_DEBUG_RUN_COUNT:
+			if (cpu->cpu_state == CHIP8_STATE_ERROR_OPCODE || command->value == 0)
+				return 1;
+			chip8_debug_run_count(debug, command->value);
+			cpu->cpu_state = CHIP8_STATE_EXE;
+			return 0;
+
+		default:
+			return 1;
+	}
+}
@@ -0,0 +1,157 @@
+/* chip8_command.h
+* Lock-free single producer / single consumer command queue. The UI thread
+* posts edits to a machine; the thread that runs the machine applies them.
+* GitHub: https:\\github.com\tommojphillips
+*/
+
+#ifndef CHIP8_COMMAND_H
+#define CHIP8_COMMAND_H
+
+#include <stdint.h>
+
+#include "chip8.h" // chip8 cpu core
+
+/* Queue capacity. Must be a power of 2 */
+#define CHIP8_COMMAND_QUEUE_SIZE 256
+
+typedef struct CHIP8_MACHINE CHIP8_MACHINE;
+
+/* Command type */
+typedef enum {
+	/* Reset the cpu */
+	CHIP8_COMMAND_RESET = 0,
+
+	/* cpu_state = value */
+	CHIP8_COMMAND_SET_STATE,
+
+	/* Execute one instruction */
+	CHIP8_COMMAND_SINGLE_STEP,
+
+	/* Register arg (CHIP8_COMMAND_REGISTER) = value */
+	CHIP8_COMMAND_SET_REGISTER,
+
+	/* Key arg = value (CHIP8_KEY_STATE_*) */
+	CHIP8_COMMAND_SET_KEY,
+
+	/* quirks = value */
+	CHIP8_COMMAND_SET_QUIRKS,
+
+	/* quirks ^= value */
+	CHIP8_COMMAND_TOGGLE_QUIRKS,
+
+	/* RAM[arg] = value */
+	CHIP8_COMMAND_WRITE_RAM,
+
+	/* display[arg] = value */
+	CHIP8_COMMAND_WRITE_DISPLAY,
+
+	/* Toggle display pixel arg; y * width + x of the current frame */
+	CHIP8_COMMAND_TOGGLE_PIXEL,
+
+	/* Load the program in filename. The consumer frees filename */
+	CHIP8_COMMAND_LOAD_PROGRAM,
+
+	/* Save a state to slot arg. Handled by the frontend */
+	CHIP8_COMMAND_SAVE_STATE,
+
+	/* Load the state in slot arg. Handled by the frontend */
+	CHIP8_COMMAND_LOAD_STATE,
+
+	/* Start recording a movie. Handled by the frontend */
+	CHIP8_COMMAND_MOVIE_RECORD,
+
+	/* Replay the last recorded movie. Handled by the frontend */
+	CHIP8_COMMAND_MOVIE_PLAY,
+
+	/* Stop recording or replaying. Handled by the frontend */
+	CHIP8_COMMAND_MOVIE_STOP,
+
+	/* Set (value 1) or clear (value 0) a breakpoint at address arg */
+	CHIP8_COMMAND_DEBUG_BREAKPOINT,
+
+	/* Add the watch expression in text */
+	CHIP8_COMMAND_DEBUG_WATCH,
+
+	/* Add the break condition expression in text */
+	CHIP8_COMMAND_DEBUG_CONDITION,
+
+	/* Remove watch (arg CHIP8_COMMAND_DEBUG_WATCH) or condition (arg
+	   CHIP8_COMMAND_DEBUG_CONDITION) number value */
+	CHIP8_COMMAND_DEBUG_REMOVE,
+
+	/* Remove every breakpoint, watch and condition */
+	CHIP8_COMMAND_DEBUG_CLEAR,
+
+	/* Run until PC is arg */
+	CHIP8_COMMAND_DEBUG_RUN_TO,
+
+	/* Execute one instruction; a call runs until it returns */
+	CHIP8_COMMAND_DEBUG_STEP_OVER,
+
+	/* Run value instructions */
+	CHIP8_COMMAND_DEBUG_RUN_COUNT,
+
+	/* Start (value 1) or stop (value 0) counting instructions */
+	CHIP8_COMMAND_PROFILE_ENABLE,
+
+	/* Zero the profile */
+	CHIP8_COMMAND_PROFILE_RESET,
+
+	/* Write the profile to a csv file. Handled by the frontend */
+	CHIP8_COMMAND_PROFILE_EXPORT,
+
+	/* Reset the frame pacer's worst case jitter. Handled by the frontend */
+	CHIP8_COMMAND_PACING_RESET,
+} CHIP8_COMMAND_TYPE;
+
+/* Register selector for CHIP8_COMMAND_SET_REGISTER */
+typedef enum {
+	/* V0 - VF are 0x0 - 0xF */
+	CHIP8_COMMAND_REGISTER_I = CHIP8_REGISTER_COUNT,
+	CHIP8_COMMAND_REGISTER_SP,
+	CHIP8_COMMAND_REGISTER_DT,
+	CHIP8_COMMAND_REGISTER_ST,
+	CHIP8_COMMAND_REGISTER_PC,
+} CHIP8_COMMAND_REGISTER;
+
+/* Command */
+typedef struct {
+	CHIP8_COMMAND_TYPE type;
+	uint16_t arg;
+	uint32_t value;
+	char* filename;
+	char* text; // debug expression. The consumer frees it
+} CHIP8_COMMAND;
+
+/* Command queue. head is only written by the consumer, tail only by the producer */
+typedef struct {
+	CHIP8_COMMAND commands[CHIP8_COMMAND_QUEUE_SIZE];
+	volatile long head; // next command to pop
+	volatile long tail; // next free slot
+} CHIP8_COMMAND_QUEUE;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Empty the queue */
+void chip8_command_queue_init(CHIP8_COMMAND_QUEUE* queue);
+
+/* Producer side. returns 0 on success, 1 if the queue is full */
+int chip8_command_push(CHIP8_COMMAND_QUEUE* queue, const CHIP8_COMMAND* command);
+
+/* Consumer side. returns 1 if a command was popped, 0 if the queue is empty */
+int chip8_command_pop(CHIP8_COMMAND_QUEUE* queue, CHIP8_COMMAND* command);
+
+/* Apply a command to a machine. Does not handle CHIP8_COMMAND_LOAD_PROGRAM,
+   the save state, the movie commands, CHIP8_COMMAND_PROFILE_EXPORT or
+   CHIP8_COMMAND_PACING_RESET; the
+   debug commands need machine->debug and the profile commands
+   machine->profile. returns 0 if the command was applied */
+int chip8_command_apply(CHIP8_MACHINE* machine, const CHIP8_COMMAND* command);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif
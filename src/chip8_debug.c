@@ -0,0 +1,529 @@
+/* chip8_debug.c
+* Debugger. PC breakpoints, watch expressions and break conditions compiled
+* to a small stack bytecode, run to address, step over and run N. While
+* nothing is armed the engines run unchecked.
+* GitHub: https:\\github.com\tommojphillips
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "chip8_debug.h"
+#include "chip8_machine.h"
+#include "chip8_decode.h"
+#include "chip8_profile.h"
+#include "chip8.h" // chip8 cpu core
+
+/* Expression ops */
+enum {
+	DEBUG_OP_CONST = 0,
+	DEBUG_OP_V,
+	DEBUG_OP_I,
+	DEBUG_OP_PC,
+	DEBUG_OP_SP,
+	DEBUG_OP_DT,
+	DEBUG_OP_ST,
+	DEBUG_OP_KEYS,
+	DEBUG_OP_RAM,
+	DEBUG_OP_NOT,
+	DEBUG_OP_NEG,
+	DEBUG_OP_LOR,
+	DEBUG_OP_LAND,
+	DEBUG_OP_OR,
+	DEBUG_OP_XOR,
+	DEBUG_OP_AND,
+	DEBUG_OP_EQ,
+	DEBUG_OP_NE,
+	DEBUG_OP_LT,
+	DEBUG_OP_LE,
+	DEBUG_OP_GT,
+	DEBUG_OP_GE,
+	DEBUG_OP_ADD,
+	DEBUG_OP_SUB,
+};
+
+/* Binary operators by precedence; the longer of two that share a prefix first */
+static const struct {
+	const char* text;
+	int precedence;
+	uint8_t op;
+} debug_binary_ops[] = {
+	{ "||", 1, DEBUG_OP_LOR },
+	{ "&&", 2, DEBUG_OP_LAND },
+	{ "==", 6, DEBUG_OP_EQ },
+	{ "!=", 6, DEBUG_OP_NE },
+	{ "<=", 7, DEBUG_OP_LE },
+	{ ">=", 7, DEBUG_OP_GE },
+	{ "<", 7, DEBUG_OP_LT },
+	{ ">", 7, DEBUG_OP_GT },
+	{ "|", 3, DEBUG_OP_OR },
+	{ "^", 4, DEBUG_OP_XOR },
+	{ "&", 5, DEBUG_OP_AND },
+	{ "+", 8, DEBUG_OP_ADD },
+	{ "-", 8, DEBUG_OP_SUB },
+};
+
+/* Named operands */
+static const struct {
+	const char* name;
+	uint8_t op;
+} debug_operands[] = {
+	{ "i", DEBUG_OP_I },
+	{ "pc", DEBUG_OP_PC },
+	{ "sp", DEBUG_OP_SP },
+	{ "dt", DEBUG_OP_DT },
+	{ "st", DEBUG_OP_ST },
+	{ "keys", DEBUG_OP_KEYS },
+};
+
+/* Expression parser */
+typedef struct {
+	const char* p;
+	CHIP8_DEBUG_EXPR* expr;
+	int depth;
+	const char* error;
+} DEBUG_PARSER;
+
+static int debug_parse_binary(DEBUG_PARSER* parser, int precedence);
+static int debug_parse_unary(DEBUG_PARSER* parser);
+static int debug_emit(DEBUG_PARSER* parser, uint8_t op, uint16_t value, int depth);
+static void debug_skip_space(DEBUG_PARSER* parser);
+static int debug_check(CHIP8_DEBUG* debug, CHIP8_MACHINE* machine, uint64_t instruction);
+static void debug_stop(CHIP8_DEBUG* debug, CHIP8_MACHINE* machine, CHIP8_DEBUG_STOP stop, uint64_t instruction);
+static void debug_update_armed(CHIP8_DEBUG* debug);
+
+CHIP8_DEBUG* chip8_debug_create() {
+	CHIP8_DEBUG* debug = (CHIP8_DEBUG*)malloc(sizeof(CHIP8_DEBUG));
+	if (debug == NULL) {
+		return NULL;
+	}
+	memset(debug, 0, sizeof(CHIP8_DEBUG));
+	chip8_debug_clear(debug);
+	return debug;
+}
+void chip8_debug_destroy(CHIP8_DEBUG* debug) {
+	free(debug);
+}
+void chip8_debug_clear(CHIP8_DEBUG* debug) {
+	memset(debug->breakpoints, 0, sizeof(debug->breakpoints));
+	debug->breakpoint_count = 0;
+	debug->watch_count = 0;
+	debug->condition_count = 0;
+	debug->run_to = CHIP8_DEBUG_OFF;
+	debug->run_to_sp = -1;
+	debug->run_count = CHIP8_DEBUG_OFF;
+	debug->skip_instruction = CHIP8_DEBUG_OFF;
+	debug_update_armed(debug);
+}
+void chip8_debug_set_breakpoint(CHIP8_DEBUG* debug, uint16_t addr, int set) {
+	uint8_t* breakpoint = &debug->breakpoints[addr & CHIP8_ADDR_MASK];
+	set = (set != 0);
+	if (*breakpoint != set) {
+		*breakpoint = (uint8_t)set;
+		debug->breakpoint_count += set ? 1 : -1;
+	}
+	debug_update_armed(debug);
+}
+int chip8_debug_add_watch(CHIP8_DEBUG* debug, const CHIP8* cpu, const char* source) {
+	if (debug->watch_count == CHIP8_DEBUG_MAX_WATCHES)
+		return 1;
+
+	CHIP8_DEBUG_WATCH* watch = &debug->watches[debug->watch_count];
+	if (chip8_debug_compile(&watch->expr, source) != NULL)
+		return 1;
+
+	watch->value = chip8_debug_eval(&watch->expr, cpu);
+	debug->watch_count++;
+	debug_update_armed(debug);
+	return 0;
+}
+int chip8_debug_add_condition(CHIP8_DEBUG* debug, const char* source) {
+	if (debug->condition_count == CHIP8_DEBUG_MAX_CONDITIONS)
+		return 1;
+
+	if (chip8_debug_compile(&debug->conditions[debug->condition_count], source) != NULL)
+		return 1;
+
+	debug->condition_count++;
+	debug_update_armed(debug);
+	return 0;
+}
+void chip8_debug_remove_watch(CHIP8_DEBUG* debug, int index) {
+	if (index < 0 || index >= debug->watch_count)
+		return;
+	memmove(&debug->watches[index], &debug->watches[index + 1], (debug->watch_count - index - 1) * sizeof(CHIP8_DEBUG_WATCH));
+	debug->watch_count--;
+	debug_update_armed(debug);
+}
+void chip8_debug_remove_condition(CHIP8_DEBUG* debug, int index) {
+	if (index < 0 || index >= debug->condition_count)
+		return;
+	memmove(&debug->conditions[index], &debug->conditions[index + 1], (debug->condition_count - index - 1) * sizeof(CHIP8_DEBUG_EXPR));
+	debug->condition_count--;
+	debug_update_armed(debug);
+}
+void chip8_debug_run_to(CHIP8_DEBUG* debug, uint16_t addr, int sp) {
+	debug->run_to = addr & CHIP8_ADDR_MASK;
+	debug->run_to_sp = sp;
+	debug_update_armed(debug);
+}
+void chip8_debug_run_count(CHIP8_DEBUG* debug, uint64_t count) {
+	debug->run_count = count;
+	debug_update_armed(debug);
+}
+void chip8_debug_sync(CHIP8_DEBUG* debug, const CHIP8* cpu) {
+	for (int n = 0; n < debug->watch_count; ++n) {
+		debug->watches[n].value = chip8_debug_eval(&debug->watches[n].expr, cpu);
+	}
+}
+void chip8_debug_describe_stop(const CHIP8_DEBUG* debug, char* buffer, size_t size) {
+	switch (debug->stop) {
+		case CHIP8_DEBUG_STOP_BREAKPOINT:
+			snprintf(buffer, size, "breakpoint at 0x%03x", debug->stop_pc);
+			break;
+		case CHIP8_DEBUG_STOP_WATCH:
+			snprintf(buffer, size, "watch %d changed %u -> %u at 0x%03x", debug->stop_index + 1, debug->stop_old, debug->stop_new, debug->stop_pc);
+			break;
+		case CHIP8_DEBUG_STOP_CONDITION:
+			snprintf(buffer, size, "condition %d at 0x%03x", debug->stop_index + 1, debug->stop_pc);
+			break;
+		case CHIP8_DEBUG_STOP_RUN_TO:
+			snprintf(buffer, size, "ran to 0x%03x", debug->stop_pc);
+			break;
+		case CHIP8_DEBUG_STOP_RUN_COUNT:
+			snprintf(buffer, size, "ran to instruction %llu at 0x%03x", (unsigned long long)debug->stop_instruction, debug->stop_pc);
+			break;
+		default:
+			snprintf(buffer, size, "-");
+			break;
+	}
+}
+
+const char* chip8_debug_compile(CHIP8_DEBUG_EXPR* expr, const char* source) {
+
+	const size_t size = strlen(source) + 1;
+	if (size > CHIP8_DEBUG_MAX_SOURCE)
+		return "expression too long";
+
+	DEBUG_PARSER parser = { 0 };
+	parser.p = source;
+	parser.expr = expr;
+	expr->length = 0;
+
+	if (debug_parse_binary(&parser, 1) != 0)
+		return parser.error;
+
+	debug_skip_space(&parser);
+	if (*parser.p != '\0')
+		return "unexpected character";
+
+	memcpy(expr->source, source, size);
+	return NULL;
+}
+uint32_t chip8_debug_eval(const CHIP8_DEBUG_EXPR* expr, const CHIP8* cpu) {
+
+	/* compile checked the stack depth */
+	int32_t stack[CHIP8_DEBUG_MAX_DEPTH];
+	int top = 0;
+
+	for (int n = 0; n < expr->length; ++n) {
+		const CHIP8_DEBUG_INSTR* in = &expr->code[n];
+		switch (in->op) {
+			case DEBUG_OP_CONST:
+				stack[top++] = in->value;
+				continue;
+			case DEBUG_OP_V:
+				stack[top++] = cpu->v[in->value];
+				continue;
+			case DEBUG_OP_I:
+				stack[top++] = cpu->i;
+				continue;
+			case DEBUG_OP_PC:
+				stack[top++] = cpu->pc;
+				continue;
+			case DEBUG_OP_SP:
+				stack[top++] = cpu->sp;
+				continue;
+			case DEBUG_OP_DT:
+				stack[top++] = cpu->delay_timer;
+				continue;
+			case DEBUG_OP_ST:
+				stack[top++] = cpu->sound_timer;
+				continue;
+			case DEBUG_OP_KEYS:
+				stack[top++] = cpu->keypad;
+				continue;
+			case DEBUG_OP_RAM:
+				stack[top - 1] = cpu->ram[stack[top - 1] & CHIP8_ADDR_MASK];
+				continue;
+			case DEBUG_OP_NOT:
+				stack[top - 1] = !stack[top - 1];
+				continue;
+			case DEBUG_OP_NEG:
+				stack[top - 1] = -stack[top - 1];
+				continue;
+		}
+
+		/* binary */
+		const int32_t b = stack[--top];
+		int32_t* a = &stack[top - 1];
+		switch (in->op) {
+			case DEBUG_OP_LOR:
+				*a = (*a || b);
+				break;
+			case DEBUG_OP_LAND:
+				*a = (*a && b);
+				break;
+			case DEBUG_OP_OR:
+				*a |= b;
+				break;
+			case DEBUG_OP_XOR:
+				*a ^= b;
+				break;
+			case DEBUG_OP_AND:
+				*a &= b;
+				break;
+			case DEBUG_OP_EQ:
+				*a = (*a == b);
+				break;
+			case DEBUG_OP_NE:
+				*a = (*a != b);
+				break;
+			case DEBUG_OP_LT:
+				*a = (*a < b);
+				break;
+			case DEBUG_OP_LE:
+				*a = (*a <= b);
+				break;
+			case DEBUG_OP_GT:
+				*a = (*a > b);
+				break;
+			case DEBUG_OP_GE:
+				*a = (*a >= b);
+				break;
+			case DEBUG_OP_ADD:
+				*a += b;
+				break;
+			case DEBUG_OP_SUB:
+				*a -= b;
+				break;
+		}
+	}
+	return (uint32_t)stack[0];
+}
+
+int chip8_debug_run(CHIP8_MACHINE* machine, int budget) {
+
+	CHIP8* cpu = &machine->cpu;
+	CHIP8_DEBUG* debug = machine->debug;
+
+	/* the core runs what it can; everything else steps the cache, which
+	   invalidates what it writes for the other engines */
+	const int core = (machine->engine == CHIP8_ENGINE_CORE && machine->platform == CHIP8_PLATFORM_CHIP8);
+	const int profiling = (machine->profile != NULL && machine->profile->enabled);
+
+	int count = 0;
+	while (count < budget && cpu->draw_display == 0 && cpu->cpu_state == CHIP8_STATE_EXE) {
+
+		const uint64_t instruction = machine->instruction_count + count;
+		if (debug_check(debug, machine, instruction))
+			break;
+
+		if (profiling)
+			chip8_profile_execute(machine, core);
+		else if (core)
+			chip8_execute(cpu);
+		else
+			chip8_decode_step(machine);
+		count++;
+
+		if (debug->run_count != CHIP8_DEBUG_OFF) {
+			debug->run_count--;
+		}
+	}
+	return count;
+}
+
+static int debug_check(CHIP8_DEBUG* debug, CHIP8_MACHINE* machine, uint64_t instruction) {
+
+	/* before each instruction. returns 1 if the cpu was stopped */
+	const CHIP8* cpu = &machine->cpu;
+
+	/* watches see changes made by the last instruction and the timers */
+	for (int n = 0; n < debug->watch_count; ++n) {
+		CHIP8_DEBUG_WATCH* watch = &debug->watches[n];
+		const uint32_t value = chip8_debug_eval(&watch->expr, cpu);
+		if (value != watch->value) {
+			debug->stop_index = n;
+			debug->stop_old = watch->value;
+			debug->stop_new = value;
+			chip8_debug_sync(debug, cpu);
+			debug_stop(debug, machine, CHIP8_DEBUG_STOP_WATCH, instruction);
+			return 1;
+		}
+	}
+
+	if (debug->run_count == 0) {
+		debug_stop(debug, machine, CHIP8_DEBUG_STOP_RUN_COUNT, instruction);
+		return 1;
+	}
+
+	if (instruction == debug->skip_instruction && cpu->pc == debug->skip_pc)
+		return 0; // continuing from this stop
+
+	if (debug->breakpoints[cpu->pc & CHIP8_ADDR_MASK]) {
+		debug_stop(debug, machine, CHIP8_DEBUG_STOP_BREAKPOINT, instruction);
+		return 1;
+	}
+
+	if (debug->run_to == cpu->pc && (debug->run_to_sp < 0 || debug->run_to_sp == cpu->sp)) {
+		debug_stop(debug, machine, CHIP8_DEBUG_STOP_RUN_TO, instruction);
+		return 1;
+	}
+
+	for (int n = 0; n < debug->condition_count; ++n) {
+		if (chip8_debug_eval(&debug->conditions[n], cpu) != 0) {
+			debug->stop_index = n;
+			debug_stop(debug, machine, CHIP8_DEBUG_STOP_CONDITION, instruction);
+			return 1;
+		}
+	}
+	return 0;
+}
+static void debug_stop(CHIP8_DEBUG* debug, CHIP8_MACHINE* machine, CHIP8_DEBUG_STOP stop, uint64_t instruction) {
+	machine->cpu.cpu_state = CHIP8_STATE_HLT;
+	debug->stops++;
+	debug->stop = stop;
+	debug->stop_pc = machine->cpu.pc;
+	debug->stop_instruction = instruction;
+	debug->skip_instruction = instruction;
+	debug->skip_pc = machine->cpu.pc;
+
+	/* run to and run N are one shot */
+	debug->run_to = CHIP8_DEBUG_OFF;
+	debug->run_to_sp = -1;
+	debug->run_count = CHIP8_DEBUG_OFF;
+	debug_update_armed(debug);
+}
+static void debug_update_armed(CHIP8_DEBUG* debug) {
+	debug->armed = debug->breakpoint_count > 0 || debug->watch_count > 0 || debug->condition_count > 0 ||
+		debug->run_to != CHIP8_DEBUG_OFF || debug->run_count != CHIP8_DEBUG_OFF;
+}
+
+static int debug_parse_binary(DEBUG_PARSER* parser, int precedence) {
+
+	/* precedence climbing; operators of one level are left associative */
+	if (debug_parse_unary(parser) != 0)
+		return 1;
+
+	for (;;) {
+		debug_skip_space(parser);
+
+		int match = -1;
+		for (int n = 0; n < (int)(sizeof(debug_binary_ops) / sizeof(debug_binary_ops[0])); ++n) {
+			const size_t length = strlen(debug_binary_ops[n].text);
+			if (strncmp(parser->p, debug_binary_ops[n].text, length) == 0) {
+				match = n;
+				break;
+			}
+		}
+		if (match < 0 || debug_binary_ops[match].precedence < precedence)
+			return 0;
+
+		parser->p += strlen(debug_binary_ops[match].text);
+		if (debug_parse_binary(parser, debug_binary_ops[match].precedence + 1) != 0)
+			return 1;
+		if (debug_emit(parser, debug_binary_ops[match].op, 0, -1) != 0)
+			return 1;
+	}
+}
+static int debug_parse_unary(DEBUG_PARSER* parser) {
+
+	debug_skip_space(parser);
+	const char c = *parser->p;
+
+	if (c == '!' || c == '-') {
+		parser->p++;
+		if (debug_parse_unary(parser) != 0)
+			return 1;
+		return debug_emit(parser, (c == '!') ? DEBUG_OP_NOT : DEBUG_OP_NEG, 0, 0);
+	}
+
+	if (c == '(' || c == '[') {
+		parser->p++;
+		if (debug_parse_binary(parser, 1) != 0)
+			return 1;
+		debug_skip_space(parser);
+		if (*parser->p != ((c == '(') ? ')' : ']')) {
+			parser->error = (c == '(') ? "missing )" : "missing ]";
+			return 1;
+		}
+		parser->p++;
+		return (c == '[') ? debug_emit(parser, DEBUG_OP_RAM, 0, 0) : 0;
+	}
+
+	if (isdigit((unsigned char)c)) {
+		char* end = NULL;
+		const int hex = (c == '0' && (parser->p[1] == 'x' || parser->p[1] == 'X'));
+		const unsigned long value = strtoul(parser->p, &end, hex ? 16 : 10);
+		if (value > 0xFFFF) {
+			parser->error = "number too big";
+			return 1;
+		}
+		parser->p = end;
+		return debug_emit(parser, DEBUG_OP_CONST, (uint16_t)value, 1);
+	}
+
+	if (isalpha((unsigned char)c)) {
+		char name[8] = { 0 };
+		int length = 0;
+		while (isalnum((unsigned char)parser->p[length])) {
+			if (length < (int)sizeof(name) - 1) {
+				name[length] = (char)tolower((unsigned char)parser->p[length]);
+			}
+			length++;
+		}
+
+		if (length == 2 && name[0] == 'v' && isxdigit((unsigned char)name[1])) {
+			parser->p += length;
+			return debug_emit(parser, DEBUG_OP_V, (uint16_t)strtoul(name + 1, NULL, 16), 1);
+		}
+		for (int n = 0; n < (int)(sizeof(debug_operands) / sizeof(debug_operands[0])); ++n) {
+			if (length < (int)sizeof(name) && strcmp(name, debug_operands[n].name) == 0) {
+				parser->p += length;
+				return debug_emit(parser, debug_operands[n].op, 0, 1);
+			}
+		}
+		parser->error = "unknown name";
+		return 1;
+	}
+
+	parser->error = (c == '\0') ? "expected a value" : "unexpected character";
+	return 1;
+}
+static int debug_emit(DEBUG_PARSER* parser, uint8_t op, uint16_t value, int depth) {
+	CHIP8_DEBUG_EXPR* expr = parser->expr;
+	if (expr->length == CHIP8_DEBUG_MAX_CODE) {
+		parser->error = "expression too long";
+		return 1;
+	}
+
+	parser->depth += depth;
+	if (parser->depth > CHIP8_DEBUG_MAX_DEPTH) {
+		parser->error = "expression too deep";
+		return 1;
+	}
+
+	expr->code[expr->length].op = op;
+	expr->code[expr->length].value = value;
+	expr->length++;
+	return 0;
+}
+static void debug_skip_space(DEBUG_PARSER* parser) {
+	while (*parser->p == ' ' || *parser->p == '\t') {
+		parser->p++;
+	}
+}
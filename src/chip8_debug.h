@@ -0,0 +1,148 @@
+/* chip8_debug.h
+* Debugger. PC breakpoints, watch expressions and break conditions compiled
+* to a small stack bytecode, run to address, step over and run N. While
+* nothing is armed the engines run unchecked. No SDL / IMGUI dependencies.
+* GitHub: https:\\github.com\tommojphillips
+*/
+
+#ifndef CHIP8_DEBUG_H
+#define CHIP8_DEBUG_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "chip8.h" // chip8 cpu core
+
+/* Watches and break conditions */
+#define CHIP8_DEBUG_MAX_WATCHES 8
+#define CHIP8_DEBUG_MAX_CONDITIONS 8
+
+/* Expression limits */
+#define CHIP8_DEBUG_MAX_SOURCE 64
+#define CHIP8_DEBUG_MAX_CODE 32
+#define CHIP8_DEBUG_MAX_DEPTH 8
+
+/* run_to / run_count not set */
+#define CHIP8_DEBUG_OFF UINT64_MAX
+
+typedef struct CHIP8_MACHINE CHIP8_MACHINE;
+
+/* Why the debugger stopped the cpu */
+typedef enum {
+	CHIP8_DEBUG_STOP_NONE = 0,
+	CHIP8_DEBUG_STOP_BREAKPOINT = 1, // before the instruction at a breakpoint
+	CHIP8_DEBUG_STOP_WATCH = 2, // a watch changed value
+	CHIP8_DEBUG_STOP_CONDITION = 3, // a break condition was true
+	CHIP8_DEBUG_STOP_RUN_TO = 4, // reached the run to address or stepped over a call
+	CHIP8_DEBUG_STOP_RUN_COUNT = 5, // ran the instructions asked for
+} CHIP8_DEBUG_STOP;
+
+/* Expression instruction */
+typedef struct {
+	uint8_t op;
+	uint16_t value; // constant or register
+} CHIP8_DEBUG_INSTR;
+
+/* Compiled expression. Operands are v0 - vf, i, pc, sp, dt, st, keys,
+   numbers (0x hex) and [addr] for a byte of RAM. Operators are C's
+   || && | ^ & == != < <= > >= + - and unary ! - with parentheses */
+typedef struct {
+	char source[CHIP8_DEBUG_MAX_SOURCE];
+	CHIP8_DEBUG_INSTR code[CHIP8_DEBUG_MAX_CODE];
+	int length;
+} CHIP8_DEBUG_EXPR;
+
+/* Watch. Stops the cpu when its value changes */
+typedef struct {
+	CHIP8_DEBUG_EXPR expr;
+	uint32_t value; // value at the last check
+} CHIP8_DEBUG_WATCH;
+
+/* Debugger */
+typedef struct CHIP8_DEBUG {
+	int armed; // something to check. 0 = the engines run unchecked
+
+	uint8_t breakpoints[CHIP8_MEMORY_BYTES]; // 1 = stop before the instruction at this address
+	int breakpoint_count;
+
+	CHIP8_DEBUG_WATCH watches[CHIP8_DEBUG_MAX_WATCHES];
+	int watch_count;
+	CHIP8_DEBUG_EXPR conditions[CHIP8_DEBUG_MAX_CONDITIONS];
+	int condition_count;
+
+	/* one shot; cleared when the debugger stops the cpu */
+	uint64_t run_to; // stop before this address; CHIP8_DEBUG_OFF if not set
+	int run_to_sp; // step over; only at this stack depth. -1 = any
+	uint64_t run_count; // instructions left to run; CHIP8_DEBUG_OFF if not set
+
+	/* last stop */
+	uint64_t stops; // times the debugger stopped the cpu
+	CHIP8_DEBUG_STOP stop;
+	int stop_index; // watch or condition that stopped the cpu
+	uint16_t stop_pc;
+	uint32_t stop_old; // watch value before the change
+	uint32_t stop_new; // watch value after the change
+	uint64_t stop_instruction; // instruction count the cpu stopped at
+
+	/* a stop before an instruction does not stop it again on continue */
+	uint64_t skip_instruction;
+	uint16_t skip_pc;
+} CHIP8_DEBUG;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Allocate a debugger with nothing armed. returns NULL on failure */
+CHIP8_DEBUG* chip8_debug_create();
+
+/* Free a debugger */
+void chip8_debug_destroy(CHIP8_DEBUG* debug);
+
+/* Remove every breakpoint, watch and condition */
+void chip8_debug_clear(CHIP8_DEBUG* debug);
+
+/* Set or clear a breakpoint */
+void chip8_debug_set_breakpoint(CHIP8_DEBUG* debug, uint16_t addr, int set);
+
+/* Add a watch. returns 0 on success, 1 if the expression does not compile
+   or the watches are full */
+int chip8_debug_add_watch(CHIP8_DEBUG* debug, const CHIP8* cpu, const char* source);
+
+/* Add a break condition. returns 0 on success, 1 if the expression does
+   not compile or the conditions are full */
+int chip8_debug_add_condition(CHIP8_DEBUG* debug, const char* source);
+
+/* Remove a watch or condition by index */
+void chip8_debug_remove_watch(CHIP8_DEBUG* debug, int index);
+void chip8_debug_remove_condition(CHIP8_DEBUG* debug, int index);
+
+/* Run until pc is addr. sp >= 0 also waits for that stack depth */
+void chip8_debug_run_to(CHIP8_DEBUG* debug, uint16_t addr, int sp);
+
+/* Run count instructions */
+void chip8_debug_run_count(CHIP8_DEBUG* debug, uint64_t count);
+
+/* Take the current watch values; after an edit or a load so the edit
+   does not stop the cpu */
+void chip8_debug_sync(CHIP8_DEBUG* debug, const CHIP8* cpu);
+
+/* Describe the last stop, e.g. "breakpoint at 0x2a4" */
+void chip8_debug_describe_stop(const CHIP8_DEBUG* debug, char* buffer, size_t size);
+
+/* Compile an expression. returns NULL on success, else what is wrong with it */
+const char* chip8_debug_compile(CHIP8_DEBUG_EXPR* expr, const char* source);
+
+/* Evaluate a compiled expression */
+uint32_t chip8_debug_eval(const CHIP8_DEBUG_EXPR* expr, const CHIP8* cpu);
+
+/* Run up to budget instructions one at a time, checking before each. Stops
+   early like the engines, or halts the cpu when the debugger stops it.
+   returns instructions executed */
+int chip8_debug_run(CHIP8_MACHINE* machine, int budget);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif
@@ -0,0 +1,461 @@
+/* chip8_decode.c
+* Predecoded instruction cache.
+
+* Every entry starts out pointing at op_decode(). The first time an address
+* is executed the opcode is decoded, the entry is rewritten with the real
+* handler and the handler is run. Writes to RAM reset the overlapping
+* entries back to op_decode() so self modifying programs stay correct.
+
+* Handlers implement the instructions whose behaviour is fully described by
+* the CHIP8 struct, plus DXYN which draws through chip8_display.c.
+* Instructions that depend on core internals (stack, font, keypad, key wait)
+* are handed to chip8_execute().
+
+* On SUPER-CHIP and XO-CHIP the display instructions draw into the machine's
+* frame and the instructions those platforms add are handled here; the core
+* only knows CHIP-8. The platform is picked at decode time like the quirks.
+
+* Handlers that depend on a quirk are instantiated for both settings (DXYN
+* for all four settings of display clipping and display wait) and the
+* decoder picks the one matching the quirks at decode time, so no quirk is
+* tested per instruction. Changing quirks invalidates the cache.
+
+* GitHub: https:\\github.com\tommojphillips
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "chip8_decode.h"
+#include "chip8_threaded.h"
+#include "chip8_jit.h"
+#include "chip8_machine.h"
+#include "chip8_display.h"
+#include "chip8.h" // chip8 cpu core
+
+#define V (machine->cpu.v)
+#define VF (machine->cpu.v[0xF])
+#define PC (machine->cpu.pc)
+#define I (machine->cpu.i)
+#define RAM (machine->cpu.ram)
+#define QUIRKS (machine->cpu.quirks)
+#define SCREEN (machine->screen)
+
+static void op_decode(CHIP8_MACHINE* machine, const CHIP8_DECODED_OP* op);
+
+void chip8_decode_invalidate_all(CHIP8_MACHINE* machine) {
+	for (int i = 0; i < CHIP8_MEMORY_BYTES; ++i) {
+		machine->op_cache[i].fn = op_decode;
+	}
+	if (machine->threaded != NULL) {
+		chip8_threaded_invalidate_all(machine->threaded);
+	}
+	if (machine->jit != NULL) {
+		chip8_jit_invalidate_all(machine->jit);
+	}
+}
+void chip8_decode_invalidate(CHIP8_MACHINE* machine, uint16_t addr, uint16_t size) {
+	/* an op at addr - 1 reads the byte at addr as its low byte */
+	for (int i = -1; i < (int)size; ++i) {
+		machine->op_cache[(addr + i) & CHIP8_ADDR_MASK].fn = op_decode;
+	}
+	if (machine->threaded != NULL) {
+		chip8_threaded_invalidate(machine->threaded, addr, size);
+	}
+	if (machine->jit != NULL) {
+		chip8_jit_invalidate(machine->jit, addr, size);
+	}
+}
+void chip8_decode_write_ram(CHIP8_MACHINE* machine, uint16_t addr, uint8_t value) {
+	RAM[addr & CHIP8_ADDR_MASK] = value;
+	chip8_decode_invalidate(machine, addr, 1);
+}
+
+/* Instantiate handler name(machine, op, quirk) as name_q0 / name_q1 */
+#define QUIRK_HANDLER(name) \
+	static void name##_q0(CHIP8_MACHINE* machine, const CHIP8_DECODED_OP* op) { name(machine, op, 0); } \
+	static void name##_q1(CHIP8_MACHINE* machine, const CHIP8_DECODED_OP* op) { name(machine, op, 1); }
+
+/* Pick the instance of name for quirk */
+#define QUIRK_SELECT(name, quirk) ((quirks & (quirk)) ? name##_q1 : name##_q0)
+
+/* Instantiate handler name(machine, op, quirk) of two quirks as name_q0 .. name_q3;
+   bit 0 of quirk is the first quirk, bit 1 the second */
+#define QUIRK_HANDLER2(name) \
+	QUIRK_HANDLER(name) \
+	static void name##_q2(CHIP8_MACHINE* machine, const CHIP8_DECODED_OP* op) { name(machine, op, 2); } \
+	static void name##_q3(CHIP8_MACHINE* machine, const CHIP8_DECODED_OP* op) { name(machine, op, 3); }
+
+/* Pick the instance of name for quirk0 and quirk1 */
+#define QUIRK_SELECT2(name, quirk0, quirk1) ((quirks & (quirk1)) ? \
+	((quirks & (quirk0)) ? name##_q3 : name##_q2) : \
+	((quirks & (quirk0)) ? name##_q1 : name##_q0))
+
+/* DXYN quirk bits of the two quirk handlers */
+#define DXYN_CLIP 1
+#define DXYN_WAIT 2
+
+/* Handlers */
+
+static void op_core(CHIP8_MACHINE* machine, const CHIP8_DECODED_OP* op) {
+	chip8_execute(&machine->cpu);
+}
+
+static void op_1nnn(CHIP8_MACHINE* machine, const CHIP8_DECODED_OP* op) {
+	PC = op->nnn;
+}
+static void op_3xnn(CHIP8_MACHINE* machine, const CHIP8_DECODED_OP* op) {
+	PC += (V[op->x] == op->nn) ? 4 : 2;
+}
+static void op_4xnn(CHIP8_MACHINE* machine, const CHIP8_DECODED_OP* op) {
+	PC += (V[op->x] != op->nn) ? 4 : 2;
+}
+static void op_5xy0(CHIP8_MACHINE* machine, const CHIP8_DECODED_OP* op) {
+	PC += (V[op->x] == V[op->y]) ? 4 : 2;
+}
+static void op_6xnn(CHIP8_MACHINE* machine, const CHIP8_DECODED_OP* op) {
+	V[op->x] = op->nn;
+	PC += 2;
+}
+static void op_7xnn(CHIP8_MACHINE* machine, const CHIP8_DECODED_OP* op) {
+	V[op->x] += op->nn;
+	PC += 2;
+}
+static void op_8xy0(CHIP8_MACHINE* machine, const CHIP8_DECODED_OP* op) {
+	V[op->x] = V[op->y];
+	PC += 2;
+}
+static inline void op_8xy1(CHIP8_MACHINE* machine, const CHIP8_DECODED_OP* op, const int quirk) {
+	V[op->x] |= V[op->y];
+	if (quirk)
+		VF = 0;
+	PC += 2;
+}
+static inline void op_8xy2(CHIP8_MACHINE* machine, const CHIP8_DECODED_OP* op, const int quirk) {
+	V[op->x] &= V[op->y];
+	if (quirk)
+		VF = 0;
+	PC += 2;
+}
+static inline void op_8xy3(CHIP8_MACHINE* machine, const CHIP8_DECODED_OP* op, const int quirk) {
+	V[op->x] ^= V[op->y];
+	if (quirk)
+		VF = 0;
+	PC += 2;
+}
+static void op_8xy4(CHIP8_MACHINE* machine, const CHIP8_DECODED_OP* op) {
+	uint16_t r = V[op->x] + V[op->y];
+	V[op->x] = (uint8_t)r;
+	VF = (r > 0xFF);
+	PC += 2;
+}
+static void op_8xy5(CHIP8_MACHINE* machine, const CHIP8_DECODED_OP* op) {
+	uint8_t f = (V[op->x] >= V[op->y]);
+	V[op->x] = V[op->x] - V[op->y];
+	VF = f;
+	PC += 2;
+}
+static inline void op_8xy6(CHIP8_MACHINE* machine, const CHIP8_DECODED_OP* op, const int quirk) {
+	uint8_t s = quirk ? V[op->x] : V[op->y];
+	V[op->x] = s >> 1;
+	VF = s & 1;
+	PC += 2;
+}
+static void op_8xy7(CHIP8_MACHINE* machine, const CHIP8_DECODED_OP* op) {
+	uint8_t f = (V[op->y] >= V[op->x]);
+	V[op->x] = V[op->y] - V[op->x];
+	VF = f;
+	PC += 2;
+}
+static inline void op_8xye(CHIP8_MACHINE* machine, const CHIP8_DECODED_OP* op, const int quirk) {
+	uint8_t s = quirk ? V[op->x] : V[op->y];
+	V[op->x] = s << 1;
+	VF = s >> 7;
+	PC += 2;
+}
+static void op_9xy0(CHIP8_MACHINE* machine, const CHIP8_DECODED_OP* op) {
+	PC += (V[op->x] != V[op->y]) ? 4 : 2;
+}
+static void op_annn(CHIP8_MACHINE* machine, const CHIP8_DECODED_OP* op) {
+	I = op->nnn;
+	PC += 2;
+}
+static inline void op_bnnn(CHIP8_MACHINE* machine, const CHIP8_DECODED_OP* op, const int quirk) {
+	if (quirk)
+		PC = op->nnn + V[op->x];
+	else
+		PC = op->nnn + V[0];
+}
+static void op_cxnn(CHIP8_MACHINE* machine, const CHIP8_DECODED_OP* op) {
+	V[op->x] = chip8_machine_random(machine) & op->nn;
+	PC += 2;
+}
+static inline void op_dxyn(CHIP8_MACHINE* machine, const CHIP8_DECODED_OP* op, const int quirk) {
+	if (quirk & DXYN_CLIP)
+		chip8_display_draw_sprite_clip(&machine->cpu, V[op->x], V[op->y], op->n);
+	else
+		chip8_display_draw_sprite_wrap(&machine->cpu, V[op->x], V[op->y], op->n);
+
+	if (quirk & DXYN_WAIT)
+		machine->cpu.draw_display = 1; // stop until vblank
+	PC += 2;
+}
+static void op_fx07(CHIP8_MACHINE* machine, const CHIP8_DECODED_OP* op) {
+	V[op->x] = machine->cpu.delay_timer;
+	PC += 2;
+}
+static void op_fx15(CHIP8_MACHINE* machine, const CHIP8_DECODED_OP* op) {
+	machine->cpu.delay_timer = V[op->x];
+	PC += 2;
+}
+static void op_fx18(CHIP8_MACHINE* machine, const CHIP8_DECODED_OP* op) {
+	machine->cpu.sound_timer = V[op->x];
+	PC += 2;
+}
+static void op_fx1e(CHIP8_MACHINE* machine, const CHIP8_DECODED_OP* op) {
+	I += V[op->x];
+	PC += 2;
+}
+static void op_fx33(CHIP8_MACHINE* machine, const CHIP8_DECODED_OP* op) {
+	const uint8_t vx = V[op->x];
+	RAM[I & CHIP8_ADDR_MASK] = vx / 100;
+	RAM[(I + 1) & CHIP8_ADDR_MASK] = (vx / 10) % 10;
+	RAM[(I + 2) & CHIP8_ADDR_MASK] = vx % 10;
+	chip8_decode_invalidate(machine, I, 3);
+	PC += 2;
+}
+static inline void op_fx55(CHIP8_MACHINE* machine, const CHIP8_DECODED_OP* op, const int quirk) {
+	for (int i = 0; i <= op->x; ++i) {
+		RAM[(I + i) & CHIP8_ADDR_MASK] = V[i];
+	}
+	chip8_decode_invalidate(machine, I, op->x + 1);
+	if (quirk)
+		I += op->x + 1;
+	PC += 2;
+}
+static inline void op_fx65(CHIP8_MACHINE* machine, const CHIP8_DECODED_OP* op, const int quirk) {
+	for (int i = 0; i <= op->x; ++i) {
+		V[i] = RAM[(I + i) & CHIP8_ADDR_MASK];
+	}
+	if (quirk)
+		I += op->x + 1;
+	PC += 2;
+}
+
+/* SUPER-CHIP / XO-CHIP */
+
+static void op_00cn(CHIP8_MACHINE* machine, const CHIP8_DECODED_OP* op) {
+	chip8_frame_scroll_down(&SCREEN, machine->plane_mask, op->n);
+	PC += 2;
+}
+static void op_00dn(CHIP8_MACHINE* machine, const CHIP8_DECODED_OP* op) {
+	chip8_frame_scroll_up(&SCREEN, machine->plane_mask, op->n);
+	PC += 2;
+}
+static void op_00e0(CHIP8_MACHINE* machine, const CHIP8_DECODED_OP* op) {
+	chip8_frame_clear(&SCREEN, machine->plane_mask);
+	PC += 2;
+}
+static void op_00fb(CHIP8_MACHINE* machine, const CHIP8_DECODED_OP* op) {
+	chip8_frame_scroll_right(&SCREEN, machine->plane_mask);
+	PC += 2;
+}
+static void op_00fc(CHIP8_MACHINE* machine, const CHIP8_DECODED_OP* op) {
+	chip8_frame_scroll_left(&SCREEN, machine->plane_mask);
+	PC += 2;
+}
+static void op_00fd(CHIP8_MACHINE* machine, const CHIP8_DECODED_OP* op) {
+	machine->cpu.cpu_state = CHIP8_STATE_HLT;
+}
+static void op_00fe(CHIP8_MACHINE* machine, const CHIP8_DECODED_OP* op) {
+	chip8_frame_init(&SCREEN, 0);
+	PC += 2;
+}
+static void op_00ff(CHIP8_MACHINE* machine, const CHIP8_DECODED_OP* op) {
+	chip8_frame_init(&SCREEN, 1);
+	PC += 2;
+}
+static void op_5xy2(CHIP8_MACHINE* machine, const CHIP8_DECODED_OP* op) {
+	/* Vx .. Vy in either direction; I is not changed */
+	const int step = (op->x <= op->y) ? 1 : -1;
+	const int count = (op->x <= op->y) ? op->y - op->x + 1 : op->x - op->y + 1;
+	for (int i = 0; i < count; ++i) {
+		RAM[(I + i) & CHIP8_ADDR_MASK] = V[op->x + i * step];
+	}
+	chip8_decode_invalidate(machine, I, count);
+	PC += 2;
+}
+static void op_5xy3(CHIP8_MACHINE* machine, const CHIP8_DECODED_OP* op) {
+	const int step = (op->x <= op->y) ? 1 : -1;
+	const int count = (op->x <= op->y) ? op->y - op->x + 1 : op->x - op->y + 1;
+	for (int i = 0; i < count; ++i) {
+		V[op->x + i * step] = RAM[(I + i) & CHIP8_ADDR_MASK];
+	}
+	PC += 2;
+}
+static inline void op_dxyn_frame(CHIP8_MACHINE* machine, const CHIP8_DECODED_OP* op, const int quirk) {
+	int rows;
+	if (quirk & DXYN_CLIP)
+		rows = chip8_frame_draw_sprite_clip(&SCREEN, machine->plane_mask, &machine->cpu, V[op->x], V[op->y], op->n);
+	else
+		rows = chip8_frame_draw_sprite_wrap(&SCREEN, machine->plane_mask, &machine->cpu, V[op->x], V[op->y], op->n);
+
+	/* SUPER-CHIP hires counts the rows that collided */
+	if (machine->platform == CHIP8_PLATFORM_SCHIP && SCREEN.width == CHIP8_FRAME_MAX_WIDTH)
+		VF = (uint8_t)rows;
+	else
+		VF = (rows != 0);
+
+	if (quirk & DXYN_WAIT)
+		machine->cpu.draw_display = 1;
+	PC += 2;
+}
+static void op_fn01(CHIP8_MACHINE* machine, const CHIP8_DECODED_OP* op) {
+	machine->plane_mask = op->x;
+	PC += 2;
+}
+static void op_fx30(CHIP8_MACHINE* machine, const CHIP8_DECODED_OP* op) {
+	I = CHIP8_FRAME_BIG_FONT_ADDR + (V[op->x] & 0xF) * 10;
+	PC += 2;
+}
+static void op_fx75(CHIP8_MACHINE* machine, const CHIP8_DECODED_OP* op) {
+	for (int i = 0; i <= op->x; ++i) {
+		machine->rpl[i] = V[i];
+	}
+	PC += 2;
+}
+static void op_fx85(CHIP8_MACHINE* machine, const CHIP8_DECODED_OP* op) {
+	for (int i = 0; i <= op->x; ++i) {
+		V[i] = machine->rpl[i];
+	}
+	PC += 2;
+}
+
+QUIRK_HANDLER(op_8xy1)
+QUIRK_HANDLER(op_8xy2)
+QUIRK_HANDLER(op_8xy3)
+QUIRK_HANDLER(op_8xy6)
+QUIRK_HANDLER(op_8xye)
+QUIRK_HANDLER(op_bnnn)
+QUIRK_HANDLER(op_fx55)
+QUIRK_HANDLER(op_fx65)
+QUIRK_HANDLER2(op_dxyn)
+QUIRK_HANDLER2(op_dxyn_frame)
+
+static CHIP8_OP_FN decode_frame_handler(uint16_t opcode, uint8_t quirks, CHIP8_PLATFORM platform) {
+	/* SUPER-CHIP / XO-CHIP instructions. NULL for the rest */
+	const int xo = (platform == CHIP8_PLATFORM_XOCHIP);
+	switch (opcode >> 12) {
+		case 0x0:
+			if ((opcode & 0xFFF0) == 0x00C0) return op_00cn;
+			if ((opcode & 0xFFF0) == 0x00D0 && xo) return op_00dn;
+			switch (opcode) {
+				case 0x00E0: return op_00e0;
+				case 0x00FB: return op_00fb;
+				case 0x00FC: return op_00fc;
+				case 0x00FD: return op_00fd;
+				case 0x00FE: return op_00fe;
+				case 0x00FF: return op_00ff;
+			}
+			break;
+		case 0x5:
+			if ((opcode & 0xF) == 0x2 && xo) return op_5xy2;
+			if ((opcode & 0xF) == 0x3 && xo) return op_5xy3;
+			break;
+		case 0xD:
+			return QUIRK_SELECT2(op_dxyn_frame, CHIP8_QUIRK_DISPLAY_CLIPPING, CHIP8_QUIRK_DISPLAY_WAIT);
+		case 0xF:
+			switch (opcode & 0xFF) {
+				case 0x01: return xo ? op_fn01 : NULL;
+				case 0x30: return op_fx30;
+				case 0x75: return op_fx75;
+				case 0x85: return op_fx85;
+			}
+			break;
+	}
+	return NULL;
+}
+static CHIP8_OP_FN decode_handler(uint16_t opcode, uint8_t quirks, CHIP8_PLATFORM platform) {
+
+	if (platform != CHIP8_PLATFORM_CHIP8) {
+		CHIP8_OP_FN fn = decode_frame_handler(opcode, quirks, platform);
+		if (fn != NULL)
+			return fn;
+	}
+
+	switch (opcode >> 12) {
+		case 0x1: return op_1nnn;
+		case 0x3: return op_3xnn;
+		case 0x4: return op_4xnn;
+		case 0x5: return (opcode & 0xF) == 0 ? op_5xy0 : op_core;
+		case 0x6: return op_6xnn;
+		case 0x7: return op_7xnn;
+		case 0x8:
+			switch (opcode & 0xF) {
+				case 0x0: return op_8xy0;
+				case 0x1: return QUIRK_SELECT(op_8xy1, CHIP8_QUIRK_ZERO_VF_REGISTER);
+				case 0x2: return QUIRK_SELECT(op_8xy2, CHIP8_QUIRK_ZERO_VF_REGISTER);
+				case 0x3: return QUIRK_SELECT(op_8xy3, CHIP8_QUIRK_ZERO_VF_REGISTER);
+				case 0x4: return op_8xy4;
+				case 0x5: return op_8xy5;
+				case 0x6: return QUIRK_SELECT(op_8xy6, CHIP8_QUIRK_SHIFT_X_REGISTER);
+				case 0x7: return op_8xy7;
+				case 0xE: return QUIRK_SELECT(op_8xye, CHIP8_QUIRK_SHIFT_X_REGISTER);
+			}
+			break;
+		case 0x9: return (opcode & 0xF) == 0 ? op_9xy0 : op_core;
+		case 0xA: return op_annn;
+		case 0xB: return QUIRK_SELECT(op_bnnn, CHIP8_QUIRK_JUMP_VX);
+		case 0xC: return op_cxnn;
+		case 0xD: return QUIRK_SELECT2(op_dxyn, CHIP8_QUIRK_DISPLAY_CLIPPING, CHIP8_QUIRK_DISPLAY_WAIT);
+		case 0xF:
+			switch (opcode & 0xFF) {
+				case 0x07: return op_fx07;
+				case 0x15: return op_fx15;
+				case 0x18: return op_fx18;
+				case 0x1E: return op_fx1e;
+				case 0x33: return op_fx33;
+				case 0x55: return QUIRK_SELECT(op_fx55, CHIP8_QUIRK_INCREMENT_I_REGISTER);
+				case 0x65: return QUIRK_SELECT(op_fx65, CHIP8_QUIRK_INCREMENT_I_REGISTER);
+			}
+			break;
+	}
+
+	/* 00E0, 00EE, 2NNN, EX9E, EXA1, FX0A, FX29 and invalid opcodes */
+	return op_core;
+}
+
+void chip8_decode_op(CHIP8_MACHINE* machine, uint16_t addr, CHIP8_DECODED_OP* op) {
+	const uint16_t opcode = CHIP8_FETCH(RAM, addr);
+	op->opcode = opcode;
+	op->nnn = opcode & 0x0FFF;
+	op->x = (opcode >> 8) & 0xF;
+	op->y = (opcode >> 4) & 0xF;
+	op->n = opcode & 0xF;
+	op->nn = opcode & 0xFF;
+	op->fn = decode_handler(opcode, QUIRKS, machine->platform);
+}
+
+static void op_decode(CHIP8_MACHINE* machine, const CHIP8_DECODED_OP* op) {
+	CHIP8_DECODED_OP* entry = &machine->op_cache[PC & CHIP8_ADDR_MASK];
+	chip8_decode_op(machine, PC, entry);
+	entry->fn(machine, entry);
+}
+
+void chip8_decode_step(CHIP8_MACHINE* machine) {
+	const CHIP8_DECODED_OP* op = &machine->op_cache[PC & CHIP8_ADDR_MASK];
+	op->fn(machine, op);
+}
+int chip8_decode_run(CHIP8_MACHINE* machine, int budget) {
+
+	CHIP8* cpu = &machine->cpu;
+	const CHIP8_DECODED_OP* cache = machine->op_cache;
+
+	int count = 0;
+	while (count < budget && cpu->draw_display == 0 && cpu->cpu_state == CHIP8_STATE_EXE) {
+		const CHIP8_DECODED_OP* op = &cache[cpu->pc & CHIP8_ADDR_MASK];
+		op->fn(machine, op);
+		count++;
+	}
+	return count;
+}
@@ -0,0 +1,63 @@
+/* chip8_decode.h
+* Predecoded instruction cache. One entry per RAM address holding the
+* handler and the pre-extracted X/Y/N/NN/NNN fields of the opcode there.
+* GitHub: https:\\github.com\tommojphillips
+*/
+
+#ifndef CHIP8_DECODE_H
+#define CHIP8_DECODE_H
+
+#include <stdint.h>
+
+#include "chip8.h" // chip8 cpu core
+
+typedef struct CHIP8_MACHINE CHIP8_MACHINE;
+typedef struct CHIP8_DECODED_OP CHIP8_DECODED_OP;
+
+/* Execute a decoded op. Handlers advance the pc themselves */
+typedef void (*CHIP8_OP_FN)(CHIP8_MACHINE* machine, const CHIP8_DECODED_OP* op);
+
+/* Predecoded op */
+struct CHIP8_DECODED_OP {
+	CHIP8_OP_FN fn;
+	uint16_t opcode;
+	uint16_t nnn;
+	uint8_t x;
+	uint8_t y;
+	uint8_t n;
+	uint8_t nn;
+};
+
+#define CHIP8_ADDR_MASK (CHIP8_MEMORY_BYTES - 1)
+
+/* Fetch the opcode at addr */
+#define CHIP8_FETCH(ram, addr) ((uint16_t)(((ram)[(addr) & CHIP8_ADDR_MASK] << 8) | (ram)[((addr) + 1) & CHIP8_ADDR_MASK]))
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Mark the whole cache as undecoded */
+void chip8_decode_invalidate_all(CHIP8_MACHINE* machine);
+
+/* Mark the ops overlapping RAM[addr .. addr + size) as undecoded */
+void chip8_decode_invalidate(CHIP8_MACHINE* machine, uint16_t addr, uint16_t size);
+
+/* Write a byte of RAM and invalidate the ops that overlap it */
+void chip8_decode_write_ram(CHIP8_MACHINE* machine, uint16_t addr, uint8_t value);
+
+/* Decode the opcode at addr into op */
+void chip8_decode_op(CHIP8_MACHINE* machine, uint16_t addr, CHIP8_DECODED_OP* op);
+
+/* Run the instruction at pc from the cache, whatever the cpu state */
+void chip8_decode_step(CHIP8_MACHINE* machine);
+
+/* Run up to budget instructions from the cache. Stops early on a display
+   draw or if the cpu leaves the run state. returns instructions executed */
+int chip8_decode_run(CHIP8_MACHINE* machine, int budget);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif
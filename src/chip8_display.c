@@ -0,0 +1,230 @@
+/* chip8_display.c
+* Packed DXYN sprite draw; a shift, an AND and an XOR per sprite row.
+* The draws come in a wrap and a clip instance so the edge handling is
+* fixed by the caller's choice of function rather than tested per row.
+* SUPER-CHIP / XO-CHIP frame draws, clears and row parallel scrolls.
+* GitHub: https:\\github.com\tommojphillips
+*/
+
+#include <stdint.h>
+
+#include "chip8_display.h"
+#include "chip8_decode.h"
+#include "chip8.h" // chip8 cpu core
+
+/* DXYN body; clip is a constant in each instance */
+static inline void display_draw_sprite(CHIP8* cpu, uint8_t vx, uint8_t vy, uint8_t n, const int clip) {
+
+	const int x = vx & (CHIP8_DISPLAY_WIDTH - 1);
+	const int y = vy & (CHIP8_DISPLAY_HEIGHT - 1);
+
+	uint64_t collision = 0;
+	for (int r = 0; r < n; ++r) {
+
+		int py = y + r;
+		if (py >= CHIP8_DISPLAY_HEIGHT) {
+			if (clip)
+				break;
+			py -= CHIP8_DISPLAY_HEIGHT;
+		}
+
+		/* sprite byte at x; the part past the right edge wraps to x 0 */
+		const uint64_t sprite = (uint64_t)cpu->ram[(cpu->i + r) & CHIP8_ADDR_MASK] << 56;
+		uint64_t mask = sprite >> x;
+		if (!clip && x > CHIP8_DISPLAY_WIDTH - 8) {
+			mask |= sprite << (CHIP8_DISPLAY_WIDTH - x);
+		}
+
+		const uint64_t row = chip8_display_get_row(cpu->display, py);
+		collision |= row & mask;
+		chip8_display_set_row(cpu->display, py, row ^ mask);
+	}
+
+	cpu->v[0xF] = (collision != 0);
+}
+void chip8_display_draw_sprite_wrap(CHIP8* cpu, uint8_t vx, uint8_t vy, uint8_t n) {
+	display_draw_sprite(cpu, vx, vy, n, 0);
+}
+void chip8_display_draw_sprite_clip(CHIP8* cpu, uint8_t vx, uint8_t vy, uint8_t n) {
+	display_draw_sprite(cpu, vx, vy, n, 1);
+}
+
+const uint8_t chip8_frame_big_font[CHIP8_FRAME_BIG_FONT_BYTES] = {
+	0x3C, 0x7E, 0xE7, 0xC3, 0xC3, 0xC3, 0xC3, 0xE7, 0x7E, 0x3C, // 0
+	0x18, 0x38, 0x58, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x3C, // 1
+	0x3E, 0x7F, 0xC3, 0x06, 0x0C, 0x18, 0x30, 0x60, 0xFF, 0xFF, // 2
+	0x3C, 0x7E, 0xC3, 0x03, 0x0E, 0x0E, 0x03, 0xC3, 0x7E, 0x3C, // 3
+	0x06, 0x0E, 0x1E, 0x36, 0x66, 0xC6, 0xFF, 0xFF, 0x06, 0x06, // 4
+	0xFF, 0xFF, 0xC0, 0xC0, 0xFC, 0xFE, 0x03, 0xC3, 0x7E, 0x3C, // 5
+	0x3E, 0x7C, 0xC0, 0xC0, 0xFC, 0xFE, 0xC3, 0xC3, 0x7E, 0x3C, // 6
+	0xFF, 0xFF, 0x03, 0x06, 0x0C, 0x18, 0x30, 0x60, 0x60, 0x60, // 7
+	0x3C, 0x7E, 0xC3, 0xC3, 0x7E, 0x7E, 0xC3, 0xC3, 0x7E, 0x3C, // 8
+	0x3C, 0x7E, 0xC3, 0xC3, 0x7F, 0x3F, 0x03, 0x03, 0x3E, 0x7C, // 9
+	0x3C, 0x7E, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, // A
+	0xFC, 0xFE, 0xC3, 0xC3, 0xFE, 0xFE, 0xC3, 0xC3, 0xFE, 0xFC, // B
+	0x3C, 0x7E, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0x7E, 0x3C, // C
+	0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC, // D
+	0xFF, 0xFF, 0xC0, 0xC0, 0xFC, 0xFC, 0xC0, 0xC0, 0xFF, 0xFF, // E
+	0xFF, 0xFF, 0xC0, 0xC0, 0xFC, 0xFC, 0xC0, 0xC0, 0xC0, 0xC0, // F
+};
+
+void chip8_frame_init(CHIP8_FRAME* frame, int hires) {
+	frame->width = hires ? CHIP8_FRAME_MAX_WIDTH : CHIP8_FRAME_LORES_WIDTH;
+	frame->height = hires ? CHIP8_FRAME_MAX_HEIGHT : CHIP8_FRAME_LORES_HEIGHT;
+	frame->planes = 1;
+	memset(frame->rows, 0, sizeof(frame->rows));
+}
+void chip8_frame_from_display(CHIP8_FRAME* frame, const uint8_t* display) {
+	frame->width = CHIP8_DISPLAY_WIDTH;
+	frame->height = CHIP8_DISPLAY_HEIGHT;
+	frame->planes = 1;
+	for (int y = 0; y < CHIP8_DISPLAY_HEIGHT; ++y) {
+		frame->rows[0][y][0] = chip8_display_get_row(display, y);
+	}
+}
+void chip8_frame_clear(CHIP8_FRAME* frame, uint8_t plane_mask) {
+	for (int p = 0; p < CHIP8_FRAME_MAX_PLANES; ++p) {
+		if (plane_mask & (1 << p)) {
+			memset(frame->rows[p], 0, sizeof(frame->rows[p]));
+		}
+	}
+}
+
+/* Sprite row s (left aligned in bit 63) at x of a frame row; m[0] is pixels 0-63 */
+static inline void place_sprite_row(uint64_t s, int x, int width, const int clip, uint64_t m[CHIP8_FRAME_ROW_WORDS]) {
+	if (width == 64) {
+		m[0] = s >> x;
+		m[1] = 0;
+		if (!clip && x > 0)
+			m[0] |= s << (64 - x);
+		return;
+	}
+
+	if (x < 64) {
+		m[0] = s >> x;
+		m[1] = (x > 0) ? s << (64 - x) : 0;
+	}
+	else {
+		m[0] = 0;
+		m[1] = s >> (x - 64);
+		if (!clip && x > 64)
+			m[0] |= s << (128 - x);
+	}
+}
+/* Frame DXYN body; clip is a constant in each instance */
+static inline int frame_draw_sprite(CHIP8_FRAME* frame, uint8_t plane_mask, const CHIP8* cpu, uint8_t vx, uint8_t vy, uint8_t n, const int clip) {
+
+	const int width = frame->width;
+	const int height = frame->height;
+	const int words = CHIP8_FRAME_WORDS(frame);
+	const int x = vx & (width - 1);
+	const int y = vy & (height - 1);
+
+	/* n = 0 is a 16x16 sprite, two bytes a row */
+	const int wide = (n == 0);
+	const int lines = wide ? 16 : n;
+
+	uint16_t addr = cpu->i;
+	uint32_t collided = 0; // bit r = sprite row r
+	for (int p = 0; p < CHIP8_FRAME_MAX_PLANES; ++p) {
+
+		if ((plane_mask & (1 << p)) == 0)
+			continue;
+
+		for (int r = 0; r < lines; ++r) {
+
+			uint64_t s = (uint64_t)cpu->ram[(addr + r * (wide + 1)) & CHIP8_ADDR_MASK] << 56;
+			if (wide) {
+				s |= (uint64_t)cpu->ram[(addr + r * 2 + 1) & CHIP8_ADDR_MASK] << 48;
+			}
+
+			int py = y + r;
+			if (py >= height) {
+				if (clip)
+					break;
+				py -= height;
+			}
+
+			uint64_t m[CHIP8_FRAME_ROW_WORDS];
+			place_sprite_row(s, x, width, clip, m);
+
+			uint64_t* row = frame->rows[p][py];
+			for (int w = 0; w < words; ++w) {
+				if (row[w] & m[w])
+					collided |= 1u << r;
+				row[w] ^= m[w];
+			}
+		}
+
+		addr += lines * (wide + 1);
+		if (frame->planes < p + 1)
+			frame->planes = (uint8_t)(p + 1);
+	}
+
+	int count = 0;
+	for (; collided != 0; collided &= collided - 1) {
+		count++;
+	}
+	return count;
+}
+int chip8_frame_draw_sprite_wrap(CHIP8_FRAME* frame, uint8_t plane_mask, const CHIP8* cpu, uint8_t vx, uint8_t vy, uint8_t n) {
+	return frame_draw_sprite(frame, plane_mask, cpu, vx, vy, n, 0);
+}
+int chip8_frame_draw_sprite_clip(CHIP8_FRAME* frame, uint8_t plane_mask, const CHIP8* cpu, uint8_t vx, uint8_t vy, uint8_t n) {
+	return frame_draw_sprite(frame, plane_mask, cpu, vx, vy, n, 1);
+}
+
+void chip8_frame_scroll_down(CHIP8_FRAME* frame, uint8_t plane_mask, int n) {
+	const int height = frame->height;
+	if (n > height)
+		n = height;
+	for (int p = 0; p < CHIP8_FRAME_MAX_PLANES; ++p) {
+		if (plane_mask & (1 << p)) {
+			memmove(frame->rows[p][n], frame->rows[p][0], (height - n) * sizeof(frame->rows[p][0]));
+			memset(frame->rows[p][0], 0, n * sizeof(frame->rows[p][0]));
+		}
+	}
+}
+void chip8_frame_scroll_up(CHIP8_FRAME* frame, uint8_t plane_mask, int n) {
+	const int height = frame->height;
+	if (n > height)
+		n = height;
+	for (int p = 0; p < CHIP8_FRAME_MAX_PLANES; ++p) {
+		if (plane_mask & (1 << p)) {
+			memmove(frame->rows[p][0], frame->rows[p][n], (height - n) * sizeof(frame->rows[p][0]));
+			memset(frame->rows[p][height - n], 0, n * sizeof(frame->rows[p][0]));
+		}
+	}
+}
+void chip8_frame_scroll_right(CHIP8_FRAME* frame, uint8_t plane_mask) {
+	for (int p = 0; p < CHIP8_FRAME_MAX_PLANES; ++p) {
+		if ((plane_mask & (1 << p)) == 0)
+			continue;
+		for (int y = 0; y < frame->height; ++y) {
+			uint64_t* row = frame->rows[p][y];
+			if (frame->width == 64) {
+				row[0] >>= 4;
+			}
+			else {
+				row[1] = (row[1] >> 4) | (row[0] << 60);
+				row[0] >>= 4;
+			}
+		}
+	}
+}
+void chip8_frame_scroll_left(CHIP8_FRAME* frame, uint8_t plane_mask) {
+	for (int p = 0; p < CHIP8_FRAME_MAX_PLANES; ++p) {
+		if ((plane_mask & (1 << p)) == 0)
+			continue;
+		for (int y = 0; y < frame->height; ++y) {
+			uint64_t* row = frame->rows[p][y];
+			if (frame->width == 64) {
+				row[0] <<= 4;
+			}
+			else {
+				row[0] = (row[0] << 4) | (row[1] >> 60);
+				row[1] <<= 4;
+			}
+		}
+	}
+}
@@ -0,0 +1,155 @@
+/* chip8_display.h
+* Row access to the chip8 display, the packed DXYN sprite draw and the
+* SUPER-CHIP / XO-CHIP frame.
+
+* The core stores the display one bit per pixel, MSB first, so each 64 pixel
+* row is 8 bytes; read big endian that is one uint64_t with the left most
+* pixel in bit 63. Consumers that walk the display read it a row at a time
+* and skip empty rows instead of testing 2048 pixels.
+
+* A CHIP8_FRAME holds up to 128x64 pixels in up to 4 bitplanes in the same
+* row format, CHIP8_FRAME_ROW_WORDS words to a row. The machine draws SUPER-CHIP
+* and XO-CHIP programs into one and publishes every platform as one; sprites,
+* clears and scrolls work on whole rows of the selected planes.
+
+* GitHub: https:\\github.com\tommojphillips
+*/
+
+#ifndef CHIP8_DISPLAY_H
+#define CHIP8_DISPLAY_H
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include "chip8.h" // chip8 cpu core
+
+#define CHIP8_DISPLAY_ROW_BYTES (CHIP8_DISPLAY_WIDTH / 8)
+
+/* Pixel x of a display row */
+#define CHIP8_DISPLAY_ROW_PX(row, x) (((row) >> (63 - (x))) & 1)
+
+#define CHIP8_FRAME_LORES_WIDTH 64
+#define CHIP8_FRAME_LORES_HEIGHT 32
+#define CHIP8_FRAME_MAX_WIDTH 128
+#define CHIP8_FRAME_MAX_HEIGHT 64
+#define CHIP8_FRAME_MAX_PLANES 4
+#define CHIP8_FRAME_MAX_COLORS (1 << CHIP8_FRAME_MAX_PLANES)
+#define CHIP8_FRAME_ROW_WORDS (CHIP8_FRAME_MAX_WIDTH / 64)
+
+/* Address of the SUPER-CHIP 8x10 font, after the core's 4x5 font */
+#define CHIP8_FRAME_BIG_FONT_ADDR 0x0A0
+#define CHIP8_FRAME_BIG_FONT_BYTES 160
+
+/* Display frame. Bit 63 of rows[p][y][0] is pixel 0 of row y in plane p.
+   The color index of a pixel is its plane bits, plane 0 in bit 0 */
+typedef struct {
+	uint16_t width; // 64 or 128
+	uint16_t height; // 32 or 64
+	uint8_t planes; // planes drawn to, 1 - CHIP8_FRAME_MAX_PLANES
+	uint64_t rows[CHIP8_FRAME_MAX_PLANES][CHIP8_FRAME_MAX_HEIGHT][CHIP8_FRAME_ROW_WORDS];
+} CHIP8_FRAME;
+
+/* Words in use per row of a frame */
+#define CHIP8_FRAME_WORDS(frame) ((frame)->width / 64)
+
+#if defined(_MSC_VER)
+#define CHIP8_DISPLAY_BSWAP64(v) _byteswap_uint64(v)
+#elif (defined(__GNUC__) || defined(__clang__)) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define CHIP8_DISPLAY_BSWAP64(v) __builtin_bswap64(v)
+#endif
+
+/* Read row y of the display */
+static inline uint64_t chip8_display_get_row(const uint8_t* display, int y) {
+	const uint8_t* p = display + y * CHIP8_DISPLAY_ROW_BYTES;
+#ifdef CHIP8_DISPLAY_BSWAP64
+	uint64_t row;
+	memcpy(&row, p, sizeof(row));
+	return CHIP8_DISPLAY_BSWAP64(row);
+#else
+	uint64_t row = 0;
+	for (int i = 0; i < CHIP8_DISPLAY_ROW_BYTES; ++i) {
+		row = (row << 8) | p[i];
+	}
+	return row;
+#endif
+}
+
+/* Write row y of the display */
+static inline void chip8_display_set_row(uint8_t* display, int y, uint64_t row) {
+	uint8_t* p = display + y * CHIP8_DISPLAY_ROW_BYTES;
+#ifdef CHIP8_DISPLAY_BSWAP64
+	row = CHIP8_DISPLAY_BSWAP64(row);
+	memcpy(p, &row, sizeof(row));
+#else
+	for (int i = CHIP8_DISPLAY_ROW_BYTES - 1; i >= 0; --i) {
+		p[i] = (uint8_t)row;
+		row >>= 8;
+	}
+#endif
+}
+
+/* x of the left most lit pixel of a row. row must not be 0 */
+static inline int chip8_display_row_first_px(uint64_t row) {
+#if defined(_MSC_VER) && defined(_M_X64)
+	unsigned long index;
+	_BitScanReverse64(&index, row);
+	return 63 - (int)index;
+#elif defined(__GNUC__) || defined(__clang__)
+	return __builtin_clzll(row);
+#else
+	int x = 0;
+	while ((row & ((uint64_t)1 << 63)) == 0) {
+		row <<= 1;
+		x++;
+	}
+	return x;
+#endif
+}
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Clear the frame to 64x32 (hires = 0) or 128x64 (hires = 1) with one plane */
+void chip8_frame_init(CHIP8_FRAME* frame, int hires);
+
+/* Copy the core display into a 64x32 single plane frame */
+void chip8_frame_from_display(CHIP8_FRAME* frame, const uint8_t* display);
+
+/* Clear the planes in plane_mask */
+void chip8_frame_clear(CHIP8_FRAME* frame, uint8_t plane_mask);
+
+/* DXYN on a frame. XOR the sprite at I onto the planes in plane_mask at
+   (vx, vy); one sprite after the other per plane. n = 0 draws 16x16.
+   _wrap wraps at the edges, _clip clips.
+   returns the number of sprite rows that collided */
+int chip8_frame_draw_sprite_wrap(CHIP8_FRAME* frame, uint8_t plane_mask, const CHIP8* cpu, uint8_t vx, uint8_t vy, uint8_t n);
+int chip8_frame_draw_sprite_clip(CHIP8_FRAME* frame, uint8_t plane_mask, const CHIP8* cpu, uint8_t vx, uint8_t vy, uint8_t n);
+
+/* 00CN / 00DN. Scroll the planes in plane_mask down / up n rows */
+void chip8_frame_scroll_down(CHIP8_FRAME* frame, uint8_t plane_mask, int n);
+void chip8_frame_scroll_up(CHIP8_FRAME* frame, uint8_t plane_mask, int n);
+
+/* 00FB / 00FC. Scroll the planes in plane_mask right / left 4 pixels */
+void chip8_frame_scroll_right(CHIP8_FRAME* frame, uint8_t plane_mask);
+void chip8_frame_scroll_left(CHIP8_FRAME* frame, uint8_t plane_mask);
+
+/* SUPER-CHIP 8x10 hex font, CHIP8_FRAME_BIG_FONT_BYTES bytes */
+extern const uint8_t chip8_frame_big_font[CHIP8_FRAME_BIG_FONT_BYTES];
+
+/* DXYN. XOR the N byte sprite at I onto the display at (vx, vy) a row at a
+   time and set VF on collision. _wrap wraps at the edges, _clip clips.
+   The display wait quirk is left to the caller.
+   Does not advance pc */
+void chip8_display_draw_sprite_wrap(CHIP8* cpu, uint8_t vx, uint8_t vy, uint8_t n);
+void chip8_display_draw_sprite_clip(CHIP8* cpu, uint8_t vx, uint8_t vy, uint8_t n);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif
@@ -0,0 +1,94 @@
+/* chip8_framebuffer.c
+* Lock-free triple buffered display exchange between the emulator and the presenter.
+* GitHub: https:\\github.com\tommojphillips
+*/
+
+#include <stdint.h>
+#include <string.h>
+
+#include "chip8_framebuffer.h"
+#include "chip8_display.h"
+#include "thread.h"
+
+/* set in middle when it holds a frame the presenter has not taken */
+#define CHIP8_FRAMEBUFFER_FRESH 0x4
+#define CHIP8_FRAMEBUFFER_INDEX 0x3
+
+void chip8_framebuffer_init(CHIP8_FRAMEBUFFER* framebuffer) {
+	memset(framebuffer, 0, sizeof(CHIP8_FRAMEBUFFER));
+	for (int i = 0; i < 3; ++i) {
+		chip8_frame_init(&framebuffer->frames[i], 0);
+	}
+	framebuffer->front = 0;
+	framebuffer->middle = 1;
+	framebuffer->back = 2;
+	framebuffer->published = 1;
+	framebuffer->next_generation = 1;
+}
+
+int chip8_framebuffer_publish(CHIP8_FRAMEBUFFER* framebuffer, const CHIP8_FRAME* frame) {
+
+	/* the last published buffer is never written while it is the newest,
+	   so it can be read from either side */
+	const CHIP8_FRAME* last = &framebuffer->frames[framebuffer->published];
+	const int words = CHIP8_FRAME_WORDS(frame);
+	uint64_t dirty = 0;
+	if (last->width != frame->width || last->height != frame->height || last->planes != frame->planes) {
+		dirty = CHIP8_FRAMEBUFFER_ALL_ROWS;
+	}
+	else {
+		for (int y = 0; y < frame->height; ++y) {
+			for (int p = 0; p < frame->planes; ++p) {
+				if (memcmp(last->rows[p][y], frame->rows[p][y], words * sizeof(uint64_t)) != 0) {
+					dirty |= (uint64_t)1 << y;
+					break;
+				}
+			}
+		}
+	}
+	if (dirty == 0) {
+		return 0;
+	}
+
+	/* only the rows of the planes in use */
+	const int back = framebuffer->back;
+	CHIP8_FRAME* dst = &framebuffer->frames[back];
+	dst->width = frame->width;
+	dst->height = frame->height;
+	dst->planes = frame->planes;
+	for (int p = 0; p < frame->planes; ++p) {
+		memcpy(dst->rows[p], frame->rows[p], frame->height * sizeof(frame->rows[p][0]));
+	}
+	framebuffer->generation[back] = framebuffer->next_generation++;
+	framebuffer->dirty_rows[back] = dirty;
+
+	/* the exchange is a full barrier; the frame is visible before its index */
+	long old = thread_atomic_exchange(&framebuffer->middle, back | CHIP8_FRAMEBUFFER_FRESH);
+	framebuffer->back = (int)(old & CHIP8_FRAMEBUFFER_INDEX);
+	framebuffer->published = back;
+	return 1;
+}
+
+const CHIP8_FRAME* chip8_framebuffer_acquire(CHIP8_FRAMEBUFFER* framebuffer, uint64_t* generation) {
+
+	if (thread_atomic_load(&framebuffer->middle) & CHIP8_FRAMEBUFFER_FRESH) {
+		long old = thread_atomic_exchange(&framebuffer->middle, framebuffer->front);
+		framebuffer->front = (int)(old & CHIP8_FRAMEBUFFER_INDEX);
+	}
+
+	if (generation != NULL) {
+		*generation = framebuffer->generation[framebuffer->front];
+	}
+	return &framebuffer->frames[framebuffer->front];
+}
+uint64_t chip8_framebuffer_changed_rows(const CHIP8_FRAMEBUFFER* framebuffer, uint64_t since) {
+	const uint64_t generation = framebuffer->generation[framebuffer->front];
+	if (generation == since)
+		return 0;
+	if (generation == since + 1)
+		return framebuffer->dirty_rows[framebuffer->front];
+	return CHIP8_FRAMEBUFFER_ALL_ROWS;
+}
+int chip8_framebuffer_pending(CHIP8_FRAMEBUFFER* framebuffer) {
+	return (thread_atomic_load(&framebuffer->middle) & CHIP8_FRAMEBUFFER_FRESH) != 0;
+}
@@ -0,0 +1,63 @@
+/* chip8_framebuffer.h
+* Lock-free triple buffered display exchange between the emulator and the presenter.
+* GitHub: https:\\github.com\tommojphillips
+*/
+
+#ifndef CHIP8_FRAMEBUFFER_H
+#define CHIP8_FRAMEBUFFER_H
+
+#include <stdint.h>
+
+#include "chip8.h" // chip8 cpu core
+#include "chip8_display.h"
+
+/* Row mask with every frame row set. Bit y = row y */
+#define CHIP8_FRAMEBUFFER_ALL_ROWS (~(uint64_t)0)
+
+/* Three display buffers. The emulator owns back, the presenter owns front and
+   the newest complete frame sits in the middle. Either side swaps its buffer
+   with the middle in one atomic exchange; neither side ever waits or copies
+   the other's buffer */
+typedef struct {
+	CHIP8_FRAME frames[3];
+	uint64_t generation[3]; // generation of the frame in each buffer
+	uint64_t dirty_rows[3]; // rows that differ from the previous generation
+
+	volatile long middle; // index of the middle buffer | CHIP8_FRAMEBUFFER_FRESH
+
+	/* emulator side */
+	int back;
+	int published; // buffer holding the last published frame
+	uint64_t next_generation;
+
+	/* presenter side */
+	int front;
+} CHIP8_FRAMEBUFFER;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Init the buffers to a blank display at generation 0 */
+void chip8_framebuffer_init(CHIP8_FRAMEBUFFER* framebuffer);
+
+/* Emulator side. Publish a completed frame if it differs from the last one.
+   returns 1 if a new generation was published */
+int chip8_framebuffer_publish(CHIP8_FRAMEBUFFER* framebuffer, const CHIP8_FRAME* frame);
+
+/* Presenter side. Take the newest published frame if there is one.
+   returns the front buffer; valid until the next acquire. generation is set to its generation */
+const CHIP8_FRAME* chip8_framebuffer_acquire(CHIP8_FRAMEBUFFER* framebuffer, uint64_t* generation);
+
+/* Presenter side. Rows of the front buffer that changed after generation since.
+   Every row if a generation in between was skipped or the frame changed size or planes */
+uint64_t chip8_framebuffer_changed_rows(const CHIP8_FRAMEBUFFER* framebuffer, uint64_t since);
+
+/* Presenter side. returns 1 if a frame newer than the front buffer is waiting */
+int chip8_framebuffer_pending(CHIP8_FRAMEBUFFER* framebuffer);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif
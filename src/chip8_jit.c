@@ -0,0 +1,573 @@
+/* chip8_jit.c
+* x86-64 JIT. Translates basic blocks into native code. Linux only.
+
+* Blocks are discovered as execution reaches them, the same way the threaded
+* engine finds them. Each block is compiled into a function
+*   int block(CHIP8* cpu);
+* that works directly on the CHIP8 struct (rdi), writes the next pc and
+* returns the number of instructions it executed. Quirks are baked into the
+* code when the block is compiled; the cache is flushed if they change.
+
+* Only instructions that are fully described by the CHIP8 struct are
+* compiled: ALU, LD I, timers, FX1E, FX65, JP, the skips and BNNN. A block
+* ends in front of anything else (CXNN, DXYN, FX33, FX55 and everything
+* handed to chip8_execute()) and that instruction runs on the predecoded
+* cache. This is where display wait (DXYN), key wait (FX0A), RAM writes
+* and the stack are handled, so a block can never draw, block or modify
+* code. The run loop checks draw_display and the cpu state between blocks
+* exactly like the interpreter checks them between instructions.
+
+* A block is only entered when the remaining budget covers its worst case
+* instruction count; otherwise the tail of the budget runs on the
+* predecoded cache so instruction counts (and timer steps) stay exact.
+
+* The code buffer is never writable and executable at once. It is mapped
+* read / write, then read / execute; the pages a block is emitted into are
+* flipped to read / write for the compile and back to read / execute after
+* it. If the host refuses a flip everything runs on the predecoded cache.
+
+* GitHub: https:\\github.com\tommojphillips
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chip8_jit.h"
+#include "chip8_decode.h"
+#include "chip8_machine.h"
+#include "chip8.h" // chip8 cpu core
+
+#ifdef CHIP8_JIT_SUPPORTED
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define JIT_CODE_BYTES (256 * 1024)
+#define JIT_MAX_BLOCK_LEN 64
+#define JIT_MAX_OP_BYTES 512 // FX65 with x = F is the largest op
+#define JIT_MAX_BLOCK_BYTES ((JIT_MAX_BLOCK_LEN + 1) * JIT_MAX_OP_BYTES)
+
+#define JIT_BLOCK_NONE -1 // not compiled yet
+#define JIT_BLOCK_INTERPRET -2 // first instruction is not compiled; run it on the cache
+
+_Static_assert(sizeof(((CHIP8*)0)->pc) == 2, "jit expects a 16 bit pc");
+_Static_assert(sizeof(((CHIP8*)0)->i) == 2, "jit expects a 16 bit i register");
+_Static_assert(sizeof(((CHIP8*)0)->v[0]) == 1, "jit expects 8 bit v registers");
+
+/* CHIP8 field offsets from rdi */
+#define OFF_V(x) (uint32_t)(offsetof(CHIP8, v) + (x))
+#define OFF_VF OFF_V(0xF)
+#define OFF_I (uint32_t)offsetof(CHIP8, i)
+#define OFF_PC (uint32_t)offsetof(CHIP8, pc)
+#define OFF_DT (uint32_t)offsetof(CHIP8, delay_timer)
+#define OFF_ST (uint32_t)offsetof(CHIP8, sound_timer)
+#define OFF_RAM (uint32_t)offsetof(CHIP8, ram)
+
+/* x86 registers used by the emitter */
+#define R_AX 0
+#define R_CX 1
+
+/* x86 condition codes */
+#define CC_E 0x4
+#define CC_NE 0x5
+
+typedef int (*JIT_BLOCK_FN)(CHIP8* cpu);
+
+/* Code emitter */
+typedef struct {
+	uint8_t* p;
+} JIT_ASM;
+
+/* Block cache */
+struct CHIP8_JIT {
+	uint8_t* code; // mmap'd buffer; read / execute outside of a compile
+	uint32_t code_used;
+	int32_t block_map[CHIP8_MEMORY_BYTES]; // code offset of the block at addr, or JIT_BLOCK_*
+	uint8_t block_cost[CHIP8_MEMORY_BYTES]; // worst case instructions of the block at addr
+	uint8_t code_map[CHIP8_MEMORY_BYTES]; // RAM bytes covered by a block
+	uint8_t quirks; // quirks the blocks were compiled with
+	int dirty;
+	int disabled; // a protection flip failed; everything runs on the cache
+};
+
+static void flush(CHIP8_JIT* jit, uint8_t quirks);
+static int protect(CHIP8_JIT* jit, uint32_t offset, uint32_t size, int prot);
+static int32_t compile_block(CHIP8_MACHINE* machine, uint16_t start);
+
+CHIP8_JIT* chip8_jit_create() {
+	CHIP8_JIT* jit = (CHIP8_JIT*)malloc(sizeof(CHIP8_JIT));
+	if (jit == NULL) {
+		return NULL;
+	}
+
+	void* code = mmap(NULL, JIT_CODE_BYTES, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (code == MAP_FAILED) {
+		free(jit);
+		return NULL;
+	}
+
+	/* hardened hosts may refuse executable anonymous memory */
+	if (mprotect(code, JIT_CODE_BYTES, PROT_READ | PROT_EXEC) != 0) {
+		munmap(code, JIT_CODE_BYTES);
+		free(jit);
+		return NULL;
+	}
+
+	jit->code = (uint8_t*)code;
+	jit->disabled = 0;
+	flush(jit, 0);
+	jit->dirty = 1; // compile with the cpu quirks on first run
+	return jit;
+}
+void chip8_jit_destroy(CHIP8_JIT* jit) {
+	if (jit != NULL) {
+		munmap(jit->code, JIT_CODE_BYTES);
+		free(jit);
+	}
+}
+void chip8_jit_invalidate(CHIP8_JIT* jit, uint16_t addr, uint16_t size) {
+	for (int i = 0; i < size; ++i) {
+		if (jit->code_map[(addr + i) & CHIP8_ADDR_MASK]) {
+			jit->dirty = 1;
+			return;
+		}
+	}
+}
+void chip8_jit_invalidate_all(CHIP8_JIT* jit) {
+	jit->dirty = 1;
+}
+
+static void flush(CHIP8_JIT* jit, uint8_t quirks) {
+	for (int i = 0; i < CHIP8_MEMORY_BYTES; ++i) {
+		jit->block_map[i] = JIT_BLOCK_NONE;
+	}
+	memset(jit->code_map, 0, sizeof(jit->code_map));
+	jit->code_used = 0;
+	jit->quirks = quirks;
+	jit->dirty = 0;
+}
+static int protect(CHIP8_JIT* jit, uint32_t offset, uint32_t size, int prot) {
+
+	/* whole pages around code[offset .. offset + size) */
+	const uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+	const uintptr_t start = (uintptr_t)(jit->code + offset) & ~(page - 1);
+	uintptr_t end = ((uintptr_t)(jit->code + offset + size) + page - 1) & ~(page - 1);
+	if (end > (uintptr_t)(jit->code + JIT_CODE_BYTES)) {
+		end = (uintptr_t)(jit->code + JIT_CODE_BYTES);
+	}
+
+	if (mprotect((void*)start, end - start, prot) != 0) {
+		jit->disabled = 1;
+		return 1;
+	}
+	return 0;
+}
+
+/* Emitter */
+
+static void emit_u8(JIT_ASM* a, uint8_t b) {
+	*a->p++ = b;
+}
+static void emit_u16(JIT_ASM* a, uint16_t v) {
+	emit_u8(a, v & 0xFF);
+	emit_u8(a, v >> 8);
+}
+static void emit_u32(JIT_ASM* a, uint32_t v) {
+	emit_u16(a, v & 0xFFFF);
+	emit_u16(a, v >> 16);
+}
+
+/* modrm for [rdi + disp32] */
+static void emit_mem(JIT_ASM* a, int reg, uint32_t disp) {
+	emit_u8(a, 0x87 | (reg << 3));
+	emit_u32(a, disp);
+}
+
+/* op r8, [rdi + disp] / op [rdi + disp], r8 */
+static void emit_op_mem(JIT_ASM* a, uint8_t opcode, int reg, uint32_t disp) {
+	emit_u8(a, opcode);
+	emit_mem(a, reg, disp);
+}
+
+/* mov r8, byte [rdi + disp] */
+static void emit_load8(JIT_ASM* a, int reg, uint32_t disp) {
+	emit_op_mem(a, 0x8A, reg, disp);
+}
+
+/* mov byte [rdi + disp], r8 */
+static void emit_store8(JIT_ASM* a, int reg, uint32_t disp) {
+	emit_op_mem(a, 0x88, reg, disp);
+}
+
+/* mov byte [rdi + disp], imm8 */
+static void emit_store8_imm(JIT_ASM* a, uint32_t disp, uint8_t imm) {
+	emit_op_mem(a, 0xC6, 0, disp);
+	emit_u8(a, imm);
+}
+
+/* mov word [rdi + disp], imm16 */
+static void emit_store16_imm(JIT_ASM* a, uint32_t disp, uint16_t imm) {
+	emit_u8(a, 0x66);
+	emit_op_mem(a, 0xC7, 0, disp);
+	emit_u16(a, imm);
+}
+
+/* movzx eax, byte [rdi + disp] */
+static void emit_movzx8(JIT_ASM* a, uint32_t disp) {
+	emit_u8(a, 0x0F);
+	emit_op_mem(a, 0xB6, R_AX, disp);
+}
+
+/* movzx eax, word [rdi + disp] */
+static void emit_movzx16(JIT_ASM* a, uint32_t disp) {
+	emit_u8(a, 0x0F);
+	emit_op_mem(a, 0xB7, R_AX, disp);
+}
+
+/* setcc cl */
+static void emit_setcc_cl(JIT_ASM* a, uint8_t cc) {
+	emit_u8(a, 0x0F);
+	emit_u8(a, 0x90 | cc);
+	emit_u8(a, 0xC1);
+}
+
+/* mov eax, count; ret */
+static void emit_return(JIT_ASM* a, int count) {
+	emit_u8(a, 0xB8);
+	emit_u32(a, count);
+	emit_u8(a, 0xC3);
+}
+
+/* pc = next_pc; return count */
+static void emit_exit(JIT_ASM* a, uint16_t next_pc, int count) {
+	emit_store16_imm(a, OFF_PC, next_pc);
+	emit_return(a, count);
+}
+
+/* Exit on the flags of the previous compare. cc is the condition that
+   selects the taken exit; mov does not touch the flags */
+static void emit_branch_exit(JIT_ASM* a, uint8_t cc, uint16_t taken_pc, int taken_count, uint16_t not_taken_pc, int not_taken_count) {
+	emit_store16_imm(a, OFF_PC, not_taken_pc); // 9 bytes
+	emit_u8(a, 0xB8); // 5 bytes
+	emit_u32(a, not_taken_count);
+	emit_u8(a, 0x70 | (cc ^ 1)); // jncc over the taken exit
+	emit_u8(a, 14);
+	emit_store16_imm(a, OFF_PC, taken_pc);
+	emit_u8(a, 0xB8);
+	emit_u32(a, taken_count);
+	emit_u8(a, 0xC3);
+}
+
+/* Compare for a skip instruction. returns the condition that skips */
+static uint8_t emit_skip_compare(JIT_ASM* a, uint16_t opcode) {
+	const uint8_t x = (opcode >> 8) & 0xF;
+	const uint8_t y = (opcode >> 4) & 0xF;
+	const uint8_t nn = opcode & 0xFF;
+
+	switch (opcode >> 12) {
+		case 0x3:
+		case 0x4:
+			emit_op_mem(a, 0x80, 7, OFF_V(x)); // cmp byte [Vx], nn
+			emit_u8(a, nn);
+			break;
+		default:
+			emit_load8(a, R_AX, OFF_V(x));
+			emit_op_mem(a, 0x3A, R_AX, OFF_V(y)); // cmp al, [Vy]
+			break;
+	}
+
+	switch (opcode >> 12) {
+		case 0x3:
+		case 0x5:
+			return CC_E;
+		default:
+			return CC_NE;
+	}
+}
+
+/* Emit a straight line instruction. returns 0 if it is not compiled */
+static int emit_straight_line(JIT_ASM* a, uint16_t opcode, uint8_t quirks) {
+
+	const uint8_t x = (opcode >> 8) & 0xF;
+	const uint8_t y = (opcode >> 4) & 0xF;
+	const uint8_t nn = opcode & 0xFF;
+	const uint16_t nnn = opcode & 0x0FFF;
+
+	switch (opcode >> 12) {
+		case 0x6:
+			emit_store8_imm(a, OFF_V(x), nn);
+			return 1;
+		case 0x7:
+			emit_op_mem(a, 0x80, 0, OFF_V(x)); // add byte [Vx], nn
+			emit_u8(a, nn);
+			return 1;
+		case 0x8:
+			switch (opcode & 0xF) {
+				case 0x0:
+					emit_load8(a, R_AX, OFF_V(y));
+					emit_store8(a, R_AX, OFF_V(x));
+					return 1;
+				case 0x1:
+				case 0x2:
+				case 0x3: {
+					static const uint8_t logic_ops[] = { 0x08, 0x20, 0x30 }; // or, and, xor [Vx], al
+					emit_load8(a, R_AX, OFF_V(y));
+					emit_op_mem(a, logic_ops[(opcode & 0xF) - 1], R_AX, OFF_V(x));
+					if (quirks & CHIP8_QUIRK_ZERO_VF_REGISTER)
+						emit_store8_imm(a, OFF_VF, 0);
+					return 1;
+				}
+				case 0x4:
+					emit_load8(a, R_AX, OFF_V(x));
+					emit_op_mem(a, 0x02, R_AX, OFF_V(y)); // add al, [Vy]
+					emit_setcc_cl(a, 0x2); // setc
+					emit_store8(a, R_AX, OFF_V(x));
+					emit_store8(a, R_CX, OFF_VF);
+					return 1;
+				case 0x5:
+				case 0x7: {
+					const uint8_t lhs = ((opcode & 0xF) == 0x5) ? x : y;
+					const uint8_t rhs = ((opcode & 0xF) == 0x5) ? y : x;
+					emit_load8(a, R_AX, OFF_V(lhs));
+					emit_op_mem(a, 0x2A, R_AX, OFF_V(rhs)); // sub al, [rhs]
+					emit_setcc_cl(a, 0x3); // setnc
+					emit_store8(a, R_AX, OFF_V(x));
+					emit_store8(a, R_CX, OFF_VF);
+					return 1;
+				}
+				case 0x6:
+				case 0xE: {
+					const uint8_t s = (quirks & CHIP8_QUIRK_SHIFT_X_REGISTER) ? x : y;
+					emit_load8(a, R_AX, OFF_V(s));
+					emit_u8(a, 0x88); // mov cl, al
+					emit_u8(a, 0xC1);
+					if ((opcode & 0xF) == 0x6) {
+						emit_u8(a, 0xD0); // shr al, 1
+						emit_u8(a, 0xE8);
+						emit_u8(a, 0x80); // and cl, 1
+						emit_u8(a, 0xE1);
+						emit_u8(a, 0x01);
+					}
+					else {
+						emit_u8(a, 0xD0); // shl al, 1
+						emit_u8(a, 0xE0);
+						emit_u8(a, 0xC0); // shr cl, 7
+						emit_u8(a, 0xE9);
+						emit_u8(a, 0x07);
+					}
+					emit_store8(a, R_AX, OFF_V(x));
+					emit_store8(a, R_CX, OFF_VF);
+					return 1;
+				}
+			}
+			return 0;
+		case 0xA:
+			emit_store16_imm(a, OFF_I, nnn);
+			return 1;
+		case 0xF:
+			switch (nn) {
+				case 0x07:
+					emit_load8(a, R_AX, OFF_DT);
+					emit_store8(a, R_AX, OFF_V(x));
+					return 1;
+				case 0x15:
+					emit_load8(a, R_AX, OFF_V(x));
+					emit_store8(a, R_AX, OFF_DT);
+					return 1;
+				case 0x18:
+					emit_load8(a, R_AX, OFF_V(x));
+					emit_store8(a, R_AX, OFF_ST);
+					return 1;
+				case 0x1E:
+					emit_movzx8(a, OFF_V(x));
+					emit_u8(a, 0x66);
+					emit_op_mem(a, 0x01, R_AX, OFF_I); // add word [I], ax
+					return 1;
+				case 0x65:
+					for (int i = 0; i <= x; ++i) {
+						emit_movzx16(a, OFF_I);
+						if (i != 0) {
+							emit_u8(a, 0x05); // add eax, i
+							emit_u32(a, i);
+						}
+						emit_u8(a, 0x25); // and eax, CHIP8_ADDR_MASK
+						emit_u32(a, CHIP8_ADDR_MASK);
+						emit_u8(a, 0x8A); // mov cl, [rdi + rax + ram]
+						emit_u8(a, 0x8C);
+						emit_u8(a, 0x07);
+						emit_u32(a, OFF_RAM);
+						emit_store8(a, R_CX, OFF_V(i));
+					}
+					if (quirks & CHIP8_QUIRK_INCREMENT_I_REGISTER) {
+						emit_u8(a, 0x66);
+						emit_op_mem(a, 0x81, 0, OFF_I); // add word [I], x + 1
+						emit_u16(a, x + 1);
+					}
+					return 1;
+			}
+			return 0;
+	}
+	return 0;
+}
+
+static int is_skip(uint16_t opcode) {
+	switch (opcode >> 12) {
+		case 0x3:
+		case 0x4:
+			return 1;
+		case 0x5:
+		case 0x9:
+			return (opcode & 0xF) == 0;
+	}
+	return 0;
+}
+
+static int32_t compile_block(CHIP8_MACHINE* machine, uint16_t start) {
+
+	CHIP8_JIT* jit = machine->jit;
+	const uint8_t* ram = machine->cpu.ram;
+
+	if (JIT_CODE_BYTES - jit->code_used < JIT_MAX_BLOCK_BYTES) {
+		flush(jit, jit->quirks);
+	}
+
+	/* the pages this block can reach; read / execute again below */
+	const uint32_t window = jit->code_used;
+	if (protect(jit, window, JIT_MAX_BLOCK_BYTES, PROT_READ | PROT_WRITE) != 0) {
+		return JIT_BLOCK_INTERPRET;
+	}
+
+	const int32_t entry = (int32_t)jit->code_used;
+	JIT_ASM a = { jit->code + jit->code_used };
+	int cost = 0;
+	uint16_t addr = start;
+
+	for (;;) {
+		const uint16_t opcode = CHIP8_FETCH(ram, addr);
+
+		jit->code_map[addr & CHIP8_ADDR_MASK] = 1;
+		jit->code_map[(addr + 1) & CHIP8_ADDR_MASK] = 1;
+
+		if (emit_straight_line(&a, opcode, jit->quirks)) {
+			cost++;
+			addr += 2;
+			if (cost >= JIT_MAX_BLOCK_LEN || addr >= CHIP8_MEMORY_BYTES - 1) {
+				emit_exit(&a, addr, cost);
+				break;
+			}
+			continue;
+		}
+
+		if ((opcode >> 12) == 0x1) {
+			emit_exit(&a, opcode & 0x0FFF, cost + 1);
+			cost++;
+			break;
+		}
+
+		if ((opcode >> 12) == 0xB) {
+			const uint8_t r = (jit->quirks & CHIP8_QUIRK_JUMP_VX) ? ((opcode >> 8) & 0xF) : 0;
+			emit_movzx8(&a, OFF_V(r));
+			emit_u8(&a, 0x05); // add eax, nnn
+			emit_u32(&a, opcode & 0x0FFF);
+			emit_u8(&a, 0x66);
+			emit_op_mem(&a, 0x89, R_AX, OFF_PC); // mov word [pc], ax
+			emit_return(&a, cost + 1);
+			cost++;
+			break;
+		}
+
+		if (is_skip(opcode)) {
+			const uint16_t next = CHIP8_FETCH(ram, addr + 2);
+			const uint8_t cc = emit_skip_compare(&a, opcode);
+			if ((next >> 12) == 0x1) {
+				/* skip + jump: skipping steps over the jump, otherwise the jump is taken */
+				jit->code_map[(addr + 2) & CHIP8_ADDR_MASK] = 1;
+				jit->code_map[(addr + 3) & CHIP8_ADDR_MASK] = 1;
+				emit_branch_exit(&a, cc, addr + 4, cost + 1, next & 0x0FFF, cost + 2);
+				cost += 2;
+			}
+			else {
+				emit_branch_exit(&a, cc, addr + 4, cost + 1, addr + 2, cost + 1);
+				cost++;
+			}
+			break;
+		}
+
+		/* not compiled; the cache runs it */
+		if (cost == 0) {
+			jit->block_map[start] = JIT_BLOCK_INTERPRET;
+			break;
+		}
+		emit_exit(&a, addr, cost);
+		break;
+	}
+
+	if (protect(jit, window, JIT_MAX_BLOCK_BYTES, PROT_READ | PROT_EXEC) != 0) {
+		return JIT_BLOCK_INTERPRET;
+	}
+	if (cost == 0) {
+		return JIT_BLOCK_INTERPRET;
+	}
+
+	jit->code_used = (uint32_t)(a.p - jit->code);
+	jit->block_map[start] = entry;
+	jit->block_cost[start] = (uint8_t)cost;
+	return entry;
+}
+
+int chip8_jit_run(CHIP8_MACHINE* machine, int budget) {
+
+	CHIP8_JIT* jit = machine->jit;
+	CHIP8* cpu = &machine->cpu;
+	int count = 0;
+
+	while (count < budget && cpu->draw_display == 0 && cpu->cpu_state == CHIP8_STATE_EXE) {
+
+		if (jit->disabled) {
+			count += chip8_decode_run(machine, budget - count);
+			break;
+		}
+
+		if (jit->dirty || jit->quirks != cpu->quirks) {
+			flush(jit, cpu->quirks);
+		}
+
+		int32_t entry = JIT_BLOCK_INTERPRET;
+		if (cpu->pc <= CHIP8_ADDR_MASK) {
+			entry = jit->block_map[cpu->pc];
+			if (entry == JIT_BLOCK_NONE) {
+				entry = compile_block(machine, cpu->pc);
+			}
+		}
+
+		if (entry == JIT_BLOCK_INTERPRET) {
+			count += chip8_decode_run(machine, 1);
+		}
+		else if (budget - count < jit->block_cost[cpu->pc]) {
+			count += chip8_decode_run(machine, budget - count);
+		}
+		else {
+			count += ((JIT_BLOCK_FN)(jit->code + entry))(cpu);
+		}
+	}
+	return count;
+}
+
+#else
+
+CHIP8_JIT* chip8_jit_create() {
+	return NULL;
+}
+void chip8_jit_destroy(CHIP8_JIT* jit) {
+}
+void chip8_jit_invalidate(CHIP8_JIT* jit, uint16_t addr, uint16_t size) {
+}
+void chip8_jit_invalidate_all(CHIP8_JIT* jit) {
+}
+int chip8_jit_run(CHIP8_MACHINE* machine, int budget) {
+	return chip8_decode_run(machine, budget);
+}
+
+#endif
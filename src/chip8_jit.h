@@ -0,0 +1,44 @@
+/* chip8_jit.h
+* x86-64 JIT. Translates basic blocks into native code. Linux only.
+* GitHub: https:\\github.com\tommojphillips
+*/
+
+#ifndef CHIP8_JIT_H
+#define CHIP8_JIT_H
+
+#include <stdint.h>
+
+#include "chip8.h" // chip8 cpu core
+
+#if defined(__x86_64__) && defined(__linux__)
+#define CHIP8_JIT_SUPPORTED 1
+#endif
+
+typedef struct CHIP8_MACHINE CHIP8_MACHINE;
+typedef struct CHIP8_JIT CHIP8_JIT;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Map the code buffer. returns NULL on failure or if the host is not supported */
+CHIP8_JIT* chip8_jit_create();
+
+/* Unmap the code buffer */
+void chip8_jit_destroy(CHIP8_JIT* jit);
+
+/* Drop blocks overlapping RAM[addr .. addr + size) */
+void chip8_jit_invalidate(CHIP8_JIT* jit, uint16_t addr, uint16_t size);
+
+/* Drop all blocks */
+void chip8_jit_invalidate_all(CHIP8_JIT* jit);
+
+/* Run up to budget instructions. Stops early on a display draw or if the
+   cpu leaves the run state. returns instructions executed */
+int chip8_jit_run(CHIP8_MACHINE* machine, int budget);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif
@@ -0,0 +1,615 @@
+/* chip8_machine.c
+* Per-instance chip8 machine context. Owns its cpu, timing and display buffer.
+* GitHub: https:\\github.com\tommojphillips
+*/
+
+#include <stdlib.h> // for rand()
+#include <stdio.h>
+#include <string.h>
+
+#include "chip8_machine.h"
+#include "chip8_decode.h"
+#include "chip8_threaded.h"
+#include "chip8_jit.h"
+#include "chip8_movie.h"
+#include "chip8_debug.h"
+#include "chip8_profile.h"
+#include "thread.h"
+#include "chip8.h" // chip8 cpu core
+
+static int machine_run(CHIP8_MACHINE* machine, int budget);
+static void machine_run_to(CHIP8_MACHINE* machine, int due);
+static void machine_start_period(CHIP8_MACHINE* machine);
+static void machine_end_period(CHIP8_MACHINE* machine);
+static void machine_reset_display(CHIP8_MACHINE* machine);
+static void machine_skip_idle(CHIP8_MACHINE* machine, int due);
+static int machine_skip_blocked_key(CHIP8_MACHINE* machine, int due);
+static void machine_step(CHIP8_MACHINE* machine);
+static int idle_loop_length(const CHIP8* cpu, uint16_t pc, uint16_t* first);
+static int idle_loop_op(uint16_t opcode);
+
+/* Instructions run between idle loop checks */
+#define IDLE_CHECK_INTERVAL 256
+
+/* Seed of a new machine */
+#define DEFAULT_RANDOM_SEED 0
+
+/* The machine running on this thread; the core's chip8_random() has no cpu */
+static THREAD_LOCAL CHIP8_MACHINE* running_machine = NULL;
+
+/* chip8 core callbacks */
+
+void chip8_render(CHIP8* chip8) {
+	CHIP8_MACHINE* machine = CHIP8_MACHINE_FROM_CPU(chip8);
+	chip8->draw_display = 0;
+	if (machine->publish_hold)
+		return;
+	if (machine->render_interval <= 1 || machine->frame_count % machine->render_interval == 0) {
+		chip8_machine_publish(machine);
+	}
+}
+void chip8_beep(CHIP8* chip8) {
+	CHIP8_MACHINE* machine = CHIP8_MACHINE_FROM_CPU(chip8);
+	machine->beep_count++;
+}
+uint8_t chip8_random() {
+	if (running_machine == NULL)
+		return (rand() % 256);
+	return chip8_machine_random(running_machine);
+}
+
+CHIP8_MACHINE* chip8_machine_create() {
+
+	CHIP8_MACHINE* machine = (CHIP8_MACHINE*)malloc(sizeof(CHIP8_MACHINE));
+	if (machine == NULL) {
+		return NULL;
+	}
+	memset(machine, 0, sizeof(CHIP8_MACHINE));
+
+	chip8_init_cpu(&machine->cpu);
+	chip8_framebuffer_init(&machine->framebuffer);
+	machine_reset_display(machine);
+	machine->quirks = machine->cpu.quirks;
+	chip8_decode_invalidate_all(machine);
+
+	machine->engine = CHIP8_ENGINE_CACHED;
+	machine->cpu_target = 540; // 540hz
+	machine->timer_target = 60; // 60hz
+	machine->max_catchup = CHIP8_MACHINE_DEFAULT_MAX_CATCHUP;
+	machine->render_interval = 1;
+	chip8_machine_seed_random(machine, DEFAULT_RANDOM_SEED);
+	machine_start_period(machine);
+	return machine;
+}
+void chip8_machine_destroy(CHIP8_MACHINE* machine) {
+	if (machine != NULL) {
+		chip8_threaded_destroy(machine->threaded);
+		chip8_jit_destroy(machine->jit);
+		free(machine);
+	}
+}
+void chip8_machine_reset(CHIP8_MACHINE* machine) {
+	CHIP8_CPU_STATE s = machine->cpu.cpu_state;
+	if (s == CHIP8_STATE_ERROR_OPCODE)
+		s = CHIP8_STATE_HLT;
+	chip8_reset_cpu(&machine->cpu);
+	machine->cpu.cpu_state = s;
+	machine_reset_display(machine);
+	machine->timer_accumulator = 0;
+	machine->cpu_remainder = 0;
+	machine->instructions_per_frame = 0;
+	machine_start_period(machine);
+	chip8_decode_invalidate_all(machine);
+}
+void chip8_machine_set_engine(CHIP8_MACHINE* machine, CHIP8_ENGINE engine) {
+	if (engine < 0 || engine >= CHIP8_ENGINE_COUNT)
+		engine = CHIP8_ENGINE_CACHED;
+
+	if (engine == CHIP8_ENGINE_THREADED && machine->threaded == NULL) {
+		machine->threaded = chip8_threaded_create();
+		if (machine->threaded == NULL) {
+			printf("Failed to allocate threaded block cache\n");
+			engine = CHIP8_ENGINE_CACHED;
+		}
+	}
+
+	if (engine == CHIP8_ENGINE_JIT && machine->jit == NULL) {
+		machine->jit = chip8_jit_create();
+		if (machine->jit == NULL) {
+			printf("JIT is not available on this host\n");
+			engine = CHIP8_ENGINE_CACHED;
+		}
+	}
+
+	machine->engine = engine;
+	chip8_machine_set_quirks(machine, machine->cpu.quirks);
+}
+void chip8_machine_set_quirks(CHIP8_MACHINE* machine, uint8_t quirks) {
+	machine->cpu.quirks = quirks;
+	machine->quirks = quirks;
+	if (machine->threaded != NULL) {
+		chip8_threaded_set_quirks(machine->threaded, quirks);
+	}
+	chip8_decode_invalidate_all(machine);
+}
+void chip8_machine_set_platform(CHIP8_MACHINE* machine, CHIP8_PLATFORM platform) {
+	if (platform < 0 || platform >= CHIP8_PLATFORM_COUNT)
+		platform = CHIP8_PLATFORM_CHIP8;
+	machine->platform = platform;
+	machine_reset_display(machine);
+	chip8_decode_invalidate_all(machine);
+}
+void chip8_machine_seed_random(CHIP8_MACHINE* machine, uint64_t seed) {
+	/* splitmix64 so nearby seeds give unrelated sequences */
+	uint64_t z = seed + 0x9E3779B97F4A7C15ull;
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+	z ^= z >> 31;
+	machine->random_state = (z != 0) ? z : 1;
+}
+uint8_t chip8_machine_random(CHIP8_MACHINE* machine) {
+	uint64_t x = machine->random_state;
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	machine->random_state = x;
+	return (uint8_t)((x * 0x2545F4914F6CDD1Dull) >> 56);
+}
+const char* chip8_machine_platform_name(CHIP8_PLATFORM platform) {
+	switch (platform) {
+		case CHIP8_PLATFORM_CHIP8:
+			return "CHIP-8";
+		case CHIP8_PLATFORM_SCHIP:
+			return "SUPER-CHIP";
+		case CHIP8_PLATFORM_XOCHIP:
+			return "XO-CHIP";
+		default:
+			return "Unknown";
+	}
+}
+int chip8_machine_publish(CHIP8_MACHINE* machine) {
+	if (machine->platform == CHIP8_PLATFORM_CHIP8) {
+		chip8_frame_from_display(&machine->screen, machine->cpu.display);
+	}
+	return chip8_framebuffer_publish(&machine->framebuffer, &machine->screen);
+}
+static void machine_reset_display(CHIP8_MACHINE* machine) {
+	chip8_frame_init(&machine->screen, 0);
+	machine->plane_mask = 1;
+	if (machine->platform != CHIP8_PLATFORM_CHIP8) {
+		memcpy(machine->cpu.ram + CHIP8_FRAME_BIG_FONT_ADDR, chip8_frame_big_font, CHIP8_FRAME_BIG_FONT_BYTES);
+	}
+}
+
+const char* chip8_machine_engine_name(CHIP8_ENGINE engine) {
+	switch (engine) {
+		case CHIP8_ENGINE_CORE:
+			return "Core";
+		case CHIP8_ENGINE_CACHED:
+			return "Cached";
+		case CHIP8_ENGINE_THREADED:
+			return "Threaded";
+		case CHIP8_ENGINE_JIT:
+			return "JIT";
+		default:
+			return "Unknown";
+	}
+}
+
+int chip8_machine_load_program(CHIP8_MACHINE* machine, const char* filename) {
+
+	FILE* file = NULL;
+#ifdef _MSC_VER
+	fopen_s(&file, filename, "rb");
+#else
+	file = fopen(filename, "rb");
+#endif
+	if (file == NULL) {
+		printf("Error: could not open file: %s\n", filename);
+		chip8_machine_reset(machine);
+		machine->cpu.cpu_state = CHIP8_STATE_HLT;
+		return 1;
+	}
+
+	fseek(file, 0, SEEK_END);
+	uint32_t size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	if (CHIP8_MEMORY_BYTES - CHIP8_PROGRAM_ADDR < size) {
+		fclose(file);
+		printf("Error: program too big\n");
+		chip8_machine_reset(machine);
+		machine->cpu.cpu_state = CHIP8_STATE_HLT;
+		return 1;
+	}
+
+	chip8_machine_reset(machine);
+	chip8_zero_program_memory(&machine->cpu);
+
+	fread(machine->cpu.ram + CHIP8_PROGRAM_ADDR, 1, size, file);
+	fclose(file);
+	chip8_decode_invalidate_all(machine);
+	machine->cpu.cpu_state = CHIP8_STATE_EXE;
+	return 0;
+}
+int chip8_machine_load_program_memory(CHIP8_MACHINE* machine, const uint8_t* program, uint32_t size) {
+
+	chip8_machine_reset(machine);
+
+	if (CHIP8_MEMORY_BYTES - CHIP8_PROGRAM_ADDR < size) {
+		printf("Error: program too big\n");
+		machine->cpu.cpu_state = CHIP8_STATE_HLT;
+		return 1;
+	}
+
+	chip8_zero_program_memory(&machine->cpu);
+	memcpy(machine->cpu.ram + CHIP8_PROGRAM_ADDR, program, size);
+	chip8_decode_invalidate_all(machine);
+	machine->cpu.cpu_state = CHIP8_STATE_EXE;
+	return 0;
+}
+
+void chip8_machine_advance(CHIP8_MACHINE* machine, uint64_t ticks, uint64_t ticks_per_second) {
+
+	if (ticks_per_second == 0)
+		return;
+
+	const uint64_t timer_target = (machine->timer_target > 0) ? machine->timer_target : 1;
+	machine->timer_accumulator += ticks * timer_target;
+
+	uint64_t periods = machine->timer_accumulator / ticks_per_second;
+	if (periods > (uint64_t)machine->max_catchup) {
+		/* stalled; drop what the catch up limit does not cover */
+		const uint64_t dropped = periods - machine->max_catchup;
+		machine->timer_accumulator -= dropped * ticks_per_second;
+		machine->dropped_periods += dropped;
+		periods = machine->max_catchup;
+	}
+
+	for (uint64_t i = 0; i < periods; ++i) {
+		machine_run_to(machine, machine->period_budget);
+		machine->timer_accumulator -= ticks_per_second;
+		machine_end_period(machine);
+	}
+
+	/* the part of the current period that has elapsed */
+	machine_run_to(machine, (int)(machine->period_budget * machine->timer_accumulator / ticks_per_second));
+}
+uint64_t chip8_machine_ticks_to_next_period(const CHIP8_MACHINE* machine, uint64_t ticks_per_second) {
+	if (ticks_per_second == 0)
+		return 0;
+	const uint64_t timer_target = (machine->timer_target > 0) ? machine->timer_target : 1;
+	const uint64_t remaining = ticks_per_second - machine->timer_accumulator % ticks_per_second;
+	return (remaining + timer_target - 1) / timer_target;
+}
+void chip8_machine_single_step(CHIP8_MACHINE* machine) {
+	/* always the core (or the cache for what the core does not run) so
+	   stepping works from any cpu state */
+	if (machine->movie != NULL) {
+		chip8_movie_update(machine, 0);
+	}
+	running_machine = machine;
+	machine->instruction_count++;
+	if (machine->platform == CHIP8_PLATFORM_CHIP8)
+		chip8_execute(&machine->cpu);
+	else
+		chip8_decode_step(machine);
+	chip8_decode_invalidate_all(machine);
+	chip8_step_timers(&machine->cpu);
+}
+void chip8_machine_run_frame(CHIP8_MACHINE* machine) {
+	machine_run_to(machine, machine->period_budget);
+	machine_end_period(machine);
+}
+void chip8_machine_run_frame_limit(CHIP8_MACHINE* machine, uint64_t limit) {
+
+	const int left = machine->period_budget - machine->period_count;
+	if (limit >= (uint64_t)left) {
+		chip8_machine_run_frame(machine);
+		return;
+	}
+
+	const int due = machine->period_count + (int)limit;
+	machine_run_to(machine, due);
+	if (machine->period_count < due) {
+		/* stopped short; nothing more runs before vblank */
+		machine_end_period(machine);
+	}
+}
+
+static void machine_run_to(CHIP8_MACHINE* machine, int due) {
+	if (due <= machine->period_count)
+		return;
+
+	/* the skips run instructions the debugger and profiler would not see */
+	const int checked = !machine->running_ahead && ((machine->debug != NULL && machine->debug->armed) ||
+		(machine->profile != NULL && machine->profile->enabled));
+
+	machine->blocked = CHIP8_BLOCKED_NONE;
+	while (due > machine->period_count) {
+
+		/* a movie stops the run at its next key change */
+		const int stop = (machine->movie != NULL) ? chip8_movie_update(machine, due) : due;
+
+		if (!checked && machine_skip_blocked_key(machine, stop)) {
+			if (stop < due)
+				continue;
+			machine->blocked = CHIP8_BLOCKED_KEY;
+			break;
+		}
+
+		int budget = stop - machine->period_count;
+		if (machine->idle_skip && !checked && budget > IDLE_CHECK_INTERVAL) {
+			budget = IDLE_CHECK_INTERVAL;
+		}
+
+		int count = machine_run(machine, budget);
+		machine->period_count += count;
+		machine->instruction_count += count;
+
+		if (count < budget) {
+			/* display wait or halted */
+			if (machine->cpu.draw_display) {
+				machine->blocked = CHIP8_BLOCKED_VBLANK;
+			}
+			break;
+		}
+
+		if (machine->idle_skip && !checked && stop > machine->period_count) {
+			machine_skip_idle(machine, stop);
+		}
+	}
+}
+static void machine_skip_idle(CHIP8_MACHINE* machine, int due) {
+
+	CHIP8* cpu = &machine->cpu;
+	const uint16_t start = cpu->pc;
+	uint16_t first = 0;
+	const int length = idle_loop_length(cpu, start, &first);
+	if (length == 0)
+		return;
+
+	/* one pass of the loop. Back at start with the same registers, every
+	   pass after it is the same until the timers or keys change */
+	uint8_t v[CHIP8_REGISTER_COUNT];
+	memcpy(v, cpu->v, sizeof(v));
+	const uint16_t i = cpu->i;
+
+	int pass = 0;
+	do {
+		if (machine->period_count >= due || cpu->cpu_state != CHIP8_STATE_EXE)
+			return;
+		machine_step(machine);
+		pass++;
+
+		if (cpu->pc < first || cpu->pc >= first + length * 2) {
+			/* left the loop */
+			return;
+		}
+	} while (cpu->pc != start && pass <= length);
+
+	if (cpu->pc != start || cpu->i != i || memcmp(cpu->v, v, sizeof(v)) != 0)
+		return;
+
+	/* whole passes only so the period ends where running them would */
+	const int remaining = due - machine->period_count;
+	const int skipped = remaining - remaining % pass;
+	if (skipped > 0) {
+		machine->period_count += skipped;
+		machine->instruction_count += skipped;
+		machine->idle_instructions += skipped;
+		machine->idle_skips++;
+	}
+}
+static int machine_skip_blocked_key(CHIP8_MACHINE* machine, int due) {
+
+	/* FX0A that does not move on spins on the same keys every instruction
+	   until a command changes them; the rest of the period is skipped.
+	   returns 1 if blocked */
+	CHIP8* cpu = &machine->cpu;
+	const uint16_t pc = cpu->pc;
+	if ((cpu->ram[pc & CHIP8_ADDR_MASK] & 0xF0) != 0xF0 || cpu->ram[(pc + 1) & CHIP8_ADDR_MASK] != 0x0A)
+		return 0;
+	if (cpu->draw_display || cpu->cpu_state != CHIP8_STATE_EXE)
+		return 0;
+
+	machine_step(machine);
+	if (cpu->pc != pc || cpu->cpu_state != CHIP8_STATE_EXE)
+		return 0;
+
+	if (due > machine->period_count) {
+		machine->instruction_count += due - machine->period_count;
+		machine->period_count = due;
+	}
+	return 1;
+}
+static void machine_step(CHIP8_MACHINE* machine) {
+	/* one instruction outside the engines; only for ops that do not write memory */
+	running_machine = machine;
+	if (machine->platform == CHIP8_PLATFORM_CHIP8)
+		chip8_execute(&machine->cpu);
+	else
+		chip8_decode_step(machine);
+	machine->period_count++;
+	machine->instruction_count++;
+}
+static int idle_loop_length(const CHIP8* cpu, uint16_t pc, uint16_t* first) {
+	/* instructions in a backward 1NNN loop around pc made of idle loop ops
+	   and its first address; 0 if pc is not in one */
+	for (int n = 0; n < CHIP8_MACHINE_IDLE_MAX_LOOP; ++n) {
+
+		const uint16_t addr = pc + n * 2;
+		const uint16_t opcode = (cpu->ram[addr & CHIP8_ADDR_MASK] << 8) | cpu->ram[(addr + 1) & CHIP8_ADDR_MASK];
+		if (!idle_loop_op(opcode))
+			return 0;
+
+		if ((opcode & 0xF000) == 0x1000) {
+			const uint16_t target = opcode & 0x0FFF;
+			if (target > pc || addr - target >= CHIP8_MACHINE_IDLE_MAX_LOOP * 2)
+				return 0;
+			for (uint16_t a = target; a < pc; a += 2) {
+				if (!idle_loop_op((cpu->ram[a & CHIP8_ADDR_MASK] << 8) | cpu->ram[(a + 1) & CHIP8_ADDR_MASK]))
+					return 0;
+			}
+			*first = target;
+			return (addr - target) / 2 + 1;
+		}
+	}
+	return 0;
+}
+static int idle_loop_op(uint16_t opcode) {
+	/* writes nothing but V, I and pc, and reads nothing a pass changes */
+	switch (opcode & 0xF000) {
+		case 0x1000: // JP NNN
+		case 0x3000: // SE VX, NN
+		case 0x4000: // SNE VX, NN
+		case 0x6000: // LD VX, NN
+		case 0x7000: // ADD VX, NN
+		case 0x8000: // ALU VX, VY
+		case 0x9000: // SNE VX, VY
+		case 0xA000: // LD I, NNN
+			return 1;
+		case 0x5000: // SE VX, VY
+			return (opcode & 0x000F) == 0;
+		case 0xE000: // SKP / SKNP VX
+			return (opcode & 0x00FF) == 0x9E || (opcode & 0x00FF) == 0xA1;
+		case 0xF000: // LD VX, DT
+			return (opcode & 0x00FF) == 0x07;
+		default:
+			return 0;
+	}
+}
+static void machine_start_period(CHIP8_MACHINE* machine) {
+	/* exactly cpu_target instructions every timer_target periods */
+	const uint64_t timer_target = (machine->timer_target > 0) ? machine->timer_target : 1;
+	const uint64_t due = machine->cpu_remainder + (uint64_t)((machine->cpu_target > 0) ? machine->cpu_target : 0);
+	machine->period_budget = (int)(due / timer_target);
+	machine->cpu_remainder = (uint32_t)(due % timer_target);
+	machine->period_count = 0;
+}
+static void machine_end_period(CHIP8_MACHINE* machine) {
+	/* timers and vblank; releases a display wait */
+	chip8_step_timers(&machine->cpu);
+	chip8_render(&machine->cpu);
+	if (machine->blocked == CHIP8_BLOCKED_VBLANK) {
+		machine->blocked = CHIP8_BLOCKED_NONE;
+	}
+	machine->instructions_per_frame = machine->period_count;
+	machine->frame_count++;
+	machine_start_period(machine);
+	if (machine->movie != NULL) {
+		chip8_movie_end_period(machine);
+	}
+}
+
+static int machine_run(CHIP8_MACHINE* machine, int budget) {
+
+	CHIP8* cpu = &machine->cpu;
+	running_machine = machine;
+
+	if (cpu->quirks != machine->quirks) {
+		/* quirks were written straight to the cpu */
+		chip8_machine_set_quirks(machine, cpu->quirks);
+	}
+
+	/* frames run ahead are rolled back; they are not counted or checked */
+	if (!machine->running_ahead) {
+		if (machine->profile != NULL && machine->profile->enabled) {
+			/* counted an instruction at a time, checked too if the debugger is armed */
+			return chip8_profile_run(machine, budget);
+		}
+
+		if (machine->debug != NULL && machine->debug->armed) {
+			/* checked an instruction at a time; unarmed, the engines run unchecked */
+			return chip8_debug_run(machine, budget);
+		}
+	}
+
+	switch (machine->engine) {
+		case CHIP8_ENGINE_CACHED:
+			return chip8_decode_run(machine, budget);
+
+		case CHIP8_ENGINE_THREADED:
+			return chip8_threaded_run(machine, budget);
+
+		case CHIP8_ENGINE_JIT:
+			return chip8_jit_run(machine, budget);
+
+		default: {
+			if (machine->platform != CHIP8_PLATFORM_CHIP8) {
+				/* the core only runs CHIP-8 */
+				return chip8_decode_run(machine, budget);
+			}
+			int count = 0;
+			while (count < budget && cpu->draw_display == 0 && cpu->cpu_state == CHIP8_STATE_EXE) {
+				chip8_execute(cpu);
+				count++;
+			}
+			return count;
+		}
+	}
+}
+
+uint32_t chip8_machine_display_hash(const CHIP8_MACHINE* machine) {
+	uint32_t hash = 2166136261u;
+	if (machine->platform == CHIP8_PLATFORM_CHIP8) {
+		for (size_t i = 0; i < sizeof(machine->cpu.display); ++i) {
+			hash ^= machine->cpu.display[i];
+			hash *= 16777619u;
+		}
+		return hash;
+	}
+
+	const CHIP8_FRAME* frame = &machine->screen;
+	for (int p = 0; p < frame->planes; ++p) {
+		for (int y = 0; y < frame->height; ++y) {
+			for (int w = 0; w < CHIP8_FRAME_WORDS(frame); ++w) {
+				const uint64_t row = frame->rows[p][y][w];
+				for (int i = 0; i < 8; ++i) {
+					hash ^= (uint8_t)(row >> (56 - i * 8));
+					hash *= 16777619u;
+				}
+			}
+		}
+	}
+	return hash;
+}
+const char* chip8_machine_compare(const CHIP8_MACHINE* a, const CHIP8_MACHINE* b) {
+
+	const CHIP8* x = &a->cpu;
+	const CHIP8* y = &b->cpu;
+
+	if (a->instruction_count != b->instruction_count)
+		return "instruction count";
+	if (x->cpu_state != y->cpu_state)
+		return "cpu state";
+	if (x->pc != y->pc)
+		return "PC";
+	if (x->i != y->i)
+		return "I";
+	if (x->sp != y->sp)
+		return "SP";
+	if (x->delay_timer != y->delay_timer)
+		return "DT";
+	if (x->sound_timer != y->sound_timer)
+		return "ST";
+	if (memcmp(x->v, y->v, sizeof(x->v)) != 0)
+		return "V";
+	if (memcmp(x->ram, y->ram, sizeof(x->ram)) != 0)
+		return "RAM";
+	if (memcmp(x->display, y->display, sizeof(x->display)) != 0)
+		return "display";
+	if (a->platform != b->platform)
+		return "platform";
+	if (a->platform != CHIP8_PLATFORM_CHIP8) {
+		if (memcmp(&a->screen, &b->screen, sizeof(a->screen)) != 0 || a->plane_mask != b->plane_mask)
+			return "screen";
+		if (memcmp(a->rpl, b->rpl, sizeof(a->rpl)) != 0)
+			return "RPL";
+	}
+	if (memcmp(x, y, sizeof(CHIP8)) != 0)
+		return "cpu"; // stack or other core state
+	if (a->random_state != b->random_state)
+		return "random";
+	return NULL;
+}
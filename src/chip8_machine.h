@@ -0,0 +1,204 @@
+/* chip8_machine.h
+* Per-instance chip8 machine context. Owns its cpu, timing and display buffer.
+* No SDL / IMGUI dependencies.
+* GitHub: https:\\github.com\tommojphillips
+*/
+
+#ifndef CHIP8_MACHINE_H
+#define CHIP8_MACHINE_H
+
+#include <stdint.h>
+
+#include "chip8.h" // chip8 cpu core
+#include "chip8_decode.h"
+#include "chip8_threaded.h"
+#include "chip8_jit.h"
+#include "chip8_framebuffer.h"
+#include "chip8_display.h"
+
+/* Default number of timer periods chip8_machine_advance() catches up after a stall */
+#define CHIP8_MACHINE_DEFAULT_MAX_CATCHUP 8
+
+/* Longest loop in instructions the idle skip recognizes */
+#define CHIP8_MACHINE_IDLE_MAX_LOOP 8
+
+/* Execution engine */
+typedef enum {
+	/* chip8_execute() for every instruction */
+	CHIP8_ENGINE_CORE = 0,
+
+	/* Predecoded instruction cache */
+	CHIP8_ENGINE_CACHED = 1,
+
+	/* Direct-threaded basic blocks with superinstructions */
+	CHIP8_ENGINE_THREADED = 2,
+
+	/* x86-64 native code. Falls back to the cache on other hosts */
+	CHIP8_ENGINE_JIT = 3,
+
+	CHIP8_ENGINE_COUNT
+} CHIP8_ENGINE;
+
+/* Platform a program is written for */
+typedef enum {
+	/* CHIP-8 on the core's 64x32 display */
+	CHIP8_PLATFORM_CHIP8 = 0,
+
+	/* SUPER-CHIP. 128x64 hires, 16x16 sprites, scrolling, big font and RPL flags */
+	CHIP8_PLATFORM_SCHIP = 1,
+
+	/* XO-CHIP display. SUPER-CHIP plus up to 4 bitplanes, scroll up and register ranges */
+	CHIP8_PLATFORM_XOCHIP = 2,
+
+	CHIP8_PLATFORM_COUNT
+} CHIP8_PLATFORM;
+
+/* What the guest is waiting on */
+typedef enum {
+	/* Running */
+	CHIP8_BLOCKED_NONE = 0,
+
+	/* FX0A waiting for a key. Nothing changes but the timers until a key command */
+	CHIP8_BLOCKED_KEY = 1,
+
+	/* DXYN display wait. Nothing runs until the next timer period */
+	CHIP8_BLOCKED_VBLANK = 2,
+} CHIP8_BLOCKED;
+
+typedef struct CHIP8_MOVIE CHIP8_MOVIE;
+typedef struct CHIP8_DEBUG CHIP8_DEBUG;
+typedef struct CHIP8_PROFILE CHIP8_PROFILE;
+
+/* Chip8 machine context */
+struct CHIP8_MACHINE {
+	CHIP8 cpu; // must be first; core callbacks receive &machine->cpu
+
+	CHIP8_ENGINE engine;
+	uint8_t quirks; // quirks the engines are specialized for
+
+	CHIP8_PLATFORM platform;
+	CHIP8_FRAME screen; // SUPER-CHIP / XO-CHIP display. The frame published on every platform
+	uint8_t plane_mask; // XO-CHIP planes selected by FN01
+	uint8_t rpl[CHIP8_REGISTER_COUNT]; // SUPER-CHIP FX75 / FX85 flags
+
+	uint64_t random_state; // CXNN generator. xorshift64*; never 0
+
+	int cpu_target; // cpu update target in hz
+	int timer_target; // timer update target in hz
+
+	/* Fixed timestep scheduler. Time is kept in host ticks scaled by the
+	   timer rate so periods never drift; instructions are spread over the
+	   timer periods with an integer remainder */
+	uint64_t timer_accumulator; // host ticks * timer_target into the current period
+	uint32_t cpu_remainder; // instructions carried into the next period, * timer_target
+	int period_budget; // instructions in the current timer period
+	int period_count; // instructions run in the current timer period
+	int max_catchup; // timer periods run per advance before the rest are dropped
+	uint64_t dropped_periods; // timer periods dropped by the catch up limit
+
+	int instructions_per_frame; // instructions run in the last timer period
+	int render_interval; // publish every Nth vblank; <= 1 publishes every vblank
+	int publish_hold; // 1 = vblanks do not publish; the frontend publishes the run-ahead frame
+	int running_ahead; // 1 = the frames run are rolled back; the movie, debugger and profile are skipped
+	CHIP8_BLOCKED blocked; // what the guest waited on when the last run stopped
+
+	/* Idle skip. A loop that only reads the delay timer, keys and registers
+	   does the same thing every pass until the next timer period or command,
+	   so the rest of the period is skipped in whole passes */
+	int idle_skip; // 1 = detect and skip idle loops
+	uint64_t idle_skips; // idle loops skipped
+	uint64_t idle_instructions; // instructions skipped; counted in instruction_count
+
+	uint64_t instruction_count;
+	uint64_t frame_count;
+	uint64_t beep_count;
+
+	CHIP8_FRAMEBUFFER framebuffer; // frames published at vblank for the presenter
+
+	CHIP8_MOVIE* movie; // recording or replaying the keypad when set. Owned by the caller
+	CHIP8_DEBUG* debug; // breakpoints and watches when set. Owned by the caller
+	CHIP8_PROFILE* profile; // instruction counts when set and enabled. Owned by the caller
+
+	CHIP8_DECODED_OP op_cache[CHIP8_MEMORY_BYTES];
+	CHIP8_THREADED* threaded; // allocated when the threaded engine is selected
+	CHIP8_JIT* jit; // allocated when the jit engine is selected
+
+	void* user_data;
+};
+
+/* Get the machine that owns a cpu */
+#define CHIP8_MACHINE_FROM_CPU(cpu) ((CHIP8_MACHINE*)(cpu))
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Allocate and init a machine. returns NULL on failure */
+CHIP8_MACHINE* chip8_machine_create();
+
+/* Free a machine */
+void chip8_machine_destroy(CHIP8_MACHINE* machine);
+
+/* Reset the cpu, preserving the halt/run state */
+void chip8_machine_reset(CHIP8_MACHINE* machine);
+
+/* Select the execution engine */
+void chip8_machine_set_engine(CHIP8_MACHINE* machine, CHIP8_ENGINE engine);
+
+/* Set the cpu quirks and select the engine variants specialized for them */
+void chip8_machine_set_quirks(CHIP8_MACHINE* machine, uint8_t quirks);
+
+/* Engine display name */
+const char* chip8_machine_engine_name(CHIP8_ENGINE engine);
+
+/* Select the platform. Clears the display */
+void chip8_machine_set_platform(CHIP8_MACHINE* machine, CHIP8_PLATFORM platform);
+
+/* Seed the CXNN generator. The same seed gives the same numbers on every host */
+void chip8_machine_seed_random(CHIP8_MACHINE* machine, uint64_t seed);
+
+/* Next CXNN random byte */
+uint8_t chip8_machine_random(CHIP8_MACHINE* machine);
+
+/* Platform display name */
+const char* chip8_machine_platform_name(CHIP8_PLATFORM platform);
+
+/* Publish the current display to the framebuffer. returns 1 if it changed */
+int chip8_machine_publish(CHIP8_MACHINE* machine);
+
+/* Load a program from a file. returns 0 on success */
+int chip8_machine_load_program(CHIP8_MACHINE* machine, const char* filename);
+
+/* Load a program from memory. returns 0 on success */
+int chip8_machine_load_program_memory(CHIP8_MACHINE* machine, const uint8_t* program, uint32_t size);
+
+/* Advance emulated time by ticks of a host clock running at ticks_per_second.
+   Runs every instruction and timer period that is due, independent of how
+   often it is called. At most max_catchup timer periods are run per call */
+void chip8_machine_advance(CHIP8_MACHINE* machine, uint64_t ticks, uint64_t ticks_per_second);
+
+/* Host ticks until the current timer period ends */
+uint64_t chip8_machine_ticks_to_next_period(const CHIP8_MACHINE* machine, uint64_t ticks_per_second);
+
+/* Execute one instruction and step the timers */
+void chip8_machine_single_step(CHIP8_MACHINE* machine);
+
+/* Run the rest of the current timer period without waiting on the host */
+void chip8_machine_run_frame(CHIP8_MACHINE* machine);
+
+/* chip8_machine_run_frame, running at most limit instructions. The period
+   ends only if it ran to its end or stopped on its own ( display wait, halt ) */
+void chip8_machine_run_frame_limit(CHIP8_MACHINE* machine, uint64_t limit);
+
+/* FNV-1a hash of the display; the cpu display memory on CHIP-8 */
+uint32_t chip8_machine_display_hash(const CHIP8_MACHINE* machine);
+
+/* Compare the emulated state of two machines.
+   returns the name of the first field that differs, NULL if they match */
+const char* chip8_machine_compare(const CHIP8_MACHINE* a, const CHIP8_MACHINE* b);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif
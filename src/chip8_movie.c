@@ -0,0 +1,245 @@
+/* chip8_movie.c
+* Keypad movies. A movie is the machine state it starts from and every keypad
+* change stamped with the instruction count it happened at, so a replay is
+* bit-exact however the host paces it.
+* GitHub: https:\\github.com\tommojphillips
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "chip8_movie.h"
+#include "chip8_snapshot.h"
+#include "chip8_machine.h"
+#include "chip8.h" // chip8 cpu core
+
+/* Events allocated when a recording starts */
+#define MOVIE_INITIAL_EVENTS 256
+
+static void movie_check_end(CHIP8_MACHINE* machine);
+static const char* movie_compare(const CHIP8_SNAPSHOT* a, const CHIP8_SNAPSHOT* b);
+
+CHIP8_MOVIE* chip8_movie_create() {
+	CHIP8_MOVIE* movie = (CHIP8_MOVIE*)malloc(sizeof(CHIP8_MOVIE));
+	if (movie == NULL) {
+		return NULL;
+	}
+	memset(movie, 0, sizeof(CHIP8_MOVIE));
+	return movie;
+}
+void chip8_movie_destroy(CHIP8_MOVIE* movie) {
+	if (movie != NULL) {
+		free(movie->events);
+		free(movie);
+	}
+}
+void chip8_movie_record(CHIP8_MOVIE* movie, CHIP8_MACHINE* machine) {
+	chip8_snapshot_save(machine, &movie->start);
+	movie->event_count = 0;
+	movie->next_event = 0;
+	movie->keypad = machine->cpu.keypad;
+	movie->mismatch = NULL;
+	movie->mode = CHIP8_MOVIE_RECORDING;
+	machine->movie = movie;
+}
+void chip8_movie_stop(CHIP8_MOVIE* movie, CHIP8_MACHINE* machine) {
+	if (movie->mode == CHIP8_MOVIE_RECORDING) {
+		chip8_snapshot_save(machine, &movie->end);
+		movie->mode = CHIP8_MOVIE_IDLE;
+	}
+	else if (movie->mode == CHIP8_MOVIE_PLAYING) {
+		movie->mode = CHIP8_MOVIE_IDLE;
+	}
+
+	if (machine->movie == movie) {
+		machine->movie = NULL;
+	}
+}
+int chip8_movie_play(CHIP8_MOVIE* movie, CHIP8_MACHINE* machine) {
+	if (chip8_snapshot_load(machine, &movie->start) != 0) {
+		return 1;
+	}
+	movie->next_event = 0;
+	movie->mismatch = NULL;
+	movie->mode = CHIP8_MOVIE_PLAYING;
+	machine->movie = movie;
+	return 0;
+}
+void chip8_movie_record_keypad(CHIP8_MOVIE* movie, const CHIP8_MACHINE* machine) {
+	if (movie->mode != CHIP8_MOVIE_RECORDING || machine->cpu.keypad == movie->keypad)
+		return;
+
+	if (movie->event_count == movie->event_capacity) {
+		const uint32_t capacity = (movie->event_capacity > 0) ? movie->event_capacity * 2 : MOVIE_INITIAL_EVENTS;
+		CHIP8_MOVIE_EVENT* events = (CHIP8_MOVIE_EVENT*)realloc(movie->events, capacity * sizeof(CHIP8_MOVIE_EVENT));
+		if (events == NULL) {
+			printf("Failed to allocate movie events\n");
+			exit(1);
+		}
+		movie->events = events;
+		movie->event_capacity = capacity;
+	}
+
+	CHIP8_MOVIE_EVENT* event = &movie->events[movie->event_count++];
+	memset(event, 0, sizeof(CHIP8_MOVIE_EVENT));
+	event->instruction_count = machine->instruction_count;
+	event->keypad = machine->cpu.keypad;
+	movie->keypad = machine->cpu.keypad;
+}
+int chip8_movie_update(CHIP8_MACHINE* machine, int due) {
+
+	CHIP8_MOVIE* movie = machine->movie;
+	if (movie->mode != CHIP8_MOVIE_PLAYING || machine->running_ahead)
+		return due; // run-ahead frames are rolled back; the replay goes on from the real run
+
+	while (movie->next_event < movie->event_count && movie->events[movie->next_event].instruction_count <= machine->instruction_count) {
+		machine->cpu.keypad = movie->events[movie->next_event].keypad;
+		movie->next_event++;
+	}
+
+	movie_check_end(machine);
+	if (movie->mode != CHIP8_MOVIE_PLAYING)
+		return due;
+
+	/* run up to the next change, or to where the recording stopped */
+	uint64_t target = movie->end.instruction_count;
+	if (movie->next_event < movie->event_count) {
+		target = movie->events[movie->next_event].instruction_count;
+	}
+
+	if (target > machine->instruction_count && due > machine->period_count) {
+		const uint64_t left = target - machine->instruction_count;
+		if (left < (uint64_t)(due - machine->period_count)) {
+			return machine->period_count + (int)left;
+		}
+	}
+	return due;
+}
+void chip8_movie_end_period(CHIP8_MACHINE* machine) {
+	if (machine->movie->mode == CHIP8_MOVIE_PLAYING && !machine->running_ahead) {
+		movie_check_end(machine);
+	}
+}
+
+int chip8_movie_write_file(const CHIP8_MOVIE* movie, const char* filename) {
+
+	FILE* file = NULL;
+#ifdef _MSC_VER
+	fopen_s(&file, filename, "wb");
+#else
+	file = fopen(filename, "wb");
+#endif
+	if (file == NULL) {
+		return 1;
+	}
+
+	CHIP8_MOVIE_HEADER header = { 0 };
+	header.magic = CHIP8_MOVIE_MAGIC;
+	header.version = CHIP8_MOVIE_VERSION;
+	header.snapshot_size = sizeof(CHIP8_SNAPSHOT);
+	header.event_count = movie->event_count;
+
+	int result = 0;
+	if (fwrite(&header, sizeof(header), 1, file) != 1 ||
+		fwrite(&movie->start, sizeof(CHIP8_SNAPSHOT), 1, file) != 1 ||
+		fwrite(&movie->end, sizeof(CHIP8_SNAPSHOT), 1, file) != 1) {
+		result = 1;
+	}
+	if (result == 0 && movie->event_count > 0) {
+		if (fwrite(movie->events, sizeof(CHIP8_MOVIE_EVENT), movie->event_count, file) != movie->event_count) {
+			result = 1;
+		}
+	}
+	fclose(file);
+	return result;
+}
+int chip8_movie_read_file(CHIP8_MOVIE* movie, const char* filename) {
+
+	FILE* file = NULL;
+#ifdef _MSC_VER
+	fopen_s(&file, filename, "rb");
+#else
+	file = fopen(filename, "rb");
+#endif
+	if (file == NULL) {
+		return 1;
+	}
+
+	CHIP8_MOVIE_HEADER header;
+	if (fread(&header, sizeof(header), 1, file) != 1 || header.magic != CHIP8_MOVIE_MAGIC ||
+		header.version != CHIP8_MOVIE_VERSION || header.snapshot_size != sizeof(CHIP8_SNAPSHOT)) {
+		fclose(file);
+		return 1;
+	}
+
+	if (fread(&movie->start, sizeof(CHIP8_SNAPSHOT), 1, file) != 1 ||
+		fread(&movie->end, sizeof(CHIP8_SNAPSHOT), 1, file) != 1 ||
+		chip8_snapshot_validate(&movie->start) != 0 || chip8_snapshot_validate(&movie->end) != 0) {
+		fclose(file);
+		return 1;
+	}
+
+	CHIP8_MOVIE_EVENT* events = NULL;
+	if (header.event_count > 0) {
+		events = (CHIP8_MOVIE_EVENT*)malloc(header.event_count * sizeof(CHIP8_MOVIE_EVENT));
+		if (events == NULL || fread(events, sizeof(CHIP8_MOVIE_EVENT), header.event_count, file) != header.event_count) {
+			free(events);
+			fclose(file);
+			return 1;
+		}
+	}
+	fclose(file);
+
+	free(movie->events);
+	movie->events = events;
+	movie->event_count = header.event_count;
+	movie->event_capacity = header.event_count;
+	movie->next_event = 0;
+	movie->mismatch = NULL;
+	movie->mode = CHIP8_MOVIE_IDLE;
+	return 0;
+}
+
+static void movie_check_end(CHIP8_MACHINE* machine) {
+
+	/* every change applied and the recording's instruction and period reached */
+	CHIP8_MOVIE* movie = machine->movie;
+	if (movie->next_event < movie->event_count)
+		return;
+	if (machine->instruction_count < movie->end.instruction_count || machine->frame_count < movie->end.frame_count)
+		return;
+
+	chip8_snapshot_save(machine, &movie->check);
+
+	/* host time and pauses are not part of the replay */
+	movie->check.timer_accumulator = movie->end.timer_accumulator;
+	movie->check.cpu.cpu_state = movie->end.cpu.cpu_state;
+
+	movie->mismatch = movie_compare(&movie->end, &movie->check);
+	movie->mode = CHIP8_MOVIE_FINISHED;
+}
+static const char* movie_compare(const CHIP8_SNAPSHOT* a, const CHIP8_SNAPSHOT* b) {
+	if (a->instruction_count != b->instruction_count)
+		return "instruction count";
+	if (a->frame_count != b->frame_count)
+		return "frame count";
+	if (a->cpu.pc != b->cpu.pc)
+		return "PC";
+	if (a->cpu.i != b->cpu.i)
+		return "I";
+	if (memcmp(a->cpu.v, b->cpu.v, sizeof(a->cpu.v)) != 0)
+		return "V";
+	if (memcmp(a->cpu.ram, b->cpu.ram, sizeof(a->cpu.ram)) != 0)
+		return "RAM";
+	if (memcmp(a->cpu.display, b->cpu.display, sizeof(a->cpu.display)) != 0)
+		return "display";
+	if (a->random_state != b->random_state)
+		return "random";
+	if (memcmp(&a->screen, &b->screen, sizeof(a->screen)) != 0)
+		return "screen";
+	if (memcmp(a, b, sizeof(CHIP8_SNAPSHOT)) != 0)
+		return "state"; // timers, stack, scheduler or counters
+	return NULL;
+}
@@ -0,0 +1,107 @@
+/* chip8_movie.h
+* Keypad movies. A movie is the machine state it starts from and every keypad
+* change stamped with the instruction count it happened at, so a replay is
+* bit-exact however the host paces it. No SDL / IMGUI dependencies.
+* GitHub: https:\\github.com\tommojphillips
+*/
+
+#ifndef CHIP8_MOVIE_H
+#define CHIP8_MOVIE_H
+
+#include <stdint.h>
+
+#include "chip8_snapshot.h"
+
+/* "C8MV" */
+#define CHIP8_MOVIE_MAGIC 0x564D3843
+
+/* Bump when the movie file changes */
+#define CHIP8_MOVIE_VERSION 1
+
+typedef struct CHIP8_MACHINE CHIP8_MACHINE;
+
+/* Movie mode */
+typedef enum {
+	CHIP8_MOVIE_IDLE = 0,
+	CHIP8_MOVIE_RECORDING = 1,
+	CHIP8_MOVIE_PLAYING = 2,
+
+	/* Played to where the recording stopped and compared against it */
+	CHIP8_MOVIE_FINISHED = 3,
+} CHIP8_MOVIE_MODE;
+
+/* Keypad change */
+typedef struct {
+	uint64_t instruction_count; // applied before this instruction runs
+	uint16_t keypad; // the whole keypad after the change
+	uint16_t reserved[3];
+} CHIP8_MOVIE_EVENT;
+
+/* Movie file header. Followed by the start and end snapshots and the events */
+typedef struct {
+	uint32_t magic; // CHIP8_MOVIE_MAGIC
+	uint16_t version; // CHIP8_MOVIE_VERSION
+	uint16_t reserved;
+	uint32_t snapshot_size; // sizeof(CHIP8_SNAPSHOT)
+	uint32_t event_count;
+} CHIP8_MOVIE_HEADER;
+
+/* Movie */
+typedef struct CHIP8_MOVIE {
+	CHIP8_MOVIE_MODE mode;
+
+	CHIP8_SNAPSHOT start; // state the recording started from
+	CHIP8_SNAPSHOT end; // state the recording stopped at
+
+	CHIP8_MOVIE_EVENT* events;
+	uint32_t event_count;
+	uint32_t event_capacity;
+	uint32_t next_event; // playback position
+	uint16_t keypad; // keypad after the last recorded change
+
+	const char* mismatch; // finished: first field that differed from the recording, NULL if none
+	CHIP8_SNAPSHOT check; // state compared against end
+} CHIP8_MOVIE;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Allocate an empty movie. returns NULL on failure */
+CHIP8_MOVIE* chip8_movie_create();
+
+/* Free a movie */
+void chip8_movie_destroy(CHIP8_MOVIE* movie);
+
+/* Start recording a machine from its current state */
+void chip8_movie_record(CHIP8_MOVIE* movie, CHIP8_MACHINE* machine);
+
+/* Stop recording or playing and detach from the machine */
+void chip8_movie_stop(CHIP8_MOVIE* movie, CHIP8_MACHINE* machine);
+
+/* Restore the start state into a machine and replay the keypad.
+   returns 0 on success */
+int chip8_movie_play(CHIP8_MOVIE* movie, CHIP8_MACHINE* machine);
+
+/* Record the machine keypad if it changed. Called after a key command */
+void chip8_movie_record_keypad(CHIP8_MOVIE* movie, const CHIP8_MACHINE* machine);
+
+/* Playback. Apply the changes due at the current instruction and check for the
+   end of the movie. returns due in period instructions, stopped at the next change.
+   Does nothing while the machine is running ahead */
+int chip8_movie_update(CHIP8_MACHINE* machine, int due);
+
+/* Playback. Check for the end of the movie at a timer period; not while running ahead */
+void chip8_movie_end_period(CHIP8_MACHINE* machine);
+
+/* Write a stopped recording to a file. returns 0 on success */
+int chip8_movie_write_file(const CHIP8_MOVIE* movie, const char* filename);
+
+/* Read a movie from a file. returns 0 on success */
+int chip8_movie_read_file(CHIP8_MOVIE* movie, const char* filename);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif
@@ -0,0 +1,154 @@
+/* chip8_profile.c
+* Execution profiler. Instructions run per address and per opcode class, and
+* host time spent in DXYN against everything else. While disabled the engines
+* run uncounted.
+* GitHub: https:\\github.com\tommojphillips
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#include "chip8_profile.h"
+#include "chip8_machine.h"
+#include "chip8_decode.h"
+#include "chip8_debug.h"
+#include "chip8.h" // chip8 cpu core
+
+static uint64_t profile_ns();
+static void profile_step(CHIP8_MACHINE* machine, int core);
+
+CHIP8_PROFILE* chip8_profile_create() {
+	CHIP8_PROFILE* profile = (CHIP8_PROFILE*)malloc(sizeof(CHIP8_PROFILE));
+	if (profile == NULL) {
+		return NULL;
+	}
+	memset(profile, 0, sizeof(CHIP8_PROFILE));
+	return profile;
+}
+void chip8_profile_destroy(CHIP8_PROFILE* profile) {
+	free(profile);
+}
+void chip8_profile_reset(CHIP8_PROFILE* profile) {
+	const int enabled = profile->enabled;
+	memset(profile, 0, sizeof(CHIP8_PROFILE));
+	profile->enabled = enabled;
+}
+const char* chip8_profile_class_name(int op_class) {
+	static const char* names[CHIP8_PROFILE_CLASSES] = {
+		"0NNN sys / cls / ret",
+		"1NNN jump",
+		"2NNN call",
+		"3XNN skip eq",
+		"4XNN skip ne",
+		"5XY0 skip eq",
+		"6XNN load",
+		"7XNN add",
+		"8XYN alu",
+		"9XY0 skip ne",
+		"ANNN load i",
+		"BNNN jump v0",
+		"CXNN random",
+		"DXYN draw",
+		"EXNN skip key",
+		"FXNN misc",
+	};
+	return names[op_class & (CHIP8_PROFILE_CLASSES - 1)];
+}
+
+void chip8_profile_execute(CHIP8_MACHINE* machine, int core) {
+
+	CHIP8_PROFILE* profile = machine->profile;
+	const uint16_t pc = machine->cpu.pc & CHIP8_ADDR_MASK;
+	const int op_class = machine->cpu.ram[pc] >> 4;
+
+	profile->address_counts[pc]++;
+	profile->class_counts[op_class]++;
+	profile->instructions++;
+
+	/* only draws are timed; a clock read per instruction would be the profile */
+	if (op_class == CHIP8_PROFILE_CLASS_DRAW) {
+		const uint64_t start = profile_ns();
+		profile_step(machine, core);
+		profile->draw_ns += profile_ns() - start;
+	}
+	else {
+		profile_step(machine, core);
+	}
+}
+int chip8_profile_run(CHIP8_MACHINE* machine, int budget) {
+
+	CHIP8* cpu = &machine->cpu;
+	const uint64_t start = profile_ns();
+
+	int count = 0;
+	if (machine->debug != NULL && machine->debug->armed) {
+		/* checks and counts each instruction */
+		count = chip8_debug_run(machine, budget);
+	}
+	else {
+		const int core = (machine->engine == CHIP8_ENGINE_CORE && machine->platform == CHIP8_PLATFORM_CHIP8);
+		while (count < budget && cpu->draw_display == 0 && cpu->cpu_state == CHIP8_STATE_EXE) {
+			chip8_profile_execute(machine, core);
+			count++;
+		}
+	}
+
+	machine->profile->run_ns += profile_ns() - start;
+	return count;
+}
+
+int chip8_profile_write_csv(const CHIP8_PROFILE* profile, const CHIP8* cpu, const char* filename) {
+
+	FILE* file = NULL;
+#ifdef _MSC_VER
+	fopen_s(&file, filename, "w");
+#else
+	file = fopen(filename, "w");
+#endif
+	if (file == NULL) {
+		return 1;
+	}
+
+	fprintf(file, "address,opcode,class,count,percent\n");
+	for (int addr = 0; addr < CHIP8_MEMORY_BYTES; ++addr) {
+		const uint64_t count = profile->address_counts[addr];
+		if (count == 0)
+			continue;
+
+		const uint16_t opcode = CHIP8_FETCH(cpu->ram, addr);
+		fprintf(file, "0x%03x,0x%04x,%s,%llu,%.3f\n", addr, opcode, chip8_profile_class_name(opcode >> 12),
+			(unsigned long long)count, count * 100.0 / profile->instructions);
+	}
+
+	const int result = ferror(file) ? 1 : 0;
+	fclose(file);
+	return result;
+}
+
+static uint64_t profile_ns() {
+#ifdef _WIN32
+	LARGE_INTEGER counter;
+	LARGE_INTEGER frequency;
+	QueryPerformanceCounter(&counter);
+	QueryPerformanceFrequency(&frequency);
+	return (uint64_t)(counter.QuadPart * (1e9 / frequency.QuadPart));
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+#endif
+}
+static void profile_step(CHIP8_MACHINE* machine, int core) {
+	if (core)
+		chip8_execute(&machine->cpu);
+	else
+		chip8_decode_step(machine);
+}
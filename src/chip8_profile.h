@@ -0,0 +1,67 @@
+/* chip8_profile.h
+* Execution profiler. Instructions run per address and per opcode class, and
+* host time spent in DXYN against everything else. While disabled the engines
+* run uncounted. No SDL / IMGUI dependencies.
+* GitHub: https:\\github.com\tommojphillips
+*/
+
+#ifndef CHIP8_PROFILE_H
+#define CHIP8_PROFILE_H
+
+#include <stdint.h>
+
+#include "chip8.h" // chip8 cpu core
+
+/* Opcode classes; the high nibble of the opcode */
+#define CHIP8_PROFILE_CLASSES 16
+
+/* Class of DXYN */
+#define CHIP8_PROFILE_CLASS_DRAW 0xD
+
+typedef struct CHIP8_MACHINE CHIP8_MACHINE;
+
+/* Profile */
+typedef struct CHIP8_PROFILE {
+	int enabled; // 1 = count; 0 = the engines run uncounted
+
+	uint64_t address_counts[CHIP8_MEMORY_BYTES]; // instructions run at each address
+	uint64_t class_counts[CHIP8_PROFILE_CLASSES]; // instructions run per opcode class
+	uint64_t instructions; // instructions counted
+
+	uint64_t draw_ns; // host time running DXYN
+	uint64_t run_ns; // host time running counted instructions, DXYN included
+} CHIP8_PROFILE;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Allocate a disabled, zeroed profile. returns NULL on failure */
+CHIP8_PROFILE* chip8_profile_create();
+
+/* Free a profile */
+void chip8_profile_destroy(CHIP8_PROFILE* profile);
+
+/* Zero the counters */
+void chip8_profile_reset(CHIP8_PROFILE* profile);
+
+/* Name of an opcode class, e.g. "DXYN draw" */
+const char* chip8_profile_class_name(int op_class);
+
+/* Count and run the instruction at pc; on the core if core is set, else
+   stepped through the cache */
+void chip8_profile_execute(CHIP8_MACHINE* machine, int core);
+
+/* Run up to budget instructions one at a time, counting each. Stops early
+   like the engines. returns instructions executed */
+int chip8_profile_run(CHIP8_MACHINE* machine, int budget);
+
+/* Write the address counts as csv; address, opcode in ram, class, count and
+   percent of the instructions counted. returns 0 on success */
+int chip8_profile_write_csv(const CHIP8_PROFILE* profile, const CHIP8* cpu, const char* filename);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif
@@ -0,0 +1,303 @@
+/* chip8_rewind.c
+* Rewind buffer. Machine snapshots are kept as XOR deltas against a keyframe,
+* run length encoded, in a ring that evicts the oldest states to stay in budget.
+* GitHub: https:\\github.com\tommojphillips
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chip8_rewind.h"
+#include "chip8_snapshot.h"
+#include "chip8_machine.h"
+
+/* Encoding. A control byte below 0x80 is followed by control + 1 literal
+   bytes of the XOR. Otherwise it and the next byte are a run of
+   ((control & 0x7F) << 8 | next) + 1 bytes that match the keyframe */
+#define REWIND_MAX_LITERAL 0x80
+#define REWIND_MAX_RUN 0x8000
+#define REWIND_MIN_RUN 3
+
+/* Worst case encoded size of n bytes */
+#define REWIND_ENCODE_BOUND(n) ((n) + (n) / REWIND_MAX_LITERAL + 16)
+
+/* A delta bigger than this fraction of its keyframe is stored as a keyframe */
+#define REWIND_DELTA_LIMIT 2
+
+/* keyframes are encoded against nothing */
+static const CHIP8_SNAPSHOT rewind_zero = { 0 };
+
+static uint32_t rewind_encode(const uint8_t* data, const uint8_t* base, uint32_t size, uint8_t* out);
+static void rewind_decode(const uint8_t* in, uint32_t in_size, const uint8_t* base, uint8_t* out);
+static int rewind_push(CHIP8_REWIND* rewind, uint32_t size, uint64_t key, uint64_t frame_count);
+static void rewind_evict_group(CHIP8_REWIND* rewind);
+static void rewind_decode_entry(CHIP8_REWIND* rewind, uint64_t index, CHIP8_SNAPSHOT* out);
+
+CHIP8_REWIND* chip8_rewind_create(size_t budget, int interval) {
+
+	CHIP8_REWIND* rewind = (CHIP8_REWIND*)malloc(sizeof(CHIP8_REWIND));
+	if (rewind == NULL) {
+		return NULL;
+	}
+	memset(rewind, 0, sizeof(CHIP8_REWIND));
+
+	/* the entry records come out of the budget too */
+	rewind->entry_capacity = (uint32_t)(budget / CHIP8_REWIND_BYTES_PER_ENTRY);
+	if (rewind->entry_capacity < CHIP8_REWIND_KEYFRAME_INTERVAL * 2)
+		rewind->entry_capacity = CHIP8_REWIND_KEYFRAME_INTERVAL * 2;
+
+	const size_t entry_bytes = rewind->entry_capacity * sizeof(CHIP8_REWIND_ENTRY);
+	size_t data_size = (budget > entry_bytes) ? budget - entry_bytes : 0;
+	if (data_size < REWIND_ENCODE_BOUND(sizeof(CHIP8_SNAPSHOT)) * 2)
+		data_size = REWIND_ENCODE_BOUND(sizeof(CHIP8_SNAPSHOT)) * 2;
+	if (data_size > UINT32_MAX)
+		data_size = UINT32_MAX;
+	rewind->data_size = (uint32_t)data_size;
+
+	rewind->data = (uint8_t*)malloc(rewind->data_size);
+	rewind->entries = (CHIP8_REWIND_ENTRY*)malloc(entry_bytes);
+	rewind->scratch = (uint8_t*)malloc(REWIND_ENCODE_BOUND(sizeof(CHIP8_SNAPSHOT)));
+	if (rewind->data == NULL || rewind->entries == NULL || rewind->scratch == NULL) {
+		chip8_rewind_destroy(rewind);
+		return NULL;
+	}
+
+	rewind->interval = (interval > 0) ? interval : 1;
+	return rewind;
+}
+void chip8_rewind_destroy(CHIP8_REWIND* rewind) {
+	if (rewind != NULL) {
+		free(rewind->data);
+		free(rewind->entries);
+		free(rewind->scratch);
+		free(rewind);
+	}
+}
+void chip8_rewind_clear(CHIP8_REWIND* rewind) {
+	rewind->first += rewind->count;
+	rewind->count = 0;
+	rewind->head = 0;
+	rewind->used = 0;
+	rewind->base_valid = 0;
+}
+int chip8_rewind_capture(CHIP8_REWIND* rewind, const CHIP8_MACHINE* machine) {
+
+	if (rewind->count > 0) {
+		/* a state that went back in time (a load) is always captured */
+		const uint64_t newest = rewind->entries[(rewind->first + rewind->count - 1) % rewind->entry_capacity].frame_count;
+		if (machine->frame_count == newest)
+			return 0;
+		if (machine->frame_count > newest && machine->frame_count - newest < (uint64_t)rewind->interval)
+			return 0;
+	}
+
+	chip8_snapshot_save(machine, &rewind->current);
+
+	const uint64_t index = rewind->first + rewind->count;
+	const uint8_t* data = (const uint8_t*)&rewind->current;
+	const uint32_t size = sizeof(CHIP8_SNAPSHOT);
+
+	if (rewind->base_valid && index - rewind->base_key < CHIP8_REWIND_KEYFRAME_INTERVAL) {
+		const uint32_t keyframe_size = rewind->entries[rewind->base_key % rewind->entry_capacity].size;
+		const uint32_t encoded = rewind_encode(data, (const uint8_t*)&rewind->base, size, rewind->scratch);
+		if (encoded <= keyframe_size / REWIND_DELTA_LIMIT && rewind_push(rewind, encoded, rewind->base_key, machine->frame_count) == 0) {
+			rewind->last_size = encoded;
+			rewind->captures++;
+			return 1;
+		}
+	}
+
+	/* new keyframe; the deltas after it are against this state */
+	const uint32_t encoded = rewind_encode(data, (const uint8_t*)&rewind_zero, size, rewind->scratch);
+	if (rewind_push(rewind, encoded, index, machine->frame_count) != 0) {
+		return 0;
+	}
+	memcpy(&rewind->base, &rewind->current, sizeof(CHIP8_SNAPSHOT));
+	rewind->base_key = index;
+	rewind->base_valid = 1;
+	rewind->last_size = encoded;
+	rewind->captures++;
+	rewind->keyframes++;
+	return 1;
+}
+int chip8_rewind_step_back(CHIP8_REWIND* rewind, CHIP8_MACHINE* machine) {
+
+	if (rewind->count == 0) {
+		return 1;
+	}
+
+	const uint64_t index = rewind->first + rewind->count - 1;
+	const CHIP8_REWIND_ENTRY* entry = &rewind->entries[index % rewind->entry_capacity];
+	const uint64_t key = entry->key;
+	rewind_decode_entry(rewind, index, &rewind->current);
+
+	rewind->head = entry->offset;
+	rewind->used -= entry->size;
+	rewind->count--;
+	if (key == index) {
+		/* the keyframe is gone; the next capture starts a new one */
+		rewind->base_valid = 0;
+	}
+
+	/* only the ram that differs is invalidated; the caches and jit blocks
+	   survive each step while rewinding */
+	return chip8_snapshot_restore(machine, &rewind->current);
+}
+uint64_t chip8_rewind_frames(const CHIP8_REWIND* rewind) {
+	if (rewind->count == 0)
+		return 0;
+	const uint64_t oldest = rewind->entries[rewind->first % rewind->entry_capacity].frame_count;
+	const uint64_t newest = rewind->entries[(rewind->first + rewind->count - 1) % rewind->entry_capacity].frame_count;
+	return (newest > oldest) ? newest - oldest : 0;
+}
+
+static uint32_t rewind_encode(const uint8_t* data, const uint8_t* base, uint32_t size, uint8_t* out) {
+
+	uint8_t* o = out;
+	uint32_t i = 0;
+	while (i < size) {
+
+		/* bytes that match the keyframe; a word at a time */
+		uint32_t end = i;
+		while (end + 8 <= size) {
+			uint64_t a, b;
+			memcpy(&a, data + end, 8);
+			memcpy(&b, base + end, 8);
+			if (a != b)
+				break;
+			end += 8;
+		}
+		while (end < size && data[end] == base[end]) {
+			end++;
+		}
+
+		uint32_t run = end - i;
+		if (run >= REWIND_MIN_RUN || (run > 0 && end == size)) {
+			while (run > 0) {
+				const uint32_t n = (run < REWIND_MAX_RUN) ? run : REWIND_MAX_RUN;
+				*o++ = (uint8_t)(0x80 | ((n - 1) >> 8));
+				*o++ = (uint8_t)((n - 1) & 0xFF);
+				i += n;
+				run -= n;
+			}
+			continue;
+		}
+
+		/* literal up to the next run worth encoding */
+		uint8_t* control = o++;
+		uint32_t count = 0;
+		while (i < size && count < REWIND_MAX_LITERAL) {
+			if (i + REWIND_MIN_RUN <= size && data[i] == base[i] && data[i + 1] == base[i + 1] && data[i + 2] == base[i + 2])
+				break;
+			*o++ = data[i] ^ base[i];
+			i++;
+			count++;
+		}
+		*control = (uint8_t)(count - 1);
+	}
+	return (uint32_t)(o - out);
+}
+static void rewind_decode(const uint8_t* in, uint32_t in_size, const uint8_t* base, uint8_t* out) {
+
+	const uint8_t* end = in + in_size;
+	uint32_t i = 0;
+	while (in < end) {
+		const uint8_t control = *in++;
+		if (control & 0x80) {
+			const uint32_t run = (((control & 0x7F) << 8) | *in++) + 1;
+			memcpy(out + i, base + i, run);
+			i += run;
+		}
+		else {
+			const uint32_t count = control + 1;
+			for (uint32_t n = 0; n < count; ++n) {
+				out[i + n] = in[n] ^ base[i + n];
+			}
+			in += count;
+			i += count;
+		}
+	}
+}
+static int rewind_push(CHIP8_REWIND* rewind, uint32_t size, uint64_t key, uint64_t frame_count) {
+
+	/* find size contiguous bytes at head, evicting the oldest groups.
+	   returns 1 if a delta would evict its own keyframe */
+	if (size > rewind->data_size)
+		return 1;
+
+	if (rewind->count == rewind->entry_capacity) {
+		if (rewind->first == key)
+			return 1;
+		rewind_evict_group(rewind);
+	}
+
+	for (;;) {
+		if (rewind->count == 0) {
+			rewind->head = 0;
+			break;
+		}
+
+		const uint32_t oldest = rewind->entries[rewind->first % rewind->entry_capacity].offset;
+		if (oldest >= rewind->head) {
+			/* free up to the oldest entry */
+			if (rewind->head + size <= oldest)
+				break;
+		}
+		else {
+			/* free to the end of the ring, then wrap */
+			if (rewind->head + size <= rewind->data_size)
+				break;
+			rewind->head = 0;
+			continue;
+		}
+
+		if (rewind->first == key)
+			return 1;
+		rewind_evict_group(rewind);
+	}
+
+	const uint64_t index = rewind->first + rewind->count;
+	CHIP8_REWIND_ENTRY* entry = &rewind->entries[index % rewind->entry_capacity];
+	entry->offset = rewind->head;
+	entry->size = size;
+	entry->key = key;
+	entry->frame_count = frame_count;
+	memcpy(rewind->data + rewind->head, rewind->scratch, size);
+
+	rewind->head += size;
+	rewind->used += size;
+	rewind->count++;
+	return 0;
+}
+static void rewind_evict_group(CHIP8_REWIND* rewind) {
+	/* the oldest keyframe and the deltas against it */
+	const uint64_t key = rewind->first;
+	do {
+		rewind->used -= rewind->entries[rewind->first % rewind->entry_capacity].size;
+		rewind->first++;
+		rewind->count--;
+		rewind->evictions++;
+	} while (rewind->count > 0 && rewind->entries[rewind->first % rewind->entry_capacity].key == key);
+
+	if (rewind->count == 0) {
+		rewind->base_valid = 0;
+	}
+}
+static void rewind_decode_entry(CHIP8_REWIND* rewind, uint64_t index, CHIP8_SNAPSHOT* out) {
+
+	const CHIP8_REWIND_ENTRY* entry = &rewind->entries[index % rewind->entry_capacity];
+	if (entry->key == index) {
+		rewind_decode(rewind->data + entry->offset, entry->size, (const uint8_t*)&rewind_zero, (uint8_t*)out);
+		return;
+	}
+
+	if (!rewind->base_valid || rewind->base_key != entry->key) {
+		/* stepped back past the keyframe base was decoded from */
+		const CHIP8_REWIND_ENTRY* key = &rewind->entries[entry->key % rewind->entry_capacity];
+		rewind_decode(rewind->data + key->offset, key->size, (const uint8_t*)&rewind_zero, (uint8_t*)&rewind->base);
+		rewind->base_key = entry->key;
+		rewind->base_valid = 1;
+	}
+	rewind_decode(rewind->data + entry->offset, entry->size, (const uint8_t*)&rewind->base, (uint8_t*)out);
+}
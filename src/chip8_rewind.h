@@ -0,0 +1,88 @@
+/* chip8_rewind.h
+* Rewind buffer. Machine snapshots are kept as XOR deltas against a keyframe,
+* run length encoded, in a ring that evicts the oldest states to stay in budget.
+* No SDL / IMGUI dependencies.
+* GitHub: https:\\github.com\tommojphillips
+*/
+
+#ifndef CHIP8_REWIND_H
+#define CHIP8_REWIND_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "chip8_snapshot.h"
+
+/* Most deltas stored against one keyframe */
+#define CHIP8_REWIND_KEYFRAME_INTERVAL 120
+
+/* Budget bytes per entry record. Bounds the number of states held */
+#define CHIP8_REWIND_BYTES_PER_ENTRY 512
+
+typedef struct CHIP8_MACHINE CHIP8_MACHINE;
+
+/* Rewind entry. The data is in the ring */
+typedef struct {
+	uint32_t offset; // ring offset of the encoded snapshot
+	uint32_t size; // encoded bytes
+	uint64_t key; // index of the keyframe entry the delta is against; its own index for a keyframe
+	uint64_t frame_count; // machine frame count of the snapshot
+} CHIP8_REWIND_ENTRY;
+
+/* Rewind buffer. Entries are numbered from 0 as they are captured; entry n
+   is in entries[n % entry_capacity]. The oldest entry is always a keyframe */
+typedef struct CHIP8_REWIND {
+	uint8_t* data; // encoded snapshots
+	uint32_t data_size;
+	uint32_t head; // ring offset the next entry is written at
+
+	CHIP8_REWIND_ENTRY* entries;
+	uint32_t entry_capacity;
+	uint64_t first; // index of the oldest entry
+	uint32_t count; // entries held
+	uint64_t used; // encoded bytes held
+
+	int interval; // capture every Nth frame
+
+	CHIP8_SNAPSHOT base; // decoded keyframe new deltas are against
+	uint64_t base_key; // entry index of base
+	int base_valid; // base is the newest keyframe in the ring
+
+	CHIP8_SNAPSHOT current; // snapshot being captured or restored
+	uint8_t* scratch; // encode buffer
+
+	uint32_t last_size; // encoded bytes of the last capture
+	uint64_t captures;
+	uint64_t keyframes;
+	uint64_t evictions; // entries dropped to stay in budget
+} CHIP8_REWIND;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Allocate a rewind buffer using about budget bytes. States are captured
+   every interval frames. returns NULL on failure */
+CHIP8_REWIND* chip8_rewind_create(size_t budget, int interval);
+
+/* Free a rewind buffer */
+void chip8_rewind_destroy(CHIP8_REWIND* rewind);
+
+/* Drop every state */
+void chip8_rewind_clear(CHIP8_REWIND* rewind);
+
+/* Capture the machine if interval frames have passed since the newest state.
+   returns 1 if a state was captured */
+int chip8_rewind_capture(CHIP8_REWIND* rewind, const CHIP8_MACHINE* machine);
+
+/* Restore the newest state and drop it. returns 0 on success, 1 if empty */
+int chip8_rewind_step_back(CHIP8_REWIND* rewind, CHIP8_MACHINE* machine);
+
+/* Frames between the oldest and newest state */
+uint64_t chip8_rewind_frames(const CHIP8_REWIND* rewind);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif
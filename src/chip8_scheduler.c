@@ -0,0 +1,212 @@
+/* chip8_scheduler.c
+* Work-stealing scheduler. Runs independent machine jobs across all cores.
+
+* Each worker owns a queue of machine indices. A worker runs a slice of its
+* newest job and re-queues it if it has more work. Idle workers steal the
+* oldest job from another worker's queue, so long running roms spread out
+* over the pool instead of leaving cores idle. A worker with nothing to run
+* or steal sleeps until a job is queued or finishes.
+
+* GitHub: https:\\github.com\tommojphillips
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "chip8_scheduler.h"
+#include "chip8_machine.h"
+#include "thread.h"
+
+/* Worker job queue */
+typedef struct {
+	THREAD_MUTEX lock;
+	int* jobs;
+	int capacity;
+	int head;
+	int count;
+} WORK_QUEUE;
+
+/* Scheduler state shared by all workers */
+typedef struct {
+	WORK_QUEUE* queues;
+	int queue_count;
+	CHIP8_MACHINE** machines;
+	CHIP8_SCHEDULER_FN fn;
+	void* user_data;
+	volatile long remaining;
+
+	/* idle workers sleep on wake; changes counts queued and finished jobs */
+	THREAD_MUTEX idle_lock;
+	THREAD_COND wake;
+	volatile long changes;
+	int idle_count;
+} SCHEDULER;
+
+/* Worker thread args */
+typedef struct {
+	SCHEDULER* scheduler;
+	int index;
+} WORKER;
+
+static void queue_push(WORK_QUEUE* q, int job) {
+	thread_mutex_lock(&q->lock);
+	q->jobs[(q->head + q->count) % q->capacity] = job;
+	q->count++;
+	thread_mutex_unlock(&q->lock);
+}
+static int queue_pop_back(WORK_QUEUE* q, int* job) {
+	int result = 0;
+	thread_mutex_lock(&q->lock);
+	if (q->count > 0) {
+		q->count--;
+		*job = q->jobs[(q->head + q->count) % q->capacity];
+		result = 1;
+	}
+	thread_mutex_unlock(&q->lock);
+	return result;
+}
+static int queue_pop_front(WORK_QUEUE* q, int* job) {
+	int result = 0;
+	thread_mutex_lock(&q->lock);
+	if (q->count > 0) {
+		*job = q->jobs[q->head];
+		q->head = (q->head + 1) % q->capacity;
+		q->count--;
+		result = 1;
+	}
+	thread_mutex_unlock(&q->lock);
+	return result;
+}
+
+static void wake_idle(SCHEDULER* s) {
+	thread_mutex_lock(&s->idle_lock);
+	thread_atomic_add(&s->changes, 1);
+	if (s->idle_count > 0) {
+		thread_cond_broadcast(&s->wake);
+	}
+	thread_mutex_unlock(&s->idle_lock);
+}
+static void wait_idle(SCHEDULER* s, long seen) {
+	thread_mutex_lock(&s->idle_lock);
+	s->idle_count++;
+	/* nothing queued or finished since the failed scan; sleep until something is */
+	while (s->changes == seen && thread_atomic_load(&s->remaining) > 0) {
+		thread_cond_wait(&s->wake, &s->idle_lock);
+	}
+	s->idle_count--;
+	thread_mutex_unlock(&s->idle_lock);
+}
+
+static int steal(SCHEDULER* s, int index, int* job) {
+	for (int i = 1; i < s->queue_count; ++i) {
+		WORK_QUEUE* victim = &s->queues[(index + i) % s->queue_count];
+		if (queue_pop_front(victim, job)) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static void worker_main(void* arg) {
+	WORKER* worker = (WORKER*)arg;
+	SCHEDULER* s = worker->scheduler;
+	WORK_QUEUE* own = &s->queues[worker->index];
+
+	while (thread_atomic_load(&s->remaining) > 0) {
+
+		const long seen = thread_atomic_load(&s->changes);
+
+		int job;
+		if (!queue_pop_back(own, &job) && !steal(s, worker->index, &job)) {
+			wait_idle(s, seen);
+			continue;
+		}
+
+		if (s->fn(s->machines[job], s->user_data)) {
+			queue_push(own, job);
+		}
+		else {
+			thread_atomic_add(&s->remaining, -1);
+		}
+		wake_idle(s);
+	}
+}
+
+int chip8_scheduler_run(CHIP8_MACHINE** machines, int machine_count, int thread_count, CHIP8_SCHEDULER_FN fn, void* user_data) {
+
+	if (machine_count <= 0) {
+		return 0;
+	}
+
+	if (thread_count <= 0) {
+		thread_count = thread_cpu_count();
+	}
+	if (thread_count > machine_count) {
+		thread_count = machine_count;
+	}
+
+	SCHEDULER s = { 0 };
+	s.machines = machines;
+	s.fn = fn;
+	s.user_data = user_data;
+	s.remaining = machine_count;
+	s.queue_count = thread_count;
+
+	s.queues = (WORK_QUEUE*)calloc(thread_count, sizeof(WORK_QUEUE));
+	WORKER* workers = (WORKER*)calloc(thread_count, sizeof(WORKER));
+	THREAD* threads = (THREAD*)calloc(thread_count, sizeof(THREAD));
+	if (s.queues == NULL || workers == NULL || threads == NULL) {
+		printf("Failed to allocate scheduler\n");
+		free(s.queues);
+		free(workers);
+		free(threads);
+		return 1;
+	}
+
+	thread_mutex_init(&s.idle_lock);
+	thread_cond_init(&s.wake);
+	for (int i = 0; i < thread_count; ++i) {
+		thread_mutex_init(&s.queues[i].lock);
+		s.queues[i].capacity = machine_count;
+		s.queues[i].jobs = (int*)malloc(machine_count * sizeof(int));
+		if (s.queues[i].jobs == NULL) {
+			printf("Failed to allocate scheduler queue\n");
+			exit(1);
+		}
+		workers[i].scheduler = &s;
+		workers[i].index = i;
+	}
+
+	/* deal the jobs out round robin */
+	for (int i = 0; i < machine_count; ++i) {
+		queue_push(&s.queues[i % thread_count], i);
+	}
+
+	/* worker 0 runs on the calling thread */
+	int started = 1;
+	for (int i = 1; i < thread_count; ++i) {
+		if (thread_create(&threads[i], worker_main, &workers[i]) != 0) {
+			printf("Failed to create worker thread %d\n", i);
+			break;
+		}
+		started++;
+	}
+
+	worker_main(&workers[0]);
+
+	for (int i = 1; i < started; ++i) {
+		thread_join(threads[i]);
+	}
+
+	for (int i = 0; i < thread_count; ++i) {
+		thread_mutex_destroy(&s.queues[i].lock);
+		free(s.queues[i].jobs);
+	}
+	thread_cond_destroy(&s.wake);
+	thread_mutex_destroy(&s.idle_lock);
+	free(s.queues);
+	free(workers);
+	free(threads);
+	return 0;
+}
@@ -0,0 +1,28 @@
+/* chip8_scheduler.h
+* Work-stealing scheduler. Runs independent machine jobs across all cores.
+* GitHub: https:\\github.com\tommojphillips
+*/
+
+#ifndef CHIP8_SCHEDULER_H
+#define CHIP8_SCHEDULER_H
+
+#include "chip8_machine.h"
+
+/* Run a slice of work for one machine.
+   return non-zero if the machine has more work to do; it is re-queued */
+typedef int (*CHIP8_SCHEDULER_FN)(CHIP8_MACHINE* machine, void* user_data);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Run every machine until fn returns 0 for it.
+   thread_count <= 0 uses one worker per logical cpu.
+   returns 0 on success */
+int chip8_scheduler_run(CHIP8_MACHINE** machines, int machine_count, int thread_count, CHIP8_SCHEDULER_FN fn, void* user_data);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif
@@ -6,129 +6,272 @@
 #include <stdio.h>
 #include <time.h>
 #include <malloc.h>
+#include <string.h>
+
+#include "SDL.h"
 
 #include "chip8_sdl2.h"
+#include "chip8_machine.h"
+#include "chip8_command.h"
 #include "chip8.h" // chip8 cpu core
 #include "display.h"
+#include "frame_pacer.h"
+#include "thread.h"
+#include "save_state.h"
+#include "chip8_rewind.h"
+#include "chip8_movie.h"
+#include "chip8_snapshot.h"
+#include "chip8_debug.h"
+#include "chip8_profile.h"
 
+CHIP8_MACHINE* machine = NULL;
 CHIP8* chip8 = NULL;
 CHIP8_CONFIG chip8_config = { 0 };
 CHIP8_STATE chip8_state = { 0 };
+CHIP8_STATUS chip8_status = { 0 };
 
-static void chip8_emulate_cycle();
-static void chip8_single_step_cycle();
-static void set_default_settings();
+/* Emulation thread. The UI thread posts commands, the emulation thread
+   drains them between timer periods */
+static CHIP8_COMMAND_QUEUE command_queue = { 0 };
+static SDL_Thread* emulation_thread = NULL;
+static SDL_sem* emulation_wake = NULL; // posted with every command
+static volatile long emulation_running = 0;
+static int emulation_fast_forward = 0; // fast forward state of the last update
+static CHIP8_REWIND* emulation_rewind = NULL; // emulation thread only
+static int emulation_rewind_mb = 0; // budget emulation_rewind was created with
+static CHIP8_MOVIE* emulation_movie = NULL; // emulation thread only
+static CHIP8_SNAPSHOT emulation_run_ahead_state; // real state while running ahead
+static uint64_t emulation_run_ahead_frame = UINT64_MAX; // frame the presented run-ahead frame was run from
+static uint16_t emulation_run_ahead_keypad = 0; // keypad it was run with
+static uint64_t emulation_debug_stops = 0; // debugger stops reported
+static CHIP8_DEBUG* emulation_debug = NULL; // owned here; machine->debug points at it
+static CHIP8_PROFILE* emulation_profile = NULL; // owned here; machine->profile points at it
 
-void upload_pixels_to_buffer() {
-	for (int i = 0; i < CHIP8_NUM_PIXELS; ++i) {
-		window_state->display_buffer[i] = chip8->display[i];
-	}
-}
+/* Config values applied by the last update; emulation thread only. Only the
+   ones the ui changed since are applied, so a restored state keeps its own
+   settings until the ui has taken them into the config */
+static int emulation_engine = -1;
+static int emulation_platform = -1;
+static int emulation_cpu_target = -1;
+static int emulation_timer_target = -1;
+
+/* Status published to the ui thread */
+static THREAD_MUTEX emulation_status_lock;
+static CHIP8_STATUS emulation_status = { 0 }; // under emulation_status_lock
+static uint32_t status_generation = 0; // generation chip8_config took last; ui thread only
+
+/* chip8_config as the ui last posted it, under emulation_status_lock, and the
+   emulation thread's copy of it, taken at the start of every update. The
+   emulation thread never reads chip8_config */
+static CHIP8_CONFIG emulation_config_posted = { 0 };
+static CHIP8_CONFIG emulation_config = { 0 };
+
+/* Speed readouts a second */
+#define EMULATION_RATE_HZ 4
+
+/* Uncapped fast forward checks for commands this often a second */
+#define EMULATION_UNCAPPED_SLICE_HZ 500
+
+/* The movie recorded and replayed by the movie commands */
+#define EMULATION_MOVIE_FILENAME "chip8_movie.c8m"
+
+/* The profile written by CHIP8_COMMAND_PROFILE_EXPORT */
+#define EMULATION_PROFILE_FILENAME "chip8_profile.csv"
+
+static void set_default_settings();
+static void config_from_quirks(uint8_t quirks);
+static int emulation_thread_main(void* arg);
+static void emulation_update();
+static void emulation_take_config();
+static void emulation_apply_config();
+static void emulation_publish_status(int changed);
+static void emulation_publish_debug(CHIP8_DEBUG_STATUS* status);
+static uint64_t emulation_run_uncapped(uint64_t start);
+static void emulation_update_render_interval(int fast_forward);
+static void emulation_update_rate(uint64_t now);
+static uint64_t emulation_next_deadline();
+static uint32_t emulation_blocked_timeout();
+static void emulation_update_rewind();
+static void emulation_capture();
+static void emulation_rewind_step();
+static void emulation_sync_config();
+static void emulation_update_movie();
+static int emulation_run_ahead_active();
+static void emulation_run_ahead();
+static void emulation_run_ahead_stop();
+static void emulation_update_debug();
+static void emulation_movie_stop(const char* reason);
+static void emulation_movie_command(const CHIP8_COMMAND* command);
+static void execute_commands();
+static void execute_command(const CHIP8_COMMAND* command);
+static void post_command(const CHIP8_COMMAND* command);
 
 void chip8_init() {
 
-	srand((uint32_t)time(NULL));
+	machine = chip8_machine_create();
+	if (machine == NULL) {
+		printf("Failed to allocate chip8 machine.\n");
+		exit(1);
+	}
+	chip8_machine_seed_random(machine, (uint64_t)time(NULL));
+
+	emulation_debug = chip8_debug_create();
+	if (emulation_debug == NULL) {
+		printf("Failed to allocate debugger\n");
+		exit(1);
+	}
+	machine->debug = emulation_debug;
 
-	chip8 = (CHIP8*)malloc(sizeof(CHIP8));
-	if (chip8 == NULL) {
-		printf("Failed to allocate chip8 cpu instance.\n");
+	emulation_profile = chip8_profile_create();
+	if (emulation_profile == NULL) {
+		printf("Failed to allocate profile\n");
 		exit(1);
 	}
+	machine->profile = emulation_profile;
 
-	chip8_init_cpu(chip8);
+	chip8 = &machine->cpu;
+	chip8_state.last_update_ticks = SDL_GetPerformanceCounter();
+	thread_mutex_init(&emulation_status_lock);
 
 	set_default_settings();
 }
 void chip8_destroy() {
 
-	if (chip8 != NULL) {
-		free(chip8);
+	if (machine != NULL) {
+		chip8_debug_destroy(emulation_debug);
+		emulation_debug = NULL;
+		chip8_profile_destroy(emulation_profile);
+		emulation_profile = NULL;
+		chip8_machine_destroy(machine);
+		machine = NULL;
 		chip8 = NULL;
+		thread_mutex_destroy(&emulation_status_lock);
 	}
 }
-void chip8_update() {
+void chip8_start_thread() {
 
-	if (chip8_state.single_step == SINGLE_STEP_EXE) {
-		chip8_state.single_step = SINGLE_STEP_NONE;
-		chip8_single_step_cycle();
-	}
-	else {
-		if (chip8->cpu_state == CHIP8_STATE_EXE) {
-			chip8_emulate_cycle();
-		}
+	chip8_command_queue_init(&command_queue);
+
+	emulation_wake = SDL_CreateSemaphore(0);
+	if (emulation_wake == NULL) {
+		printf("Failed to create emulation semaphore\n");
+		exit(1);
 	}
-}
-void chip8_reset() {
-	CHIP8_CPU_STATE s = chip8->cpu_state;
-	if (s == CHIP8_STATE_ERROR_OPCODE) 
-		s = CHIP8_STATE_HLT;
-	chip8_reset_cpu(chip8);
-	chip8->cpu_state = s;
-	chip8_state.mnem_str[0] = '\0';
-}
 
-void chip8_render(CHIP8* chip8) {
-	if (chip8->draw_display = 1) {
-		chip8->draw_display = 0;
-		upload_pixels_to_buffer();
+	/* the thread only applies what changes from here */
+	emulation_config_posted = chip8_config;
+	emulation_take_config();
+	emulation_apply_config();
+	emulation_publish_status(0);
+
+	chip8_state.last_update_ticks = SDL_GetPerformanceCounter();
+	thread_atomic_exchange(&emulation_running, 1);
+
+	emulation_thread = SDL_CreateThread(emulation_thread_main, "chip8", NULL);
+	if (emulation_thread == NULL) {
+		printf("Failed to create emulation thread\n");
+		exit(1);
 	}
 }
+void chip8_stop_thread() {
+
+	if (emulation_thread == NULL)
+		return;
+
+	thread_atomic_exchange(&emulation_running, 0);
+	SDL_SemPost(emulation_wake);
+	SDL_WaitThread(emulation_thread, NULL);
+	emulation_thread = NULL;
+
+	/* anything posted after the last drain */
+	execute_commands();
+	chip8_sync_status();
 
-void chip8_beep(CHIP8* chip8) {
-	printf("BEEP **Not Implemented\n");
+	chip8_rewind_destroy(emulation_rewind);
+	emulation_rewind = NULL;
+	emulation_rewind_mb = 0;
+
+	/* a recording is written when the emulator closes */
+	emulation_movie_stop(NULL);
+	emulation_run_ahead_stop();
+
+	SDL_DestroySemaphore(emulation_wake);
+	emulation_wake = NULL;
 }
-uint8_t chip8_random() {
-	return (rand() % 256);
+const CHIP8_PROFILE* chip8_get_profile() {
+	return emulation_profile;
 }
+void chip8_sync_status() {
 
-static void chip8_emulate_cycle() {
+	thread_mutex_lock(&emulation_status_lock);
+	chip8_status = emulation_status;
 
-	while (chip8->draw_display == 0 && window_stats->instructions_per_frame < (chip8_config.cpu_target / 60.0)) {
-		window_stats->instructions_per_frame++;
-		chip8_execute(chip8);
+	if (chip8_status.generation != status_generation) {
+		/* the machine changed its settings under the config; take them */
+		status_generation = chip8_status.generation;
+		chip8_config.engine = chip8_status.engine;
+		chip8_config.platform = chip8_status.platform;
+		chip8_config.cpu_target = chip8_status.cpu_target;
+		chip8_config.timer_target = chip8_status.timer_target;
+		config_from_quirks(chip8_status.quirks);
 	}
 
-	const double timer_duration = (1000.0 / chip8_config.timer_target);
-	window_stats->timer_elapsed_time += window_stats->delta_time;
-	if (timer_duration < window_stats->timer_elapsed_time) {
-		window_stats->timer_elapsed_time -= timer_duration;
-		chip8_step_timers(chip8);
-	}
+	/* the emulation thread takes the config from here */
+	emulation_config_posted = chip8_config;
+	thread_mutex_unlock(&emulation_status_lock);
 }
-static void chip8_single_step_cycle() {
-	chip8_execute(chip8);
-	chip8_step_timers(chip8);
+void chip8_post_command(CHIP8_COMMAND_TYPE type, uint16_t arg, uint32_t value) {
+	CHIP8_COMMAND command = { 0 };
+	command.type = type;
+	command.arg = arg;
+	command.value = value;
+	post_command(&command);
 }
+void chip8_post_load_program(const char* filename) {
 
-int load_program(const char* filename) {
+	const size_t size = strlen(filename) + 1;
+	char* copy = (char*)malloc(size);
+	if (copy == NULL) {
+		printf("Failed to allocate program filename\n");
+		exit(1);
+	}
+	memcpy(copy, filename, size);
 
-	chip8_reset();
-	chip8_zero_program_memory(chip8);
+	CHIP8_COMMAND command = { 0 };
+	command.type = CHIP8_COMMAND_LOAD_PROGRAM;
+	command.filename = copy;
+	post_command(&command);
+}
+void chip8_post_debug_expression(CHIP8_COMMAND_TYPE type, const char* text) {
 
-	uint32_t size = 0;
-	FILE* file = NULL;
-	fopen_s(&file, filename, "rb");
-	if (file == NULL) {
-		printf("Error: could not open file: %s\n", filename);
-		chip8->cpu_state = CHIP8_STATE_HLT;
-		return 1;
+	const size_t size = strlen(text) + 1;
+	char* copy = (char*)malloc(size);
+	if (copy == NULL) {
+		printf("Failed to allocate debug expression\n");
+		exit(1);
 	}
+	memcpy(copy, text, size);
+
+	CHIP8_COMMAND command = { 0 };
+	command.type = type;
+	command.text = copy;
+	post_command(&command);
+}
+void chip8_reset() {
+	chip8_post_command(CHIP8_COMMAND_RESET, 0, 0);
+	chip8_state.mnem_str[0] = '\0';
+}
 
-	fseek(file, 0, SEEK_END);
-	size = ftell(file);
-	fseek(file, 0, SEEK_SET);
+int load_program(const char* filename) {
 
-	if (CHIP8_MEMORY_BYTES - CHIP8_PROGRAM_ADDR < size) {
-		fclose(file);
-		printf("Error: program too big\n");
-		chip8->cpu_state = CHIP8_STATE_HLT;
+	if (chip8_machine_load_program(machine, filename) != 0) {
 		return 1;
 	}
 
-	fread(chip8->ram + CHIP8_PROGRAM_ADDR, 1, size, file);
-	fclose(file);
-	printf("Loaded %s (%d bytes) into RAM at 0x%x\n", filename, size, CHIP8_PROGRAM_ADDR);
-	chip8->cpu_state = CHIP8_STATE_EXE;
+	/* counts of the last program are not this one's */
+	chip8_profile_reset(emulation_profile);
+
+	printf("Loaded %s into RAM at 0x%x\n", filename, CHIP8_PROGRAM_ADDR);
 	return 0;
 }
 
@@ -136,6 +279,16 @@ static void set_default_settings() {
 	chip8_config.cpu_target = 540; // 540hz
 	chip8_config.timer_target = 60; // 60hz
 	chip8_config.render_target = 60; // 60hz
+	chip8_config.engine = CHIP8_ENGINE_CACHED;
+	chip8_config.platform = CHIP8_PLATFORM_CHIP8;
+	chip8_config.vsync = 0;
+	chip8_config.texture_renderer = 1;
+	chip8_config.fast_forward_speed = 0;
+	chip8_config.fast_forward_render_interval = 0;
+	chip8_config.idle_skip = 1;
+	chip8_config.rewind_buffer_mb = 16;
+	chip8_config.rewind_interval = 1;
+	chip8_config.run_ahead = 0;
 
 	chip8_config.on_color.r = 100;
 	chip8_config.on_color.g = 255;
@@ -162,28 +315,578 @@ static void set_default_settings() {
 }
 void set_quirks() {
 	/* set cpu quirks from config */
+	uint8_t quirks = chip8->quirks;
 	if (chip8_config.quirk_cls_on_reset)
-		chip8->quirks |= CHIP8_QUIRK_CLS_ON_RESET;
+		quirks |= CHIP8_QUIRK_CLS_ON_RESET;
 	if (chip8_config.quirk_zero_vf_register)
-		chip8->quirks |= CHIP8_QUIRK_ZERO_VF_REGISTER;
+		quirks |= CHIP8_QUIRK_ZERO_VF_REGISTER;
 	if (chip8_config.quirk_shift_x_register)
-		chip8->quirks |= CHIP8_QUIRK_SHIFT_X_REGISTER;
+		quirks |= CHIP8_QUIRK_SHIFT_X_REGISTER;
 	if (chip8_config.quirk_increment_i_register)
-		chip8->quirks |= CHIP8_QUIRK_INCREMENT_I_REGISTER;
+		quirks |= CHIP8_QUIRK_INCREMENT_I_REGISTER;
 	if (chip8_config.quirk_jump)
-		chip8->quirks |= CHIP8_QUIRK_JUMP_VX;
+		quirks |= CHIP8_QUIRK_JUMP_VX;
 	if (chip8_config.quirk_display_clipping)
-		chip8->quirks |= CHIP8_QUIRK_DISPLAY_CLIPPING;
+		quirks |= CHIP8_QUIRK_DISPLAY_CLIPPING;
 	if (chip8_config.quirk_display_wait)
-		chip8->quirks |= CHIP8_QUIRK_DISPLAY_WAIT;
+		quirks |= CHIP8_QUIRK_DISPLAY_WAIT;
+	chip8_post_command(CHIP8_COMMAND_SET_QUIRKS, 0, quirks);
 }
 void get_quirks() {
 	/* get cpu quirks and set config */
-	chip8_config.quirk_cls_on_reset = (chip8->quirks & CHIP8_QUIRK_CLS_ON_RESET);
-	chip8_config.quirk_zero_vf_register = (chip8->quirks & CHIP8_QUIRK_ZERO_VF_REGISTER);
-	chip8_config.quirk_shift_x_register = chip8->quirks & CHIP8_QUIRK_SHIFT_X_REGISTER;
-	chip8_config.quirk_increment_i_register = (chip8->quirks & CHIP8_QUIRK_INCREMENT_I_REGISTER);
-	chip8_config.quirk_jump = (chip8->quirks & CHIP8_QUIRK_JUMP_VX);
-	chip8_config.quirk_display_clipping = (chip8->quirks & CHIP8_QUIRK_DISPLAY_CLIPPING);
-	chip8_config.quirk_display_wait = (chip8->quirks & CHIP8_QUIRK_DISPLAY_WAIT);
+	config_from_quirks(chip8->quirks);
+}
+static void config_from_quirks(uint8_t quirks) {
+	chip8_config.quirk_cls_on_reset = (quirks & CHIP8_QUIRK_CLS_ON_RESET);
+	chip8_config.quirk_zero_vf_register = (quirks & CHIP8_QUIRK_ZERO_VF_REGISTER);
+	chip8_config.quirk_shift_x_register = quirks & CHIP8_QUIRK_SHIFT_X_REGISTER;
+	chip8_config.quirk_increment_i_register = (quirks & CHIP8_QUIRK_INCREMENT_I_REGISTER);
+	chip8_config.quirk_jump = (quirks & CHIP8_QUIRK_JUMP_VX);
+	chip8_config.quirk_display_clipping = (quirks & CHIP8_QUIRK_DISPLAY_CLIPPING);
+	chip8_config.quirk_display_wait = (quirks & CHIP8_QUIRK_DISPLAY_WAIT);
+}
+
+static int emulation_thread_main(void* arg) {
+
+	SDL_SetThreadPriority(SDL_THREAD_PRIORITY_HIGH);
+
+	while (thread_atomic_load(&emulation_running)) {
+
+		execute_commands();
+		emulation_update();
+
+		if (thread_atomic_load(&chip8_state.rewind_held) && emulation_rewind != NULL) {
+			/* one state back every timer period */
+			frame_pacer_wait_until(emulation_next_deadline(), 0);
+		}
+		else if (chip8->cpu_state == CHIP8_STATE_EXE && machine->blocked == CHIP8_BLOCKED_KEY &&
+			chip8->delay_timer == 0 && chip8->sound_timer == 0) {
+			/* waiting on a key with idle timers; nothing to do until a command */
+			SDL_SemWaitTimeout(emulation_wake, emulation_blocked_timeout());
+		}
+		else if (chip8->cpu_state == CHIP8_STATE_EXE) {
+			/* blocked until vblank or on a key; sleep to the period without the spin */
+			const uint64_t deadline = emulation_next_deadline();
+			if (deadline != 0) {
+				frame_pacer_wait_until(deadline, machine->blocked == CHIP8_BLOCKED_NONE);
+			}
+		}
+		else {
+			/* nothing to run until a command arrives */
+			SDL_SemWaitTimeout(emulation_wake, 100);
+		}
+	}
+	return 0;
+}
+static void emulation_update() {
+
+	emulation_take_config();
+	emulation_apply_config();
+	emulation_update_rewind();
+
+	const int fast_forward = CHIP8_FAST_FORWARD;
+	const int speed = fast_forward ? emulation_config.fast_forward_speed : 1;
+	emulation_update_render_interval(fast_forward);
+	if (emulation_fast_forward && !fast_forward) {
+		/* show the frame fast forward stopped on */
+		chip8_machine_publish(machine);
+	}
+	emulation_fast_forward = fast_forward;
+
+	/* emulated time follows the host clock, not the render rate. Fast
+	   forward scales it; timers and instructions keep their ratio */
+	uint64_t now = SDL_GetPerformanceCounter();
+
+	if (thread_atomic_load(&chip8_state.rewind_held) && emulation_rewind != NULL) {
+		emulation_rewind_step();
+	}
+	else if (chip8->cpu_state == CHIP8_STATE_EXE) {
+		if (speed <= 0) {
+			now = emulation_run_uncapped(now);
+		}
+		else {
+			/* the catch up limit is in emulated periods */
+			machine->max_catchup = CHIP8_MACHINE_DEFAULT_MAX_CATCHUP * speed;
+			chip8_machine_advance(machine, (now - chip8_state.last_update_ticks) * speed, SDL_GetPerformanceFrequency());
+			emulation_capture();
+		}
+	}
+	emulation_run_ahead();
+
+	chip8_state.last_update_ticks = now;
+	emulation_update_rate(now);
+	emulation_update_movie();
+	emulation_update_debug();
+	emulation_publish_status(0);
+}
+static void emulation_take_config() {
+	thread_mutex_lock(&emulation_status_lock);
+	emulation_config = emulation_config_posted;
+	thread_mutex_unlock(&emulation_status_lock);
+}
+static void emulation_apply_config() {
+	const int cpu_target = emulation_config.cpu_target;
+	const int timer_target = emulation_config.timer_target;
+	const int platform = emulation_config.platform;
+	const int engine = emulation_config.engine;
+
+	const int cpu_target_changed = (cpu_target != emulation_cpu_target && cpu_target != machine->cpu_target);
+	const int timer_target_changed = (timer_target != emulation_timer_target && timer_target != machine->timer_target);
+	const int platform_changed = (platform != emulation_platform && platform != machine->platform);
+	if (emulation_movie != NULL && (cpu_target_changed || timer_target_changed || platform_changed)) {
+		emulation_movie_stop("the clock or platform changed");
+	}
+
+	if (cpu_target != emulation_cpu_target) {
+		emulation_cpu_target = cpu_target;
+		machine->cpu_target = cpu_target;
+	}
+	if (timer_target != emulation_timer_target) {
+		emulation_timer_target = timer_target;
+		machine->timer_target = timer_target;
+	}
+	machine->idle_skip = emulation_config.idle_skip;
+
+	if (engine != emulation_engine) {
+		emulation_engine = engine;
+		if (machine->engine != engine) {
+			chip8_machine_set_engine(machine, (CHIP8_ENGINE)engine);
+			if (machine->engine != engine) {
+				/* fell back; show the engine that runs */
+				emulation_publish_status(1);
+			}
+		}
+	}
+	if (platform != emulation_platform) {
+		emulation_platform = platform;
+		if (machine->platform != platform) {
+			chip8_machine_set_platform(machine, (CHIP8_PLATFORM)platform);
+			chip8_machine_publish(machine);
+		}
+	}
+}
+static void emulation_publish_status(int changed) {
+	/* changed = the machine's settings no longer match the config */
+	thread_mutex_lock(&emulation_status_lock);
+	if (changed) {
+		emulation_status.generation++;
+	}
+	emulation_status.engine = machine->engine;
+	emulation_status.platform = machine->platform;
+	emulation_status.cpu_target = machine->cpu_target;
+	emulation_status.timer_target = machine->timer_target;
+	emulation_status.quirks = machine->cpu.quirks;
+	emulation_status.blocked = machine->blocked;
+	emulation_publish_debug(&emulation_status.debug);
+	frame_pacer_get_stats(&emulation_status.pacing);
+	thread_mutex_unlock(&emulation_status_lock);
+}
+static void emulation_publish_debug(CHIP8_DEBUG_STATUS* status) {
+	/* under emulation_status_lock */
+	const CHIP8_DEBUG* debug = emulation_debug;
+	if (status->stops != debug->stops) {
+		status->stops = debug->stops;
+		chip8_debug_describe_stop(debug, status->stop, sizeof(status->stop));
+	}
+
+	status->breakpoint_count = debug->breakpoint_count;
+	memcpy(status->breakpoints, debug->breakpoints, sizeof(status->breakpoints));
+
+	status->watch_count = debug->watch_count;
+	for (int i = 0; i < debug->watch_count; ++i) {
+		memcpy(status->watch_sources[i], debug->watches[i].expr.source, CHIP8_DEBUG_MAX_SOURCE);
+		status->watch_values[i] = debug->watches[i].value;
+	}
+
+	status->condition_count = debug->condition_count;
+	for (int i = 0; i < debug->condition_count; ++i) {
+		memcpy(status->condition_sources[i], debug->conditions[i].source, CHIP8_DEBUG_MAX_SOURCE);
+	}
+}
+static uint64_t emulation_run_uncapped(uint64_t start) {
+	/* whole timer periods until the slice is used; returns the end time */
+	const uint64_t end = start + SDL_GetPerformanceFrequency() / EMULATION_UNCAPPED_SLICE_HZ;
+	uint64_t now = start;
+	while (now < end && chip8->cpu_state == CHIP8_STATE_EXE) {
+		chip8_machine_run_frame(machine);
+		emulation_capture();
+		now = SDL_GetPerformanceCounter();
+	}
+	return now;
+}
+static void emulation_update_render_interval(int fast_forward) {
+	int interval = 1;
+	if (fast_forward) {
+		interval = emulation_config.fast_forward_render_interval;
+		if (interval <= 0) {
+			/* about render_target frames a second reach the presenter */
+			const int render_target = (emulation_config.render_target > 0) ? emulation_config.render_target : 1;
+			interval = (int)(chip8_state.speed * machine->timer_target / render_target);
+		}
+		if (interval < 1) {
+			interval = 1;
+		}
+	}
+	machine->render_interval = interval;
+}
+static void emulation_update_rate(uint64_t now) {
+	const uint64_t frequency = SDL_GetPerformanceFrequency();
+	const uint64_t elapsed = now - chip8_state.rate_ticks;
+	if (elapsed < frequency / EMULATION_RATE_HZ)
+		return;
+
+	if (machine->instruction_count >= chip8_state.rate_instructions && machine->frame_count >= chip8_state.rate_frames) {
+		const double seconds = elapsed / (double)frequency;
+		const int timer_target = (machine->timer_target > 0) ? machine->timer_target : 1;
+		chip8_state.mips = (machine->instruction_count - chip8_state.rate_instructions) / seconds / 1000000.0;
+		chip8_state.speed = (machine->frame_count - chip8_state.rate_frames) / (double)timer_target / seconds;
+	}
+
+	if (chip8_state.rewind_captures > 0) {
+		chip8_state.rewind_capture_us = chip8_state.rewind_capture_ticks * 1000000.0 / frequency / chip8_state.rewind_captures;
+	}
+	chip8_state.rewind_capture_ticks = 0;
+	chip8_state.rewind_captures = 0;
+
+	if (chip8_state.run_ahead_runs > 0) {
+		const int timer_target = (machine->timer_target > 0) ? machine->timer_target : 1;
+		chip8_state.run_ahead_us = chip8_state.run_ahead_ticks * 1000000.0 / frequency / chip8_state.run_ahead_runs;
+		chip8_state.run_ahead_load = chip8_state.run_ahead_us * timer_target / 10000.0;
+	}
+	chip8_state.run_ahead_ticks = 0;
+	chip8_state.run_ahead_runs = 0;
+	if (emulation_rewind != NULL) {
+		const int timer_target = (machine->timer_target > 0) ? machine->timer_target : 1;
+		chip8_state.rewind_capture_bytes = emulation_rewind->last_size;
+		chip8_state.rewind_entries = emulation_rewind->count;
+		chip8_state.rewind_bytes = emulation_rewind->used;
+		chip8_state.rewind_seconds = chip8_rewind_frames(emulation_rewind) / (double)timer_target;
+	}
+
+	chip8_state.rate_ticks = now;
+	chip8_state.rate_instructions = machine->instruction_count;
+	chip8_state.rate_frames = machine->frame_count;
+}
+static uint64_t emulation_next_deadline() {
+	/* 0 = run again now */
+	if (thread_atomic_load(&chip8_state.rewind_held) && emulation_rewind != NULL) {
+		const int timer_target = (machine->timer_target > 0) ? machine->timer_target : 1;
+		return chip8_state.last_update_ticks + SDL_GetPerformanceFrequency() / timer_target;
+	}
+
+	if (chip8->cpu_state != CHIP8_STATE_EXE)
+		return UINT64_MAX;
+
+	const int speed = CHIP8_FAST_FORWARD ? emulation_config.fast_forward_speed : 1;
+	if (speed <= 0)
+		return 0;
+
+	const uint64_t ticks = chip8_machine_ticks_to_next_period(machine, SDL_GetPerformanceFrequency());
+	return chip8_state.last_update_ticks + (ticks + speed - 1) / speed;
+}
+static uint32_t emulation_blocked_timeout() {
+	/* ms the emulation thread sleeps on a key; short enough that the periods
+	   slept through are caught up instead of dropped */
+	const int timer_target = (machine->timer_target > 0) ? machine->timer_target : 1;
+	return (uint32_t)((CHIP8_MACHINE_DEFAULT_MAX_CATCHUP - 1) * 1000 / timer_target);
+}
+static void emulation_update_rewind() {
+	const int mb = (emulation_config.rewind_buffer_mb > 0) ? emulation_config.rewind_buffer_mb : 0;
+	if (mb != emulation_rewind_mb) {
+		chip8_rewind_destroy(emulation_rewind);
+		emulation_rewind = NULL;
+		emulation_rewind_mb = mb;
+		chip8_state.rewind_capture_bytes = 0;
+		chip8_state.rewind_entries = 0;
+		chip8_state.rewind_bytes = 0;
+		chip8_state.rewind_seconds = 0;
+		if (mb > 0) {
+			emulation_rewind = chip8_rewind_create((size_t)mb * 1024 * 1024, emulation_config.rewind_interval);
+			if (emulation_rewind == NULL) {
+				printf("Failed to allocate %d MB rewind buffer\n", mb);
+			}
+		}
+	}
+
+	if (emulation_rewind != NULL) {
+		emulation_rewind->interval = (emulation_config.rewind_interval > 0) ? emulation_config.rewind_interval : 1;
+	}
+}
+static void emulation_capture() {
+	if (emulation_rewind == NULL || chip8->cpu_state != CHIP8_STATE_EXE)
+		return;
+
+	const uint64_t start = SDL_GetPerformanceCounter();
+	if (chip8_rewind_capture(emulation_rewind, machine)) {
+		chip8_state.rewind_capture_ticks += SDL_GetPerformanceCounter() - start;
+		chip8_state.rewind_captures++;
+	}
+}
+static void emulation_rewind_step() {
+	emulation_movie_stop("rewind");
+	const CHIP8_CPU_STATE state = chip8->cpu_state;
+	if (chip8_rewind_step_back(emulation_rewind, machine) == 0) {
+		if (state == CHIP8_STATE_HLT) {
+			/* stay paused on the state stepped back to */
+			chip8->cpu_state = CHIP8_STATE_HLT;
+		}
+		emulation_sync_config();
+		chip8_debug_sync(emulation_debug, chip8);
+		chip8_machine_publish(machine);
+	}
+}
+static void emulation_sync_config() {
+	/* a restored state brings its own platform, rates and quirks; the ui
+	   takes them into the config. emulation_apply_config() only applies
+	   config changes, so the old settings are not put back meanwhile */
+	emulation_publish_status(1);
+}
+static void emulation_update_movie() {
+	if (emulation_movie == NULL)
+		return;
+
+	if (emulation_movie->mode == CHIP8_MOVIE_FINISHED) {
+		if (emulation_movie->mismatch == NULL) {
+			printf("Movie replay matches the recording at instruction %llu\n", (unsigned long long)emulation_movie->end.instruction_count);
+		}
+		else {
+			printf("Movie replay differs from the recording: %s\n", emulation_movie->mismatch);
+		}
+		emulation_movie_stop(NULL);
+		return;
+	}
+
+	chip8_state.movie_mode = emulation_movie->mode;
+	if (emulation_movie->mode == CHIP8_MOVIE_PLAYING) {
+		chip8_state.movie_events = emulation_movie->event_count - emulation_movie->next_event;
+	}
+	else {
+		chip8_state.movie_events = emulation_movie->event_count;
+	}
+}
+static void emulation_movie_stop(const char* reason) {
+	if (emulation_movie == NULL)
+		return;
+
+	const int recording = (emulation_movie->mode == CHIP8_MOVIE_RECORDING);
+	chip8_movie_stop(emulation_movie, machine);
+	if (reason != NULL) {
+		printf("Movie stopped; %s\n", reason);
+	}
+	if (recording) {
+		if (chip8_movie_write_file(emulation_movie, EMULATION_MOVIE_FILENAME) == 0) {
+			printf("Recorded %u key changes to %s\n", emulation_movie->event_count, EMULATION_MOVIE_FILENAME);
+		}
+		else {
+			printf("Could not write movie to %s\n", EMULATION_MOVIE_FILENAME);
+		}
+	}
+
+	chip8_movie_destroy(emulation_movie);
+	emulation_movie = NULL;
+	chip8_state.movie_mode = CHIP8_MOVIE_IDLE;
+	chip8_state.movie_events = 0;
+}
+static void emulation_movie_command(const CHIP8_COMMAND* command) {
+
+	emulation_movie_stop(NULL);
+	if (command->type == CHIP8_COMMAND_MOVIE_STOP)
+		return;
+
+	emulation_movie = chip8_movie_create();
+	if (emulation_movie == NULL) {
+		printf("Failed to allocate movie\n");
+		exit(1);
+	}
+
+	if (command->type == CHIP8_COMMAND_MOVIE_RECORD) {
+		chip8_movie_record(emulation_movie, machine);
+		printf("Recording movie\n");
+	}
+	else if (chip8_movie_read_file(emulation_movie, EMULATION_MOVIE_FILENAME) != 0 || chip8_movie_play(emulation_movie, machine) != 0) {
+		printf("Could not play movie %s\n", EMULATION_MOVIE_FILENAME);
+		chip8_movie_destroy(emulation_movie);
+		emulation_movie = NULL;
+		return;
+	}
+	else {
+		emulation_sync_config();
+		printf("Playing movie %s\n", EMULATION_MOVIE_FILENAME);
+	}
+	emulation_update_movie();
+}
+static int emulation_run_ahead_active() {
+	if (emulation_config.run_ahead <= 0 || chip8->cpu_state != CHIP8_STATE_EXE)
+		return 0;
+	if (CHIP8_FAST_FORWARD || (thread_atomic_load(&chip8_state.rewind_held) && emulation_rewind != NULL))
+		return 0;
+	if (emulation_movie != NULL && emulation_movie->mode == CHIP8_MOVIE_PLAYING)
+		return 0; // a replay has no input to hide the latency of
+	return 1;
+}
+static void emulation_run_ahead() {
+
+	/* Each frame, run ahead with the keys as they are now and present
+	   where that lands, then put the real state back. The guest reacts to
+	   a key on the frame it is pressed instead of a frame or two later */
+	if (!emulation_run_ahead_active()) {
+		emulation_run_ahead_stop();
+		return;
+	}
+
+	machine->publish_hold = 1;
+	if (machine->frame_count == emulation_run_ahead_frame && chip8->keypad == emulation_run_ahead_keypad)
+		return; // the presented frame is still current
+
+	emulation_run_ahead_frame = machine->frame_count;
+	emulation_run_ahead_keypad = chip8->keypad;
+
+	const uint64_t start = SDL_GetPerformanceCounter();
+
+	/* host side readouts are not in the snapshot; the movie, the
+	   debugger and the profile only see the real run */
+	const CHIP8_BLOCKED blocked = machine->blocked;
+	const int instructions_per_frame = machine->instructions_per_frame;
+	const uint64_t idle_skips = machine->idle_skips;
+	const uint64_t idle_instructions = machine->idle_instructions;
+	machine->running_ahead = 1;
+
+	const int frames = (emulation_config.run_ahead < CHIP8_RUN_AHEAD_MAX) ? emulation_config.run_ahead : CHIP8_RUN_AHEAD_MAX;
+	chip8_snapshot_save(machine, &emulation_run_ahead_state);
+	for (int i = 0; i < frames && chip8->cpu_state == CHIP8_STATE_EXE; ++i) {
+		chip8_machine_run_frame(machine);
+	}
+	chip8_machine_publish(machine);
+	chip8_snapshot_restore(machine, &emulation_run_ahead_state);
+
+	machine->running_ahead = 0;
+	machine->blocked = blocked;
+	machine->instructions_per_frame = instructions_per_frame;
+	machine->idle_skips = idle_skips;
+	machine->idle_instructions = idle_instructions;
+
+	chip8_state.run_ahead_ticks += SDL_GetPerformanceCounter() - start;
+	chip8_state.run_ahead_runs++;
+}
+static void emulation_run_ahead_stop() {
+	emulation_run_ahead_frame = UINT64_MAX;
+	if (machine->publish_hold) {
+		/* back to the real frame */
+		machine->publish_hold = 0;
+		chip8_machine_publish(machine);
+	}
+}
+static void emulation_update_debug() {
+	if (emulation_debug->stops == emulation_debug_stops)
+		return;
+	emulation_debug_stops = emulation_debug->stops;
+
+	char text[96];
+	chip8_debug_describe_stop(emulation_debug, text, sizeof(text));
+	printf("Debugger stopped: %s\n", text);
+}
+static void execute_commands() {
+	CHIP8_COMMAND command;
+	int count = 0;
+	while (chip8_command_pop(&command_queue, &command)) {
+		execute_command(&command);
+		count++;
+	}
+
+	if (count > 0) {
+		/* edits show up without waiting for vblank; a halted cpu has none.
+		   Running ahead, the next update runs ahead from the edited state */
+		emulation_run_ahead_frame = UINT64_MAX;
+		if (!machine->publish_hold) {
+			chip8_machine_publish(machine);
+		}
+		emulation_publish_status(0);
+	}
+}
+static void execute_command(const CHIP8_COMMAND* command) {
+
+	if (emulation_movie != NULL) {
+		/* keys, pausing and saving keep a movie in step; any other edit does not */
+		switch (command->type) {
+			case CHIP8_COMMAND_SET_KEY:
+			case CHIP8_COMMAND_SET_STATE:
+			case CHIP8_COMMAND_SAVE_STATE:
+			case CHIP8_COMMAND_MOVIE_RECORD:
+			case CHIP8_COMMAND_MOVIE_PLAY:
+			case CHIP8_COMMAND_MOVIE_STOP:
+			case CHIP8_COMMAND_DEBUG_BREAKPOINT:
+			case CHIP8_COMMAND_DEBUG_WATCH:
+			case CHIP8_COMMAND_DEBUG_CONDITION:
+			case CHIP8_COMMAND_DEBUG_REMOVE:
+			case CHIP8_COMMAND_DEBUG_CLEAR:
+			case CHIP8_COMMAND_DEBUG_RUN_TO:
+			case CHIP8_COMMAND_DEBUG_RUN_COUNT:
+			case CHIP8_COMMAND_PROFILE_ENABLE:
+			case CHIP8_COMMAND_PROFILE_RESET:
+			case CHIP8_COMMAND_PROFILE_EXPORT:
+			case CHIP8_COMMAND_PACING_RESET:
+				break;
+			default:
+				emulation_movie_stop("the machine was edited");
+				break;
+		}
+	}
+
+	if (command->type == CHIP8_COMMAND_MOVIE_RECORD || command->type == CHIP8_COMMAND_MOVIE_PLAY || command->type == CHIP8_COMMAND_MOVIE_STOP) {
+		emulation_movie_command(command);
+	}
+	else if (command->type == CHIP8_COMMAND_LOAD_PROGRAM) {
+		load_program(command->filename);
+		free(command->filename);
+	}
+	else if (command->type == CHIP8_COMMAND_SAVE_STATE) {
+		if (save_state_save(machine, command->arg) == 0) {
+			printf("Saved state to slot %d\n", command->arg + 1);
+		}
+	}
+	else if (command->type == CHIP8_COMMAND_LOAD_STATE) {
+		if (save_state_load(machine, command->arg) == 0) {
+			emulation_sync_config();
+			printf("Loaded state from slot %d\n", command->arg + 1);
+		}
+		else {
+			printf("Slot %d has no state\n", command->arg + 1);
+		}
+	}
+	else if (command->type == CHIP8_COMMAND_PROFILE_EXPORT) {
+		if (chip8_profile_write_csv(emulation_profile, chip8, EMULATION_PROFILE_FILENAME) == 0) {
+			printf("Wrote profile to %s\n", EMULATION_PROFILE_FILENAME);
+		}
+		else {
+			printf("Could not write profile to %s\n", EMULATION_PROFILE_FILENAME);
+		}
+	}
+	else if (command->type == CHIP8_COMMAND_PACING_RESET) {
+		frame_pacer_reset_stats();
+	}
+	else if (chip8_command_apply(machine, command) != 0 && command->text != NULL) {
+		printf("Could not add debug expression: %s\n", command->text);
+	}
+
+	if (command->type != CHIP8_COMMAND_SET_KEY && command->type != CHIP8_COMMAND_SET_STATE) {
+		/* an edit or a load does not trip a watch */
+		chip8_debug_sync(emulation_debug, chip8);
+	}
+	free(command->text);
+}
+static void post_command(const CHIP8_COMMAND* command) {
+
+	if (emulation_thread == NULL) {
+		/* single threaded; before the thread starts or after it stops */
+		execute_command(command);
+		chip8_machine_publish(machine);
+		return;
+	}
+
+	while (chip8_command_push(&command_queue, command) != 0) {
+		/* full; the emulation thread drains it every timer period */
+		SDL_SemPost(emulation_wake);
+		thread_yield();
+	}
+	SDL_SemPost(emulation_wake);
 }
@@ -5,6 +5,13 @@
 #include <stdint.h>
 
 #include "chip8.h" // chip8 cpu core
+#include "chip8_machine.h"
+#include "chip8_command.h"
+#include "chip8_movie.h"
+#include "chip8_debug.h"
+#include "chip8_profile.h"
+#include "frame_pacer.h"
+#include "thread.h"
 
 /* Window width*/
 #define CFG_WINDOW_W (window_state->win_w)
@@ -35,27 +42,11 @@
 #define DISPLAY_WIDTH_OFFSET (((CFG_WINDOW_W - DISPLAY_WIDTH ) >> 1) - CFG_DISPLAY_X)
 #define DISPLAY_HEIGHT_OFFSET (((CFG_WINDOW_H - DISPLAY_HEIGHT ) >> 1) - CFG_DISPLAY_Y)
 
-#define PX_OFFSET(i) ((i) * (DISPLAY_PX_SIZE + CFG_PX_SPACE))
-
-#define PX_X(i) (DISPLAY_WIDTH_OFFSET + PX_OFFSET((i) & (CHIP8_DISPLAY_WIDTH-1)))
-#define PX_Y(i) (DISPLAY_HEIGHT_OFFSET + PX_OFFSET((i) / CHIP8_DISPLAY_WIDTH))
-#define PX_W (DISPLAY_PX_SIZE)
-#define PX_H (DISPLAY_PX_SIZE)
-
 #define DISPLAY_X_LIMIT ((CFG_WINDOW_W - DISPLAY_WIDTH) >> 1)
 #define DISPLAY_Y_LIMIT ((CFG_WINDOW_H - DISPLAY_HEIGHT) >> 1)
 #define DISPLAY_W_LIMIT (CFG_WINDOW_W - CFG_DISPLAY_X - (CHIP8_DISPLAY_WIDTH * CFG_PX_SPACE))
 #define DISPLAY_PX_LIMIT ((CFG_WINDOW_W / CHIP8_DISPLAY_WIDTH) - 1)
 
-/* Single Step State */
-enum {
-	/* Not single stepping */
-	SINGLE_STEP_NONE = 0,
-
-	/* Step instruction */
-	SINGLE_STEP_EXE = 1
-};
-
 /* Chip8 pixel color */
 typedef struct {
 	uint8_t r;
@@ -81,29 +72,127 @@ typedef struct {
 	int quirk_jump;
 	int quirk_display_clipping;
 	int quirk_display_wait;
+	int engine;
+	int platform; // CHIP8_PLATFORM
+	int vsync; // present on the display refresh instead of render_target
+	int texture_renderer; // draw the display through a streaming texture instead of rects
+	int fast_forward_speed; // fast forward multiplier; 0 = as fast as the host allows
+	int fast_forward_render_interval; // publish every Nth frame while fast forwarding; 0 = about render_target a second
+	int idle_skip; // skip idle loops to the next timer period
+	int rewind_buffer_mb; // rewind buffer budget in MB; 0 = off
+	int rewind_interval; // capture a rewind state every Nth frame
+	int run_ahead; // frames emulated ahead of the presented frame to hide input latency; 0 = off
 	PIXEL_COLOR on_color;
 	PIXEL_COLOR off_color;
 } CHIP8_CONFIG;
 
 /* Chip8 state */
 typedef struct {
-	int single_step;
 	char mnem_str[32];
+	uint64_t last_update_ticks; // performance counter at the last update; emulation thread only
+
+	volatile long fast_forward_held; // set by the ui thread; thread_atomic_* only
+	volatile long fast_forward_toggled; // set by the ui thread; thread_atomic_* only
+
+	/* speed readout; written by the emulation thread */
+	double mips; // million instructions a second
+	double speed; // emulated seconds a second
+	uint64_t rate_ticks; // performance counter at the last readout
+	uint64_t rate_instructions;
+	uint64_t rate_frames;
+
+	volatile long rewind_held; // set by the ui thread; thread_atomic_* only
+
+	/* rewind readout; written by the emulation thread */
+	double rewind_capture_us; // average capture cost
+	uint32_t rewind_capture_bytes; // encoded size of the last capture
+	uint32_t rewind_entries; // states held
+	uint64_t rewind_bytes; // encoded bytes held
+	double rewind_seconds; // emulated time held
+	uint64_t rewind_capture_ticks; // capture time since the last readout
+	uint64_t rewind_captures; // captures since the last readout
+
+	/* run-ahead readout; written by the emulation thread */
+	double run_ahead_us; // average cost of running ahead and restoring
+	double run_ahead_load; // run_ahead_us as a percentage of a timer period
+	uint64_t run_ahead_ticks; // run-ahead time since the last readout
+	uint64_t run_ahead_runs; // run-aheads since the last readout
+
+	/* movie; written by the emulation thread */
+	int movie_mode; // CHIP8_MOVIE_MODE
+	uint32_t movie_events; // key changes recorded or left to replay
 } CHIP8_STATE;
 
+/* Debugger state published with the status. The ui shows this copy; only
+   the emulation thread touches the debugger */
+typedef struct {
+	uint64_t stops; // times the debugger stopped the cpu
+	char stop[64]; // the last stop, described
+	int breakpoint_count;
+	uint8_t breakpoints[CHIP8_MEMORY_BYTES]; // 1 = breakpoint at this address
+	int watch_count;
+	char watch_sources[CHIP8_DEBUG_MAX_WATCHES][CHIP8_DEBUG_MAX_SOURCE];
+	uint32_t watch_values[CHIP8_DEBUG_MAX_WATCHES]; // value at the last check
+	int condition_count;
+	char condition_sources[CHIP8_DEBUG_MAX_CONDITIONS][CHIP8_DEBUG_MAX_SOURCE];
+} CHIP8_DEBUG_STATUS;
+
+/* Machine settings published by the emulation thread. Only the ui thread
+   writes chip8_config; chip8_sync_status() copies these in and takes the
+   settings back into the config when the machine changed them */
+typedef struct {
+	uint32_t generation; // bumped when the machine's settings change under the config
+	int engine; // CHIP8_ENGINE running; a failed engine falls back
+	int platform; // CHIP8_PLATFORM
+	int cpu_target;
+	int timer_target;
+	uint8_t quirks; // CHIP8_QUIRK_* of the cpu
+	int blocked; // CHIP8_BLOCKED; what the guest waited on when the last update stopped
+	CHIP8_DEBUG_STATUS debug;
+	FRAME_PACER_STATS pacing; // the emulation thread's waits
+} CHIP8_STATUS;
+
+/* Most frames run-ahead emulates */
+#define CHIP8_RUN_AHEAD_MAX 4
+
+/* Fast forward is held or toggled on */
+#define CHIP8_FAST_FORWARD (thread_atomic_load(&chip8_state.fast_forward_held) || thread_atomic_load(&chip8_state.fast_forward_toggled))
+
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-extern CHIP8* chip8;
+extern CHIP8_MACHINE* machine;
+extern CHIP8* chip8; // &machine->cpu
 extern CHIP8_CONFIG chip8_config;
 extern CHIP8_STATE chip8_state;
+extern CHIP8_STATUS chip8_status; // ui thread copy; refreshed by chip8_sync_status()
 
 void chip8_init();
 void chip8_destroy();
 
-void chip8_update();
+/* Run the machine on its own thread. Until it is stopped the machine
+   must only be changed through chip8_post_command() */
+void chip8_start_thread();
+void chip8_stop_thread();
+
+/* The profile the frontend owns. Valid from chip8_init() to chip8_destroy();
+   read it through here, not machine->profile */
+const CHIP8_PROFILE* chip8_get_profile();
+
+/* Copy the emulation status into chip8_status; ui thread only */
+void chip8_sync_status();
+
+/* Queue a command for the emulation thread */
+void chip8_post_command(CHIP8_COMMAND_TYPE type, uint16_t arg, uint32_t value);
+
+/* Queue a program load. filename is copied */
+void chip8_post_load_program(const char* filename);
+
+/* Queue a debug watch or condition. text is copied */
+void chip8_post_debug_expression(CHIP8_COMMAND_TYPE type, const char* text);
+
 void chip8_reset();
 
 int load_program(const char* filename);
@@ -0,0 +1,276 @@
+/* chip8_snapshot.c
+* Versioned binary machine snapshots. Save and load are plain copies of the
+* cpu, the platform display and the scheduler; snapshot files are memory mapped.
+* GitHub: https:\\github.com\tommojphillips
+*/
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "chip8_snapshot.h"
+#include "chip8_machine.h"
+#include "chip8_decode.h"
+#include "chip8.h" // chip8 cpu core
+
+static void snapshot_copy_to_machine(CHIP8_MACHINE* machine, const CHIP8_SNAPSHOT* snapshot);
+static void snapshot_invalidate_changed(CHIP8_MACHINE* machine, const uint8_t* ram);
+static uint32_t snapshot_checksum(const CHIP8_SNAPSHOT* snapshot);
+
+void chip8_snapshot_save(const CHIP8_MACHINE* machine, CHIP8_SNAPSHOT* snapshot) {
+
+	/* zeroed so the padding is the same in every snapshot */
+	memset(snapshot, 0, sizeof(CHIP8_SNAPSHOT));
+	snapshot->header.magic = CHIP8_SNAPSHOT_MAGIC;
+	snapshot->header.version = CHIP8_SNAPSHOT_VERSION;
+	snapshot->header.cpu_size = sizeof(CHIP8);
+	snapshot->header.size = sizeof(CHIP8_SNAPSHOT);
+
+	memcpy(&snapshot->cpu, &machine->cpu, sizeof(CHIP8));
+	snapshot->random_state = machine->random_state;
+
+	snapshot->platform = machine->platform;
+	snapshot->plane_mask = machine->plane_mask;
+	memcpy(snapshot->rpl, machine->rpl, sizeof(snapshot->rpl));
+	memcpy(&snapshot->screen, &machine->screen, sizeof(CHIP8_FRAME));
+
+	snapshot->cpu_target = machine->cpu_target;
+	snapshot->timer_target = machine->timer_target;
+	snapshot->timer_accumulator = machine->timer_accumulator;
+	snapshot->cpu_remainder = machine->cpu_remainder;
+	snapshot->period_budget = machine->period_budget;
+	snapshot->period_count = machine->period_count;
+
+	snapshot->instruction_count = machine->instruction_count;
+	snapshot->frame_count = machine->frame_count;
+	snapshot->beep_count = machine->beep_count;
+}
+int chip8_snapshot_load(CHIP8_MACHINE* machine, const CHIP8_SNAPSHOT* snapshot) {
+
+	if (chip8_snapshot_validate(snapshot) != 0) {
+		return 1;
+	}
+
+	snapshot_copy_to_machine(machine, snapshot);
+
+	/* ram changed under every engine; respecialize and drop the caches */
+	chip8_machine_set_quirks(machine, machine->cpu.quirks);
+	return 0;
+}
+int chip8_snapshot_restore(CHIP8_MACHINE* machine, const CHIP8_SNAPSHOT* snapshot) {
+
+	if (snapshot->cpu.quirks != machine->quirks || snapshot->platform != (uint32_t)machine->platform) {
+		return chip8_snapshot_load(machine, snapshot);
+	}
+
+	if (chip8_snapshot_validate(snapshot) != 0) {
+		return 1;
+	}
+
+	/* the engines saw every write since the snapshot; only what differs is stale */
+	snapshot_invalidate_changed(machine, snapshot->cpu.ram);
+	snapshot_copy_to_machine(machine, snapshot);
+	return 0;
+}
+int chip8_snapshot_validate(const CHIP8_SNAPSHOT* snapshot) {
+	if (snapshot->header.magic != CHIP8_SNAPSHOT_MAGIC)
+		return 1;
+	if (snapshot->header.version != CHIP8_SNAPSHOT_VERSION)
+		return 1;
+	if (snapshot->header.cpu_size != sizeof(CHIP8) || snapshot->header.size != sizeof(CHIP8_SNAPSHOT))
+		return 1;
+	if (snapshot->platform >= CHIP8_PLATFORM_COUNT)
+		return 1;
+	return 0;
+}
+
+static void snapshot_copy_to_machine(CHIP8_MACHINE* machine, const CHIP8_SNAPSHOT* snapshot) {
+
+	memcpy(&machine->cpu, &snapshot->cpu, sizeof(CHIP8));
+	machine->random_state = snapshot->random_state;
+
+	/* ram already holds the big font; don't reset the display */
+	machine->platform = (CHIP8_PLATFORM)snapshot->platform;
+	machine->plane_mask = snapshot->plane_mask;
+	memcpy(machine->rpl, snapshot->rpl, sizeof(machine->rpl));
+	memcpy(&machine->screen, &snapshot->screen, sizeof(CHIP8_FRAME));
+
+	machine->cpu_target = snapshot->cpu_target;
+	machine->timer_target = snapshot->timer_target;
+	machine->timer_accumulator = snapshot->timer_accumulator;
+	machine->cpu_remainder = snapshot->cpu_remainder;
+	machine->period_budget = snapshot->period_budget;
+	machine->period_count = snapshot->period_count;
+
+	machine->instruction_count = snapshot->instruction_count;
+	machine->frame_count = snapshot->frame_count;
+	machine->beep_count = snapshot->beep_count;
+	machine->blocked = CHIP8_BLOCKED_NONE;
+}
+static void snapshot_invalidate_changed(CHIP8_MACHINE* machine, const uint8_t* ram) {
+
+	/* runs of bytes that differ; a word at a time between them */
+	const uint8_t* current = machine->cpu.ram;
+	int i = 0;
+	while (i < CHIP8_MEMORY_BYTES) {
+		if (i + 8 <= CHIP8_MEMORY_BYTES) {
+			uint64_t a, b;
+			memcpy(&a, current + i, 8);
+			memcpy(&b, ram + i, 8);
+			if (a == b) {
+				i += 8;
+				continue;
+			}
+		}
+		if (current[i] == ram[i]) {
+			i++;
+			continue;
+		}
+
+		const int start = i;
+		while (i < CHIP8_MEMORY_BYTES && current[i] != ram[i]) {
+			i++;
+		}
+		chip8_decode_invalidate(machine, (uint16_t)start, (uint16_t)(i - start));
+	}
+}
+static uint32_t snapshot_checksum(const CHIP8_SNAPSHOT* snapshot) {
+	const uint8_t* p = (const uint8_t*)snapshot + sizeof(CHIP8_SNAPSHOT_HEADER);
+	const uint8_t* end = (const uint8_t*)snapshot + sizeof(CHIP8_SNAPSHOT);
+	uint32_t hash = 2166136261u;
+	while (p < end) {
+		hash ^= *p++;
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+#ifdef _WIN32
+int chip8_snapshot_write_file(const char* filename, CHIP8_SNAPSHOT* snapshot) {
+
+	snapshot->header.checksum = snapshot_checksum(snapshot);
+
+	HANDLE file = CreateFileA(filename, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		return 1;
+	}
+
+	/* the mapping sizes the file */
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READWRITE, 0, sizeof(CHIP8_SNAPSHOT), NULL);
+	if (mapping == NULL) {
+		CloseHandle(file);
+		return 1;
+	}
+
+	void* view = MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, sizeof(CHIP8_SNAPSHOT));
+	if (view == NULL) {
+		CloseHandle(mapping);
+		CloseHandle(file);
+		return 1;
+	}
+
+	memcpy(view, snapshot, sizeof(CHIP8_SNAPSHOT));
+	UnmapViewOfFile(view);
+	CloseHandle(mapping);
+	CloseHandle(file);
+	return 0;
+}
+int chip8_snapshot_read_file(const char* filename, CHIP8_SNAPSHOT* snapshot) {
+
+	HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		return 1;
+	}
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size) || size.QuadPart != sizeof(CHIP8_SNAPSHOT)) {
+		CloseHandle(file);
+		return 1;
+	}
+
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping == NULL) {
+		CloseHandle(file);
+		return 1;
+	}
+
+	void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, sizeof(CHIP8_SNAPSHOT));
+	if (view == NULL) {
+		CloseHandle(mapping);
+		CloseHandle(file);
+		return 1;
+	}
+
+	memcpy(snapshot, view, sizeof(CHIP8_SNAPSHOT));
+	UnmapViewOfFile(view);
+	CloseHandle(mapping);
+	CloseHandle(file);
+
+	if (chip8_snapshot_validate(snapshot) != 0 || snapshot->header.checksum != snapshot_checksum(snapshot)) {
+		return 1;
+	}
+	return 0;
+}
+#else
+int chip8_snapshot_write_file(const char* filename, CHIP8_SNAPSHOT* snapshot) {
+
+	snapshot->header.checksum = snapshot_checksum(snapshot);
+
+	int fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		return 1;
+	}
+
+	if (ftruncate(fd, sizeof(CHIP8_SNAPSHOT)) != 0) {
+		close(fd);
+		return 1;
+	}
+
+	void* view = mmap(NULL, sizeof(CHIP8_SNAPSHOT), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (view == MAP_FAILED) {
+		close(fd);
+		return 1;
+	}
+
+	memcpy(view, snapshot, sizeof(CHIP8_SNAPSHOT));
+	munmap(view, sizeof(CHIP8_SNAPSHOT));
+	close(fd);
+	return 0;
+}
+int chip8_snapshot_read_file(const char* filename, CHIP8_SNAPSHOT* snapshot) {
+
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		return 1;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size != sizeof(CHIP8_SNAPSHOT)) {
+		close(fd);
+		return 1;
+	}
+
+	void* view = mmap(NULL, sizeof(CHIP8_SNAPSHOT), PROT_READ, MAP_PRIVATE, fd, 0);
+	if (view == MAP_FAILED) {
+		close(fd);
+		return 1;
+	}
+
+	memcpy(snapshot, view, sizeof(CHIP8_SNAPSHOT));
+	munmap(view, sizeof(CHIP8_SNAPSHOT));
+	close(fd);
+
+	if (chip8_snapshot_validate(snapshot) != 0 || snapshot->header.checksum != snapshot_checksum(snapshot)) {
+		return 1;
+	}
+	return 0;
+}
+#endif
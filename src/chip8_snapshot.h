@@ -0,0 +1,94 @@
+/* chip8_snapshot.h
+* Versioned binary machine snapshots. Save and load are plain copies of the
+* cpu, the platform display and the scheduler; snapshot files are memory mapped.
+* No SDL / IMGUI dependencies.
+* GitHub: https:\\github.com\tommojphillips
+*/
+
+#ifndef CHIP8_SNAPSHOT_H
+#define CHIP8_SNAPSHOT_H
+
+#include <stdint.h>
+
+#include "chip8.h" // chip8 cpu core
+#include "chip8_display.h"
+
+/* "C8SS" */
+#define CHIP8_SNAPSHOT_MAGIC 0x53533843
+
+/* Bump when CHIP8_SNAPSHOT changes */
+#define CHIP8_SNAPSHOT_VERSION 2
+
+typedef struct CHIP8_MACHINE CHIP8_MACHINE;
+
+/* Snapshot header */
+typedef struct {
+	uint32_t magic; // CHIP8_SNAPSHOT_MAGIC
+	uint16_t version; // CHIP8_SNAPSHOT_VERSION
+	uint16_t cpu_size; // sizeof(CHIP8); the core layout the snapshot was taken with
+	uint32_t size; // sizeof(CHIP8_SNAPSHOT)
+	uint32_t checksum; // FNV-1a of everything after the header. Set when written to a file
+} CHIP8_SNAPSHOT_HEADER;
+
+/* Machine snapshot. Everything that decides what the machine does next;
+   the engine, caches and host settings are not part of it */
+typedef struct {
+	CHIP8_SNAPSHOT_HEADER header;
+
+	CHIP8 cpu;
+	uint64_t random_state;
+
+	/* platform display */
+	uint32_t platform; // CHIP8_PLATFORM
+	uint8_t plane_mask;
+	uint8_t rpl[CHIP8_REGISTER_COUNT];
+	CHIP8_FRAME screen;
+
+	/* scheduler */
+	int32_t cpu_target;
+	int32_t timer_target;
+	uint64_t timer_accumulator;
+	uint32_t cpu_remainder;
+	int32_t period_budget;
+	int32_t period_count;
+
+	uint64_t instruction_count;
+	uint64_t frame_count;
+	uint64_t beep_count;
+} CHIP8_SNAPSHOT;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Take a snapshot of a machine */
+void chip8_snapshot_save(const CHIP8_MACHINE* machine, CHIP8_SNAPSHOT* snapshot);
+
+/* Restore a machine from a snapshot. The decode caches are invalidated;
+   the caller publishes the display. returns 0 on success, 1 if the
+   snapshot is from another version or layout */
+int chip8_snapshot_load(CHIP8_MACHINE* machine, const CHIP8_SNAPSHOT* snapshot);
+
+/* Restore a snapshot taken from this machine moments ago, as run-ahead does.
+   Only the ram that changed since is invalidated, so the decode caches and
+   jit blocks survive; a change of quirks or platform falls back to
+   chip8_snapshot_load(). returns 0 on success */
+int chip8_snapshot_restore(CHIP8_MACHINE* machine, const CHIP8_SNAPSHOT* snapshot);
+
+/* Check the header of a snapshot. returns 0 if it can be loaded */
+int chip8_snapshot_validate(const CHIP8_SNAPSHOT* snapshot);
+
+/* Write a snapshot to a file through a memory mapping. Sets the checksum.
+   returns 0 on success */
+int chip8_snapshot_write_file(const char* filename, CHIP8_SNAPSHOT* snapshot);
+
+/* Read a snapshot from a file through a memory mapping. returns 0 on
+   success, 1 if the file can not be read, is from another version or
+   fails the checksum */
+int chip8_snapshot_read_file(const char* filename, CHIP8_SNAPSHOT* snapshot);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif
@@ -0,0 +1,523 @@
+/* chip8_threaded.c
+* Direct-threaded basic block engine with superinstructions.
+
+* Basic blocks are discovered as execution reaches them, starting from
+* CHIP8_PROGRAM_ADDR. A block is a run of straight line instructions
+* ending in a control transfer, a RAM write or an instruction handed to the
+* predecoded cache (the core's instructions and, on SUPER-CHIP / XO-CHIP,
+* everything that touches the display). Each instruction is translated once
+* into a threaded op holding the address of its handler, so dispatch is a
+* single indirect jump (computed goto on gcc/clang, a switch elsewhere). The
+* pc is only written at block exits.
+
+* Superinstructions:
+*   SE/SNE Vx, NN / Vx, Vy followed by JP NNN -> one conditional jump
+*   LD I, NNN followed by DXYN                -> one op
+
+* A block is only entered when the remaining budget covers its worst case
+* instruction count; otherwise the tail of the budget runs on the
+* predecoded cache so instruction counts stay exact.
+
+* The run loop lives in chip8_threaded_loop.h and is compiled once for each
+* combination of the quirks it tests (VF zero, shift X, LD inc I, jump VX,
+* display clipping, display wait).
+* chip8_threaded_set_quirks() picks the variant; no quirk is tested per
+* instruction.
+
+* GitHub: https:\\github.com\tommojphillips
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chip8_threaded.h"
+#include "chip8_decode.h"
+#include "chip8_machine.h"
+#include "chip8_display.h"
+#include "chip8.h" // chip8 cpu core
+
+#if defined(__GNUC__) || defined(__clang__)
+#define THREADED_COMPUTED_GOTO 1
+#endif
+
+#define THREADED_MAX_OPS 8192
+#define THREADED_MAX_BLOCK_LEN 64
+
+/* Threaded op kinds */
+#define THREADED_OPS(X) \
+	X(6XNN) X(7XNN) \
+	X(8XY0) X(8XY1) X(8XY2) X(8XY3) X(8XY4) X(8XY5) X(8XY6) X(8XY7) X(8XYE) \
+	X(ANNN) X(CXNN) X(FX07) X(FX15) X(FX18) X(FX1E) X(FX65) \
+	X(1NNN) X(3XNN) X(4XNN) X(5XY0) X(9XY0) X(BNNN) X(DXYN) X(FX33) X(FX55) \
+	X(CORE) X(EXIT) \
+	X(3XNN_1NNN) X(4XNN_1NNN) X(5XY0_1NNN) X(9XY0_1NNN) X(ANNN_DXYN)
+
+enum {
+#define X(k) K_##k,
+	THREADED_OPS(X)
+#undef X
+	K_COUNT
+};
+
+#define THREADED_VARIANT_COUNT 64
+
+/* Quirks of run loop variant n */
+#define THREADED_VARIANT_QUIRKS(n) ( \
+	(((n) & 1) ? CHIP8_QUIRK_ZERO_VF_REGISTER : 0) | \
+	(((n) & 2) ? CHIP8_QUIRK_SHIFT_X_REGISTER : 0) | \
+	(((n) & 4) ? CHIP8_QUIRK_INCREMENT_I_REGISTER : 0) | \
+	(((n) & 8) ? CHIP8_QUIRK_JUMP_VX : 0) | \
+	(((n) & 16) ? CHIP8_QUIRK_DISPLAY_CLIPPING : 0) | \
+	(((n) & 32) ? CHIP8_QUIRK_DISPLAY_WAIT : 0))
+
+#define THREADED_RUN_NAME(n) THREADED_RUN_NAME_(n)
+#define THREADED_RUN_NAME_(n) threaded_run_##n
+
+typedef int (*THREADED_RUN_FN)(CHIP8_MACHINE* machine, int budget);
+
+/* Threaded op */
+typedef struct {
+	const void* label; // handler address (computed goto only)
+	uint16_t pc; // address of the instruction; next address for EXIT
+	uint16_t nnn;
+	uint8_t kind;
+	uint8_t x;
+	uint8_t y;
+	uint8_t nn;
+} THREADED_OP;
+
+/* Block cache */
+struct CHIP8_THREADED {
+	int16_t block_map[CHIP8_MEMORY_BYTES]; // first op of the block at addr, -1 = none
+	uint8_t block_cost[CHIP8_MEMORY_BYTES]; // worst case instructions of the block at addr
+	uint8_t code_map[CHIP8_MEMORY_BYTES]; // RAM bytes covered by a block
+	THREADED_OP ops[THREADED_MAX_OPS];
+	int op_count;
+	int dirty;
+	THREADED_RUN_FN run; // run loop for the current quirks
+};
+
+static void flush(CHIP8_THREADED* t);
+static int compile_block(CHIP8_MACHINE* machine, uint16_t start);
+
+CHIP8_THREADED* chip8_threaded_create() {
+	CHIP8_THREADED* t = (CHIP8_THREADED*)malloc(sizeof(CHIP8_THREADED));
+	if (t == NULL) {
+		return NULL;
+	}
+	flush(t);
+	chip8_threaded_set_quirks(t, 0);
+	return t;
+}
+void chip8_threaded_destroy(CHIP8_THREADED* t) {
+	if (t != NULL) {
+		free(t);
+	}
+}
+void chip8_threaded_invalidate(CHIP8_THREADED* t, uint16_t addr, uint16_t size) {
+	for (int i = 0; i < size; ++i) {
+		if (t->code_map[(addr + i) & CHIP8_ADDR_MASK]) {
+			t->dirty = 1;
+			return;
+		}
+	}
+}
+void chip8_threaded_invalidate_all(CHIP8_THREADED* t) {
+	t->dirty = 1;
+}
+
+static void flush(CHIP8_THREADED* t) {
+	memset(t->block_map, 0xFF, sizeof(t->block_map));
+	memset(t->code_map, 0, sizeof(t->code_map));
+	t->op_count = 0;
+	t->dirty = 0;
+}
+
+static int classify(uint16_t opcode) {
+	switch (opcode >> 12) {
+		case 0x1: return K_1NNN;
+		case 0x3: return K_3XNN;
+		case 0x4: return K_4XNN;
+		case 0x5: return (opcode & 0xF) == 0 ? K_5XY0 : K_CORE;
+		case 0x6: return K_6XNN;
+		case 0x7: return K_7XNN;
+		case 0x8:
+			switch (opcode & 0xF) {
+				case 0x0: return K_8XY0;
+				case 0x1: return K_8XY1;
+				case 0x2: return K_8XY2;
+				case 0x3: return K_8XY3;
+				case 0x4: return K_8XY4;
+				case 0x5: return K_8XY5;
+				case 0x6: return K_8XY6;
+				case 0x7: return K_8XY7;
+				case 0xE: return K_8XYE;
+			}
+			break;
+		case 0x9: return (opcode & 0xF) == 0 ? K_9XY0 : K_CORE;
+		case 0xA: return K_ANNN;
+		case 0xB: return K_BNNN;
+		case 0xC: return K_CXNN;
+		case 0xD: return K_DXYN;
+		case 0xF:
+			switch (opcode & 0xFF) {
+				case 0x07: return K_FX07;
+				case 0x15: return K_FX15;
+				case 0x18: return K_FX18;
+				case 0x1E: return K_FX1E;
+				case 0x33: return K_FX33;
+				case 0x55: return K_FX55;
+				case 0x65: return K_FX65;
+			}
+			break;
+	}
+	return K_CORE;
+}
+
+static int is_straight_line(int kind) {
+	return kind < K_1NNN;
+}
+
+static int compile_block(CHIP8_MACHINE* machine, uint16_t start) {
+
+	CHIP8_THREADED* t = machine->threaded;
+	const uint8_t* ram = machine->cpu.ram;
+
+	if (t->op_count + THREADED_MAX_BLOCK_LEN + 1 > THREADED_MAX_OPS) {
+		flush(t);
+	}
+
+	const int first = t->op_count;
+	int cost = 0;
+	uint16_t addr = start;
+
+	for (;;) {
+		const uint16_t opcode = CHIP8_FETCH(ram, addr);
+		THREADED_OP* op = &t->ops[t->op_count++];
+		op->label = NULL;
+		op->pc = addr;
+		op->nnn = opcode & 0x0FFF;
+		op->x = (opcode >> 8) & 0xF;
+		op->y = (opcode >> 4) & 0xF;
+		op->nn = opcode & 0xFF;
+		op->kind = (uint8_t)classify(opcode);
+		if (op->kind == K_DXYN && machine->platform != CHIP8_PLATFORM_CHIP8) {
+			op->kind = K_CORE;
+		}
+
+		t->code_map[addr & CHIP8_ADDR_MASK] = 1;
+		t->code_map[(addr + 1) & CHIP8_ADDR_MASK] = 1;
+		cost++;
+
+		/* fuse with the following instruction */
+		const uint16_t next = CHIP8_FETCH(ram, addr + 2);
+		int fused = -1;
+		switch (op->kind) {
+			case K_3XNN:
+				if ((next >> 12) == 0x1) fused = K_3XNN_1NNN;
+				break;
+			case K_4XNN:
+				if ((next >> 12) == 0x1) fused = K_4XNN_1NNN;
+				break;
+			case K_5XY0:
+				if ((next >> 12) == 0x1) fused = K_5XY0_1NNN;
+				break;
+			case K_9XY0:
+				if ((next >> 12) == 0x1) fused = K_9XY0_1NNN;
+				break;
+			case K_ANNN:
+				if ((next >> 12) == 0xD && machine->platform == CHIP8_PLATFORM_CHIP8) fused = K_ANNN_DXYN;
+				break;
+		}
+
+		if (fused != -1) {
+			/* skip + jump keeps the skip operands and takes the jump target;
+			   LD I + DXYN keeps I in nnn and takes the draw operands */
+			op->kind = (uint8_t)fused;
+			if (fused != K_ANNN_DXYN) {
+				op->nnn = next & 0x0FFF;
+			}
+			else {
+				op->x = (next >> 8) & 0xF;
+				op->y = (next >> 4) & 0xF;
+				op->nn = next & 0xF;
+			}
+			t->code_map[(addr + 2) & CHIP8_ADDR_MASK] = 1;
+			t->code_map[(addr + 3) & CHIP8_ADDR_MASK] = 1;
+			cost++;
+			break;
+		}
+
+		if (!is_straight_line(op->kind)) {
+			break;
+		}
+
+		addr += 2;
+		if (cost >= THREADED_MAX_BLOCK_LEN || addr >= CHIP8_MEMORY_BYTES - 1) {
+			THREADED_OP* exit = &t->ops[t->op_count++];
+			exit->label = NULL;
+			exit->kind = K_EXIT;
+			exit->pc = addr & CHIP8_ADDR_MASK;
+			break;
+		}
+	}
+
+	t->block_map[start] = (int16_t)first;
+	t->block_cost[start] = (uint8_t)cost;
+	return first;
+}
+
+#ifdef THREADED_COMPUTED_GOTO
+#define OP(k) L_##k
+#define DISPATCH() goto *op->label
+#else
+#define OP(k) case K_##k
+#define DISPATCH() goto dispatch
+#endif
+
+/* Next op in the block */
+#define NEXT() do { count++; op++; DISPATCH(); } while (0)
+
+/* Leave the block with pc set */
+#define EXIT_BLOCK() goto next_block
+
+#define V (cpu->v)
+#define VF (cpu->v[0xF])
+
+/* Run loop variants */
+
+#define THREADED_VARIANT 0
+#include "chip8_threaded_loop.h"
+#undef THREADED_VARIANT
+#define THREADED_VARIANT 1
+#include "chip8_threaded_loop.h"
+#undef THREADED_VARIANT
+#define THREADED_VARIANT 2
+#include "chip8_threaded_loop.h"
+#undef THREADED_VARIANT
+#define THREADED_VARIANT 3
+#include "chip8_threaded_loop.h"
+#undef THREADED_VARIANT
+#define THREADED_VARIANT 4
+#include "chip8_threaded_loop.h"
+#undef THREADED_VARIANT
+#define THREADED_VARIANT 5
+#include "chip8_threaded_loop.h"
+#undef THREADED_VARIANT
+#define THREADED_VARIANT 6
+#include "chip8_threaded_loop.h"
+#undef THREADED_VARIANT
+#define THREADED_VARIANT 7
+#include "chip8_threaded_loop.h"
+#undef THREADED_VARIANT
+#define THREADED_VARIANT 8
+#include "chip8_threaded_loop.h"
+#undef THREADED_VARIANT
+#define THREADED_VARIANT 9
+#include "chip8_threaded_loop.h"
+#undef THREADED_VARIANT
+#define THREADED_VARIANT 10
+#include "chip8_threaded_loop.h"
+#undef THREADED_VARIANT
+#define THREADED_VARIANT 11
+#include "chip8_threaded_loop.h"
+#undef THREADED_VARIANT
+#define THREADED_VARIANT 12
+#include "chip8_threaded_loop.h"
+#undef THREADED_VARIANT
+#define THREADED_VARIANT 13
+#include "chip8_threaded_loop.h"
+#undef THREADED_VARIANT
+#define THREADED_VARIANT 14
+#include "chip8_threaded_loop.h"
+#undef THREADED_VARIANT
+#define THREADED_VARIANT 15
+#include "chip8_threaded_loop.h"
+#undef THREADED_VARIANT
+#define THREADED_VARIANT 16
+#include "chip8_threaded_loop.h"
+#undef THREADED_VARIANT
+#define THREADED_VARIANT 17
+#include "chip8_threaded_loop.h"
+#undef THREADED_VARIANT
+#define THREADED_VARIANT 18
+#include "chip8_threaded_loop.h"
+#undef THREADED_VARIANT
+#define THREADED_VARIANT 19
+#include "chip8_threaded_loop.h"
+#undef THREADED_VARIANT
+#define THREADED_VARIANT 20
+#include "chip8_threaded_loop.h"
+#undef THREADED_VARIANT
+#define THREADED_VARIANT 21
+#include "chip8_threaded_loop.h"
+#undef THREADED_VARIANT
+#define THREADED_VARIANT 22
+#include "chip8_threaded_loop.h"
+#undef THREADED_VARIANT
+#define THREADED_VARIANT 23
+#include "chip8_threaded_loop.h"
+#undef THREADED_VARIANT
+#define THREADED_VARIANT 24
+#include "chip8_threaded_loop.h"
+#undef THREADED_VARIANT
+#define THREADED_VARIANT 25
+#include "chip8_threaded_loop.h"
+#undef THREADED_VARIANT
+#define THREADED_VARIANT 26
+#include "chip8_threaded_loop.h"
+#undef THREADED_VARIANT
+#define THREADED_VARIANT 27
+#include "chip8_threaded_loop.h"
+#undef THREADED_VARIANT
+#define THREADED_VARIANT 28
+#include "chip8_threaded_loop.h"
+#undef THREADED_VARIANT
+#define THREADED_VARIANT 29
+#include "chip8_threaded_loop.h"
+#undef THREADED_VARIANT
+#define THREADED_VARIANT 30
+#include "chip8_threaded_loop.h"
+#undef THREADED_VARIANT
+#define THREADED_VARIANT 31
+#include "chip8_threaded_loop.h"
+#undef THREADED_VARIANT
+#define THREADED_VARIANT 32
+#include "chip8_threaded_loop.h"
+#undef THREADED_VARIANT
+#define THREADED_VARIANT 33
+#include "chip8_threaded_loop.h"
+#undef THREADED_VARIANT
+#define THREADED_VARIANT 34
+#include "chip8_threaded_loop.h"
+#undef THREADED_VARIANT
+#define THREADED_VARIANT 35
+#include "chip8_threaded_loop.h"
+#undef THREADED_VARIANT
+#define THREADED_VARIANT 36
+#include "chip8_threaded_loop.h"
+#undef THREADED_VARIANT
+#define THREADED_VARIANT 37
+#include "chip8_threaded_loop.h"
+#undef THREADED_VARIANT
+#define THREADED_VARIANT 38
+#include "chip8_threaded_loop.h"
+#undef THREADED_VARIANT
+#define THREADED_VARIANT 39
+#include "chip8_threaded_loop.h"
+#undef THREADED_VARIANT
+#define THREADED_VARIANT 40
+#include "chip8_threaded_loop.h"
+#undef THREADED_VARIANT
+#define THREADED_VARIANT 41
+#include "chip8_threaded_loop.h"
+#undef THREADED_VARIANT
+#define THREADED_VARIANT 42
+#include "chip8_threaded_loop.h"
+#undef THREADED_VARIANT
+#define THREADED_VARIANT 43
+#include "chip8_threaded_loop.h"
+#undef THREADED_VARIANT
+#define THREADED_VARIANT 44
+#include "chip8_threaded_loop.h"
+#undef THREADED_VARIANT
+#define THREADED_VARIANT 45
+#include "chip8_threaded_loop.h"
+#undef THREADED_VARIANT
+#define THREADED_VARIANT 46
+#include "chip8_threaded_loop.h"
+#undef THREADED_VARIANT
+#define THREADED_VARIANT 47
+#include "chip8_threaded_loop.h"
+#undef THREADED_VARIANT
+#define THREADED_VARIANT 48
+#include "chip8_threaded_loop.h"
+#undef THREADED_VARIANT
+#define THREADED_VARIANT 49
+#include "chip8_threaded_loop.h"
+#undef THREADED_VARIANT
+#define THREADED_VARIANT 50
+#include "chip8_threaded_loop.h"
+#undef THREADED_VARIANT
+#define THREADED_VARIANT 51
+#include "chip8_threaded_loop.h"
+#undef THREADED_VARIANT
+#define THREADED_VARIANT 52
+#include "chip8_threaded_loop.h"
+#undef THREADED_VARIANT
+#define THREADED_VARIANT 53
+#include "chip8_threaded_loop.h"
+#undef THREADED_VARIANT
+#define THREADED_VARIANT 54
+#include "chip8_threaded_loop.h"
+#undef THREADED_VARIANT
+#define THREADED_VARIANT 55
+#include "chip8_threaded_loop.h"
+#undef THREADED_VARIANT
+#define THREADED_VARIANT 56
+#include "chip8_threaded_loop.h"
+#undef THREADED_VARIANT
+#define THREADED_VARIANT 57
+#include "chip8_threaded_loop.h"
+#undef THREADED_VARIANT
+#define THREADED_VARIANT 58
+#include "chip8_threaded_loop.h"
+#undef THREADED_VARIANT
+#define THREADED_VARIANT 59
+#include "chip8_threaded_loop.h"
+#undef THREADED_VARIANT
+#define THREADED_VARIANT 60
+#include "chip8_threaded_loop.h"
+#undef THREADED_VARIANT
+#define THREADED_VARIANT 61
+#include "chip8_threaded_loop.h"
+#undef THREADED_VARIANT
+#define THREADED_VARIANT 62
+#include "chip8_threaded_loop.h"
+#undef THREADED_VARIANT
+#define THREADED_VARIANT 63
+#include "chip8_threaded_loop.h"
+#undef THREADED_VARIANT
+
+static const THREADED_RUN_FN run_variants[THREADED_VARIANT_COUNT] = {
+	threaded_run_0, threaded_run_1, threaded_run_2, threaded_run_3,
+	threaded_run_4, threaded_run_5, threaded_run_6, threaded_run_7,
+	threaded_run_8, threaded_run_9, threaded_run_10, threaded_run_11,
+	threaded_run_12, threaded_run_13, threaded_run_14, threaded_run_15,
+	threaded_run_16, threaded_run_17, threaded_run_18, threaded_run_19,
+	threaded_run_20, threaded_run_21, threaded_run_22, threaded_run_23,
+	threaded_run_24, threaded_run_25, threaded_run_26, threaded_run_27,
+	threaded_run_28, threaded_run_29, threaded_run_30, threaded_run_31,
+	threaded_run_32, threaded_run_33, threaded_run_34, threaded_run_35,
+	threaded_run_36, threaded_run_37, threaded_run_38, threaded_run_39,
+	threaded_run_40, threaded_run_41, threaded_run_42, threaded_run_43,
+	threaded_run_44, threaded_run_45, threaded_run_46, threaded_run_47,
+	threaded_run_48, threaded_run_49, threaded_run_50, threaded_run_51,
+	threaded_run_52, threaded_run_53, threaded_run_54, threaded_run_55,
+	threaded_run_56, threaded_run_57, threaded_run_58, threaded_run_59,
+	threaded_run_60, threaded_run_61, threaded_run_62, threaded_run_63,
+};
+
+void chip8_threaded_set_quirks(CHIP8_THREADED* t, uint8_t quirks) {
+	int variant = 0;
+	if (quirks & CHIP8_QUIRK_ZERO_VF_REGISTER)
+		variant |= 1;
+	if (quirks & CHIP8_QUIRK_SHIFT_X_REGISTER)
+		variant |= 2;
+	if (quirks & CHIP8_QUIRK_INCREMENT_I_REGISTER)
+		variant |= 4;
+	if (quirks & CHIP8_QUIRK_JUMP_VX)
+		variant |= 8;
+	if (quirks & CHIP8_QUIRK_DISPLAY_CLIPPING)
+		variant |= 16;
+	if (quirks & CHIP8_QUIRK_DISPLAY_WAIT)
+		variant |= 32;
+
+	t->run = run_variants[variant];
+	t->dirty = 1; // ops hold labels of the previous variant
+}
+
+int chip8_threaded_run(CHIP8_MACHINE* machine, int budget) {
+	return machine->threaded->run(machine, budget);
+}
@@ -0,0 +1,43 @@
+/* chip8_threaded.h
+* Direct-threaded basic block engine with superinstructions.
+* GitHub: https:\\github.com\tommojphillips
+*/
+
+#ifndef CHIP8_THREADED_H
+#define CHIP8_THREADED_H
+
+#include <stdint.h>
+
+#include "chip8.h" // chip8 cpu core
+
+typedef struct CHIP8_MACHINE CHIP8_MACHINE;
+typedef struct CHIP8_THREADED CHIP8_THREADED;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Allocate the block cache. returns NULL on failure */
+CHIP8_THREADED* chip8_threaded_create();
+
+/* Free the block cache */
+void chip8_threaded_destroy(CHIP8_THREADED* threaded);
+
+/* Drop blocks overlapping RAM[addr .. addr + size) */
+void chip8_threaded_invalidate(CHIP8_THREADED* threaded, uint16_t addr, uint16_t size);
+
+/* Drop all blocks */
+void chip8_threaded_invalidate_all(CHIP8_THREADED* threaded);
+
+/* Select the run loop specialized for quirks. Drops all blocks */
+void chip8_threaded_set_quirks(CHIP8_THREADED* threaded, uint8_t quirks);
+
+/* Run up to budget instructions. Stops early on a display draw or if the
+   cpu leaves the run state. returns instructions executed */
+int chip8_threaded_run(CHIP8_MACHINE* machine, int budget);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif
@@ -0,0 +1,278 @@
+/* chip8_threaded_loop.h
+* Threaded engine run loop template. Included by chip8_threaded.c once per
+* quirk variant with THREADED_VARIANT defined; the quirk tests below fold
+* to constants so each variant is branch free.
+* GitHub: https:\\github.com\tommojphillips
+*/
+
+#ifndef THREADED_VARIANT
+#error "define THREADED_VARIANT before including chip8_threaded_loop.h"
+#endif
+
+#define THREADED_QUIRKS THREADED_VARIANT_QUIRKS(THREADED_VARIANT)
+
+static int THREADED_RUN_NAME(THREADED_VARIANT)(CHIP8_MACHINE* machine, int budget) {
+
+#ifdef THREADED_COMPUTED_GOTO
+	static const void* const labels[K_COUNT] = {
+#define X(k) &&L_##k,
+		THREADED_OPS(X)
+#undef X
+	};
+#endif
+
+	CHIP8_THREADED* t = machine->threaded;
+	CHIP8* cpu = &machine->cpu;
+	const THREADED_OP* op = NULL;
+	int count = 0;
+
+next_block:
+	if (t->dirty) {
+		flush(t);
+	}
+
+	if (count >= budget || cpu->draw_display != 0 || cpu->cpu_state != CHIP8_STATE_EXE) {
+		return count;
+	}
+
+	{
+		const uint16_t pc = cpu->pc & CHIP8_ADDR_MASK;
+		int first = t->block_map[pc];
+		if (first < 0) {
+			first = compile_block(machine, pc);
+#ifdef THREADED_COMPUTED_GOTO
+			for (int i = first; i < t->op_count; ++i) {
+				t->ops[i].label = labels[t->ops[i].kind];
+			}
+#endif
+		}
+
+		if (budget - count < t->block_cost[pc]) {
+			return count + chip8_decode_run(machine, budget - count);
+		}
+
+		op = &t->ops[first];
+	}
+
+#ifdef THREADED_COMPUTED_GOTO
+	DISPATCH();
+	{
+#else
+dispatch:
+	switch (op->kind) {
+#endif
+
+	/* straight line */
+
+	OP(6XNN):
+		V[op->x] = op->nn;
+		NEXT();
+	OP(7XNN):
+		V[op->x] += op->nn;
+		NEXT();
+	OP(8XY0):
+		V[op->x] = V[op->y];
+		NEXT();
+	OP(8XY1):
+		V[op->x] |= V[op->y];
+		if (THREADED_QUIRKS & CHIP8_QUIRK_ZERO_VF_REGISTER)
+			VF = 0;
+		NEXT();
+	OP(8XY2):
+		V[op->x] &= V[op->y];
+		if (THREADED_QUIRKS & CHIP8_QUIRK_ZERO_VF_REGISTER)
+			VF = 0;
+		NEXT();
+	OP(8XY3):
+		V[op->x] ^= V[op->y];
+		if (THREADED_QUIRKS & CHIP8_QUIRK_ZERO_VF_REGISTER)
+			VF = 0;
+		NEXT();
+	OP(8XY4): {
+		uint16_t r = V[op->x] + V[op->y];
+		V[op->x] = (uint8_t)r;
+		VF = (r > 0xFF);
+		NEXT();
+	}
+	OP(8XY5): {
+		uint8_t f = (V[op->x] >= V[op->y]);
+		V[op->x] = V[op->x] - V[op->y];
+		VF = f;
+		NEXT();
+	}
+	OP(8XY6): {
+		uint8_t s = (THREADED_QUIRKS & CHIP8_QUIRK_SHIFT_X_REGISTER) ? V[op->x] : V[op->y];
+		V[op->x] = s >> 1;
+		VF = s & 1;
+		NEXT();
+	}
+	OP(8XY7): {
+		uint8_t f = (V[op->y] >= V[op->x]);
+		V[op->x] = V[op->y] - V[op->x];
+		VF = f;
+		NEXT();
+	}
+	OP(8XYE): {
+		uint8_t s = (THREADED_QUIRKS & CHIP8_QUIRK_SHIFT_X_REGISTER) ? V[op->x] : V[op->y];
+		V[op->x] = s << 1;
+		VF = s >> 7;
+		NEXT();
+	}
+	OP(ANNN):
+		cpu->i = op->nnn;
+		NEXT();
+	OP(CXNN):
+		V[op->x] = chip8_machine_random(machine) & op->nn;
+		NEXT();
+	OP(FX07):
+		V[op->x] = cpu->delay_timer;
+		NEXT();
+	OP(FX15):
+		cpu->delay_timer = V[op->x];
+		NEXT();
+	OP(FX18):
+		cpu->sound_timer = V[op->x];
+		NEXT();
+	OP(FX1E):
+		cpu->i += V[op->x];
+		NEXT();
+	OP(FX65):
+		for (int i = 0; i <= op->x; ++i) {
+			V[i] = cpu->ram[(cpu->i + i) & CHIP8_ADDR_MASK];
+		}
+		if (THREADED_QUIRKS & CHIP8_QUIRK_INCREMENT_I_REGISTER)
+			cpu->i += op->x + 1;
+		NEXT();
+
+	/* block exits */
+
+	OP(1NNN):
+		cpu->pc = op->nnn;
+		count++;
+		EXIT_BLOCK();
+	OP(3XNN):
+		cpu->pc = op->pc + ((V[op->x] == op->nn) ? 4 : 2);
+		count++;
+		EXIT_BLOCK();
+	OP(4XNN):
+		cpu->pc = op->pc + ((V[op->x] != op->nn) ? 4 : 2);
+		count++;
+		EXIT_BLOCK();
+	OP(5XY0):
+		cpu->pc = op->pc + ((V[op->x] == V[op->y]) ? 4 : 2);
+		count++;
+		EXIT_BLOCK();
+	OP(9XY0):
+		cpu->pc = op->pc + ((V[op->x] != V[op->y]) ? 4 : 2);
+		count++;
+		EXIT_BLOCK();
+	OP(BNNN):
+		if (THREADED_QUIRKS & CHIP8_QUIRK_JUMP_VX)
+			cpu->pc = op->nnn + V[op->x];
+		else
+			cpu->pc = op->nnn + V[0];
+		count++;
+		EXIT_BLOCK();
+	OP(DXYN):
+		if (THREADED_QUIRKS & CHIP8_QUIRK_DISPLAY_CLIPPING)
+			chip8_display_draw_sprite_clip(cpu, V[op->x], V[op->y], op->nn & 0xF);
+		else
+			chip8_display_draw_sprite_wrap(cpu, V[op->x], V[op->y], op->nn & 0xF);
+		if (THREADED_QUIRKS & CHIP8_QUIRK_DISPLAY_WAIT)
+			cpu->draw_display = 1;
+		cpu->pc = op->pc + 2;
+		count++;
+		EXIT_BLOCK();
+	OP(FX33): {
+		const uint8_t vx = V[op->x];
+		cpu->ram[cpu->i & CHIP8_ADDR_MASK] = vx / 100;
+		cpu->ram[(cpu->i + 1) & CHIP8_ADDR_MASK] = (vx / 10) % 10;
+		cpu->ram[(cpu->i + 2) & CHIP8_ADDR_MASK] = vx % 10;
+		chip8_decode_invalidate(machine, cpu->i, 3);
+		cpu->pc = op->pc + 2;
+		count++;
+		EXIT_BLOCK();
+	}
+	OP(FX55):
+		for (int i = 0; i <= op->x; ++i) {
+			cpu->ram[(cpu->i + i) & CHIP8_ADDR_MASK] = V[i];
+		}
+		chip8_decode_invalidate(machine, cpu->i, op->x + 1);
+		if (THREADED_QUIRKS & CHIP8_QUIRK_INCREMENT_I_REGISTER)
+			cpu->i += op->x + 1;
+		cpu->pc = op->pc + 2;
+		count++;
+		EXIT_BLOCK();
+	OP(CORE):
+		cpu->pc = op->pc;
+		chip8_decode_step(machine);
+		count++;
+		EXIT_BLOCK();
+	OP(EXIT):
+		cpu->pc = op->pc;
+		EXIT_BLOCK();
+
+	/* superinstructions */
+
+	OP(3XNN_1NNN):
+		if (V[op->x] == op->nn) {
+			cpu->pc = op->pc + 4;
+			count++;
+		}
+		else {
+			cpu->pc = op->nnn;
+			count += 2;
+		}
+		EXIT_BLOCK();
+	OP(4XNN_1NNN):
+		if (V[op->x] != op->nn) {
+			cpu->pc = op->pc + 4;
+			count++;
+		}
+		else {
+			cpu->pc = op->nnn;
+			count += 2;
+		}
+		EXIT_BLOCK();
+	OP(5XY0_1NNN):
+		if (V[op->x] == V[op->y]) {
+			cpu->pc = op->pc + 4;
+			count++;
+		}
+		else {
+			cpu->pc = op->nnn;
+			count += 2;
+		}
+		EXIT_BLOCK();
+	OP(9XY0_1NNN):
+		if (V[op->x] != V[op->y]) {
+			cpu->pc = op->pc + 4;
+			count++;
+		}
+		else {
+			cpu->pc = op->nnn;
+			count += 2;
+		}
+		EXIT_BLOCK();
+	OP(ANNN_DXYN):
+		cpu->i = op->nnn;
+		if (THREADED_QUIRKS & CHIP8_QUIRK_DISPLAY_CLIPPING)
+			chip8_display_draw_sprite_clip(cpu, V[op->x], V[op->y], op->nn);
+		else
+			chip8_display_draw_sprite_wrap(cpu, V[op->x], V[op->y], op->nn);
+		if (THREADED_QUIRKS & CHIP8_QUIRK_DISPLAY_WAIT)
+			cpu->draw_display = 1;
+		cpu->pc = op->pc + 4;
+		count += 2;
+		EXIT_BLOCK();
+
+#ifndef THREADED_COMPUTED_GOTO
+	default:
+		EXIT_BLOCK();
+#endif
+	}
+
+	return count;
+}
+
+#undef THREADED_QUIRKS
@@ -4,25 +4,45 @@
 
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "SDL.h"
 #include "SDL_syswm.h"
 #include "SDL_image.h"
 
 #include "display.h"
+#include "display_expand.h"
+#include "chip8_display.h"
 #include "chip8_sdl2.h"
 #include "chip8.h" // chip8 cpu core
 
 SDL_STATE sdl = { 0 };
 WINDOW_STATS* window_stats = NULL;
 WINDOW_STATE* window_state = NULL;
+DISPLAY_LAYOUT display_layout = { 0 };
 
 void input_process_event();
 void imgui_process_event();
+int imgui_is_active();
+
+/* renders after the last event; lets the ui settle hover and focus state */
+#define DISPLAY_REPAINT_FRAMES 2
+
+/* XO-CHIP colors of plane combinations past on; 0 and 1 are the config off / on colors */
+static const uint32_t default_palette[CHIP8_FRAME_MAX_COLORS] = {
+	0xFF000000, 0xFFFFFFFF, 0xFFFF6600, 0xFF662200,
+	0xFF0066FF, 0xFF00CCCC, 0xFFCC00CC, 0xFF6666CC,
+	0xFF00CC33, 0xFF66FF66, 0xFFCCCC00, 0xFF996600,
+	0xFF3399FF, 0xFFFF99CC, 0xFF999999, 0xFF555555,
+};
 
 static void resize_display_keep_aspect_ratio();
 static void set_default_settings();
-static void draw_display_buffer();
+static void update_grid(DISPLAY_GRID* grid, int width, int height);
+static void get_palette(uint32_t palette[CHIP8_FRAME_MAX_COLORS]);
+static void draw_display_buffer(const CHIP8_FRAME* frame);
+static int draw_display_texture(const CHIP8_FRAME* frame, uint64_t generation);
+static void destroy_display_texture();
 static void display_process_event();
 
 void sdl_init() {
@@ -60,11 +80,17 @@ void sdl_create_window() {
 		exit(1);
 	}
 
-	sdl.game_renderer = SDL_CreateRenderer(sdl.game_window, -1, 0);
+	uint32_t renderer_flags = 0;
+	if (chip8_config.vsync) {
+		renderer_flags |= SDL_RENDERER_PRESENTVSYNC;
+	}
+
+	sdl.game_renderer = SDL_CreateRenderer(sdl.game_window, -1, renderer_flags);
 	if (sdl.game_renderer == NULL) {
 		printf("Failed to create game renderer\n");
 		exit(1);
 	}
+	window_state->vsync = chip8_config.vsync;
 
 	// Window icon
 	sdl.icon_surface = IMG_Load("icon.ico");
@@ -76,6 +102,8 @@ void sdl_create_window() {
 	}
 
 
+	sdl_update_layout();
+
 	window_state->window_open = 1;
 }
 void sdl_destroy() {
@@ -95,6 +123,8 @@ void sdl_destroy() {
 		sdl.icon_surface = NULL;
 	}
 
+	destroy_display_texture();
+
 	if (sdl.game_renderer != NULL) {
 		SDL_DestroyRenderer(sdl.game_renderer);
 		sdl.game_renderer = NULL;
@@ -110,6 +140,8 @@ void sdl_destroy() {
 void sdl_update() {
 	while (SDL_PollEvent(&sdl.e)) {
 
+		window_state->repaint_frames = DISPLAY_REPAINT_FRAMES;
+
 		display_process_event();
 		input_process_event();
 		imgui_process_event();
@@ -117,18 +149,85 @@ void sdl_update() {
 		switch (sdl.e.type) {
 
 			case SDL_DROPFILE:
-				load_program(sdl.e.drop.file);
+				chip8_post_load_program(sdl.e.drop.file);
+				SDL_free(sdl.e.drop.file);
 				break;
 		}
 	}
 }
+int sdl_needs_render() {
+	if (window_state->repaint_frames > 0)
+		return 1;
+	if (imgui_is_active())
+		return 1;
+	return chip8_framebuffer_pending(&machine->framebuffer);
+}
 void sdl_render() {
-	SDL_RenderPresent(sdl.game_renderer);
 	SDL_SetRenderDrawColor(sdl.game_renderer, chip8_config.off_color.r, chip8_config.off_color.g, chip8_config.off_color.b, 0xFF);
 	SDL_RenderClear(sdl.game_renderer);
-	draw_display_buffer();
+
+	/* newest frame the emulator published; no copy */
+	uint64_t generation = 0;
+	const CHIP8_FRAME* frame = chip8_framebuffer_acquire(&machine->framebuffer, &generation);
+	sdl.frame = frame;
+
+	window_stats->uploaded_rows = 0;
+	if (!chip8_config.texture_renderer || draw_display_texture(frame, generation) != 0) {
+		draw_display_buffer(frame);
+	}
 }
+void sdl_present() {
+	SDL_RenderPresent(sdl.game_renderer);
+	if (window_state->repaint_frames > 0) {
+		window_state->repaint_frames--;
+	}
+}
+
+void sdl_update_vsync() {
+	if (window_state->vsync == chip8_config.vsync)
+		return;
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+	if (SDL_RenderSetVSync(sdl.game_renderer, chip8_config.vsync) == 0) {
+		window_state->vsync = chip8_config.vsync;
+		return;
+	}
+#endif
+	/* the renderer can not change vsync; applies on restart */
+	chip8_config.vsync = window_state->vsync;
+	printf("Failed to change vsync\n");
+}
+
+void sdl_update_layout() {
+	update_grid(&display_layout.lores, CHIP8_FRAME_LORES_WIDTH, CHIP8_FRAME_LORES_HEIGHT);
+	update_grid(&display_layout.hires, CHIP8_FRAME_MAX_WIDTH, CHIP8_FRAME_MAX_HEIGHT);
+	display_layout.version++;
+}
+
+static void update_grid(DISPLAY_GRID* grid, int width, int height) {
 
+	/* the config pixel size and spacing are in lores pixels */
+	const int px = CFG_DISPLAY_W / width;
+	const int cell = px + CFG_PX_SPACE * CHIP8_FRAME_LORES_WIDTH / width;
+
+	grid->px = px;
+	grid->cell = cell;
+	grid->dst.w = width * cell;
+	grid->dst.h = height * cell;
+	grid->dst.x = ((CFG_WINDOW_W - grid->dst.w) >> 1) - CFG_DISPLAY_X;
+	grid->dst.y = ((CFG_WINDOW_H - grid->dst.h) >> 1) - CFG_DISPLAY_Y;
+
+	for (int x = 0; x < width; ++x) {
+		grid->col_x[x] = grid->dst.x + x * cell;
+	}
+	for (int y = 0; y < height; ++y) {
+		grid->row_y[y] = grid->dst.y + y * cell;
+	}
+}
+static void get_palette(uint32_t palette[CHIP8_FRAME_MAX_COLORS]) {
+	memcpy(palette, default_palette, sizeof(default_palette));
+	palette[0] = 0xFF000000 | (chip8_config.off_color.r << 16) | (chip8_config.off_color.g << 8) | chip8_config.off_color.b;
+	palette[1] = 0xFF000000 | (chip8_config.on_color.r << 16) | (chip8_config.on_color.g << 8) | chip8_config.on_color.b;
+}
 static void set_default_settings() {
 
 	window_state->win_x = SDL_WINDOWPOS_CENTERED;
@@ -152,6 +251,12 @@ static void display_process_event() {
 		window_state->window_open = 0;
 		break;
 
+	case SDL_RENDER_TARGETS_RESET:
+	case SDL_RENDER_DEVICE_RESET:
+		/* texture contents are lost; expand every row again */
+		destroy_display_texture();
+		break;
+
 	case SDL_WINDOWEVENT:
 		switch (sdl.e.window.event) {
 
@@ -190,27 +295,130 @@ static void resize_display_keep_aspect_ratio() {
 	/* maintain chip8 display window pos */
 	chip8_config.win_w = (int)(DISPLAY_WIDTH * ratio);
 	chip8_config.win_h = (int)(DISPLAY_HEIGHT * ratio);
+
+	sdl_update_layout();
 }
-static void draw_display_buffer() {
-	SDL_Rect px = { 0 };
-	for (int i = 0; i < CHIP8_NUM_PIXELS; ++i) {
-		px.x = PX_X(i);
-		px.y = PX_Y(i);
-		px.w = PX_H;
-		px.h = PX_W;
+static void draw_display_buffer(const CHIP8_FRAME* frame) {
+	/* the clear already painted the off color; only lit cells are drawn, one
+	   pass per color. A pixel is color c when its plane bits equal c */
+	static SDL_Rect lit[CHIP8_FRAME_MAX_WIDTH * CHIP8_FRAME_MAX_HEIGHT];
+	const DISPLAY_GRID* grid = DISPLAY_LAYOUT_GRID(frame);
+	uint32_t palette[CHIP8_FRAME_MAX_COLORS];
+	get_palette(palette);
+
+	for (int c = 1; c < (1 << frame->planes); ++c) {
+		int count = 0;
+		for (int y = 0; y < frame->height; ++y) {
+			for (int w = 0; w < CHIP8_FRAME_WORDS(frame); ++w) {
+				uint64_t row = ~(uint64_t)0;
+				for (int p = 0; p < frame->planes; ++p) {
+					const uint64_t bits = frame->rows[p][y][w];
+					row &= ((c >> p) & 1) ? bits : ~bits;
+				}
+				while (row != 0) {
+					const int x = chip8_display_row_first_px(row);
+					SDL_Rect* rect = &lit[count++];
+					rect->x = grid->col_x[w * 64 + x];
+					rect->y = grid->row_y[y];
+					rect->w = grid->px;
+					rect->h = grid->px;
+					row &= ~((uint64_t)1 << (63 - x));
+				}
+			}
+		}
 
-		if (CHIP8_DISPLAY_GET_PX(window_state->display_buffer, i)) {
+		if (count > 0) {
 			SDL_SetRenderDrawColor(sdl.game_renderer,
-				chip8_config.on_color.r, chip8_config.on_color.g,
-				chip8_config.on_color.b, 0xFF);
+				(palette[c] >> 16) & 0xFF, (palette[c] >> 8) & 0xFF,
+				palette[c] & 0xFF, 0xFF);
+			SDL_RenderFillRects(sdl.game_renderer, lit, count);
 		}
-		else {
-			SDL_SetRenderDrawColor(sdl.game_renderer,
-				chip8_config.off_color.r, chip8_config.off_color.g,
-				chip8_config.off_color.b, 0xFF);
+	}
+}
+static int draw_display_texture(const CHIP8_FRAME* frame, uint64_t generation) {
+
+	/* Without pixel spacing the texture is one texel a pixel and scaled by the
+	   renderer. With spacing it is pre-scaled so the gaps land on whole texels */
+	const DISPLAY_GRID* grid = DISPLAY_LAYOUT_GRID(frame);
+	const int spaced = grid->cell != grid->px;
+	const int px = spaced ? grid->px : 1;
+	const int cell = spaced ? grid->cell : 1;
+	const int w = frame->width * cell;
+	const int h = frame->height * cell;
+
+	if (grid->px <= 0) {
+		return 1;
+	}
+
+	DISPLAY_EXPAND_PARAMS params;
+	get_palette(params.palette);
+	params.scale = px;
+	params.spacing = cell - px;
+
+	const uint32_t on = params.palette[1];
+	const uint32_t off = params.palette[0];
+
+	uint64_t rows = CHIP8_FRAMEBUFFER_ALL_ROWS;
+
+	/* the size follows the frame and the layout; the texels follow the layout */
+	if (sdl.display_texture == NULL || sdl.display_texture_w != w || sdl.display_texture_h != h) {
+		destroy_display_texture();
+		sdl.display_texture = SDL_CreateTexture(sdl.game_renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, w, h);
+		if (sdl.display_texture == NULL) {
+			printf("Failed to create display texture; using rects\n");
+			chip8_config.texture_renderer = 0;
+			return 1;
+		}
+		sdl.display_texture_w = w;
+		sdl.display_texture_h = h;
+#if SDL_VERSION_ATLEAST(2, 0, 12)
+		SDL_SetTextureScaleMode(sdl.display_texture, SDL_ScaleModeNearest);
+#endif
+	}
+	else if (sdl.display_texture_layout == display_layout.version &&
+		sdl.display_texture_on == on && sdl.display_texture_off == off) {
+		/* only the rows that changed since the frame in the texture */
+		rows = chip8_framebuffer_changed_rows(&machine->framebuffer, sdl.display_texture_generation);
+	}
+
+	/* lock each run of changed rows; locked texels are write only, so a run
+	   is expanded in full */
+	int y = 0;
+	while (y < frame->height) {
+
+		if (((rows >> y) & 1) == 0) {
+			y++;
+			continue;
 		}
 
-		SDL_RenderFillRect(sdl.game_renderer, &px);
+		const int start = y;
+		while (y < frame->height && ((rows >> y) & 1)) {
+			y++;
+		}
+
+		const SDL_Rect run = { 0, start * cell, w, (y - start) * cell };
+		void* pixels = NULL;
+		int pitch = 0;
+		if (SDL_LockTexture(sdl.display_texture, &run, &pixels, &pitch) != 0) {
+			return 1;
+		}
+		display_expand(frame, (uint32_t*)pixels, pitch, w, run.h, 0, -run.y, &params);
+		SDL_UnlockTexture(sdl.display_texture);
+
+		window_stats->uploaded_rows += y - start;
 	}
-}
 
+	sdl.display_texture_layout = display_layout.version;
+	sdl.display_texture_generation = generation;
+	sdl.display_texture_on = on;
+	sdl.display_texture_off = off;
+
+	SDL_RenderCopy(sdl.game_renderer, sdl.display_texture, NULL, &grid->dst);
+	return 0;
+}
+static void destroy_display_texture() {
+	if (sdl.display_texture != NULL) {
+		SDL_DestroyTexture(sdl.display_texture);
+		sdl.display_texture = NULL;
+	}
+}
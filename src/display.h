@@ -9,15 +9,45 @@
 
 #include "SDL.h"
 #include "chip8.h"
+#include "chip8_display.h"
 
 /* SDL state */
 typedef struct {
 	SDL_Window* game_window;
 	SDL_Renderer* game_renderer;
 	SDL_Surface* icon_surface;
+	SDL_Texture* display_texture; // streaming texture the display is expanded into
+	int display_texture_w;
+	int display_texture_h;
+	uint32_t display_texture_layout; // layout version the texture was sized for
+	uint64_t display_texture_generation; // framebuffer generation in the texture
+	uint32_t display_texture_on; // colors the texture was expanded with
+	uint32_t display_texture_off;
+	const CHIP8_FRAME* frame; // frame drawn by the last sdl_render()
 	SDL_Event e;
 } SDL_STATE;
 
+/* Pixel grid of one frame size in window pixels */
+typedef struct {
+	SDL_Rect dst; // the whole display
+	int px; // pixel size
+	int cell; // pixel size + spacing
+	int col_x[CHIP8_FRAME_MAX_WIDTH]; // window x of each pixel column
+	int row_y[CHIP8_FRAME_MAX_HEIGHT]; // window y of each pixel row
+} DISPLAY_GRID;
+
+/* Display geometry in window pixels. Rebuilt by sdl_update_layout() when the
+   window size, scale, spacing or offset change; drawing only reads it.
+   Lores and hires frames fill the same area */
+typedef struct {
+	uint32_t version; // bumped on every rebuild
+	DISPLAY_GRID lores; // 64x32
+	DISPLAY_GRID hires; // 128x64
+} DISPLAY_LAYOUT;
+
+/* Grid of a frame */
+#define DISPLAY_LAYOUT_GRID(frame) ((frame)->width > CHIP8_FRAME_LORES_WIDTH ? &display_layout.hires : &display_layout.lores)
+
 /* Window state */
 typedef struct {
 	int window_open;
@@ -30,7 +60,8 @@ typedef struct {
 	int last_win_h;
 	int last_win_w;
 	int last_window_state;
-	uint8_t display_buffer[CHIP8_NUM_PIXELS];
+	int vsync; // vsync state of the renderer
+	int repaint_frames; // renders owed to recent events
 } WINDOW_STATE;
 
 /* Window stats */
@@ -39,15 +70,13 @@ typedef struct {
 	double render_fps;
 
 	double render_elapsed_time;
-	double cpu_elapsed_time;
-	double timer_elapsed_time;
 
 	uint64_t start_frame_time;
 	uint64_t end_frame_time;
 	uint64_t frame_ticks;	
 
-	int instructions_per_frame;
-	int single_step_instruction_count;
+	uint64_t skipped_renders; // render ticks with nothing to redraw
+	int uploaded_rows; // display rows expanded into the texture by the last render
 } WINDOW_STATS;
 
 #ifdef __cplusplus
@@ -57,6 +86,7 @@ extern "C" {
 extern SDL_STATE sdl;
 extern WINDOW_STATS* window_stats;
 extern WINDOW_STATE* window_state;
+extern DISPLAY_LAYOUT display_layout;
 
 /* SDL2 Init */
 void sdl_init();
@@ -70,9 +100,21 @@ void sdl_destroy();
 /* SDL2 Update */
 void sdl_update();
 
-/* SDL2 Render */
+/* returns 1 if the window has to be redrawn; a new frame, an event or an open ui window */
+int sdl_needs_render();
+
+/* SDL2 Render. Clears and draws the display. The UI is drawn on top, then sdl_present() */
 void sdl_render();
 
+/* Present the rendered frame */
+void sdl_present();
+
+/* Rebuild the display layout from the window size and chip8_config */
+void sdl_update_layout();
+
+/* Apply chip8_config.vsync to the renderer */
+void sdl_update_vsync();
+
 #ifdef __cplusplus
 };
 #endif
@@ -0,0 +1,58 @@
+/* display_expand.h
+* Expands a chip8 frame into an ARGB8888 surface at an integer scale.
+* SSE2 / AVX2 kernels with a scalar fallback. No SDL dependencies.
+* GitHub: https:\\github.com\tommojphillips
+*/
+
+#ifndef DISPLAY_EXPAND_H
+#define DISPLAY_EXPAND_H
+
+#include <stdint.h>
+
+#include "chip8.h" // chip8 cpu core
+#include "chip8_display.h"
+
+/* Expansion parameters */
+typedef struct {
+	uint32_t palette[CHIP8_FRAME_MAX_COLORS]; // ARGB8888 by pixel plane bits. palette[0] is off and the pixel spacing color
+	int scale; // texels per chip8 pixel, >= 1
+	int spacing; // off texels after each chip8 pixel, >= 0
+} DISPLAY_EXPAND_PARAMS;
+
+/* Expanded frame size in texels */
+#define DISPLAY_EXPAND_WIDTH(frame, params) ((frame)->width * ((params)->scale + (params)->spacing))
+#define DISPLAY_EXPAND_HEIGHT(frame, params) ((frame)->height * ((params)->scale + (params)->spacing))
+
+/* Expansion kernel */
+typedef enum {
+	DISPLAY_EXPAND_SCALAR = 0,
+	DISPLAY_EXPAND_SSE2 = 1,
+	DISPLAY_EXPAND_AVX2 = 2,
+	DISPLAY_EXPAND_KERNEL_COUNT
+} DISPLAY_EXPAND_KERNEL;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Fastest kernel this cpu supports */
+DISPLAY_EXPAND_KERNEL display_expand_best_kernel();
+
+/* returns 1 if this cpu can run the kernel */
+int display_expand_kernel_supported(DISPLAY_EXPAND_KERNEL kernel);
+
+/* Kernel display name */
+const char* display_expand_kernel_name(DISPLAY_EXPAND_KERNEL kernel);
+
+/* Expand frame into a dst_w x dst_h surface of pitch bytes with its top left
+   texel at x, y. Texels outside the surface are clipped. Uses the best kernel */
+void display_expand(const CHIP8_FRAME* frame, uint32_t* dst, int pitch, int dst_w, int dst_h, int x, int y, const DISPLAY_EXPAND_PARAMS* params);
+
+/* display_expand() with a given kernel. An unsupported kernel runs scalar */
+void display_expand_with(DISPLAY_EXPAND_KERNEL kernel, const CHIP8_FRAME* frame, uint32_t* dst, int pitch, int dst_w, int dst_h, int x, int y, const DISPLAY_EXPAND_PARAMS* params);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif
@@ -0,0 +1,160 @@
+/* display_expand_bench.c
+* Microbenchmark for the display expansion kernels. Expands a random 64x32 frame
+* at 1x to 32x with every kernel the cpu supports and checks them against scalar.
+* GitHub: https:\\github.com\tommojphillips
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include "chip8.h" // chip8 cpu core
+#include "display_expand.h"
+
+#define BENCH_MIN_SCALE 1
+#define BENCH_MAX_SCALE 32
+#define BENCH_DEFAULT_SECONDS 0.1 // per kernel per scale
+
+static int parse_command_line(int argc, char* argv[], int* spacing, double* seconds);
+static double bench_kernel(DISPLAY_EXPAND_KERNEL kernel, const CHIP8_FRAME* frame, uint32_t* surface, int w, int h, const DISPLAY_EXPAND_PARAMS* params, double seconds);
+static void print_usage(const char* exe);
+static double get_time_seconds();
+
+int main(int argc, char* argv[]) {
+
+	int spacing = 0;
+	double seconds = BENCH_DEFAULT_SECONDS;
+	if (parse_command_line(argc, argv, &spacing, &seconds) != 0) {
+		print_usage(argv[0]);
+		return 1;
+	}
+
+	static CHIP8_FRAME frame = { 0 };
+	frame.width = CHIP8_FRAME_LORES_WIDTH;
+	frame.height = CHIP8_FRAME_LORES_HEIGHT;
+	frame.planes = 1;
+	srand(1);
+	for (int y = 0; y < frame.height; ++y) {
+		for (int i = 0; i < 8; ++i) {
+			frame.rows[0][y][0] = (frame.rows[0][y][0] << 8) | (uint64_t)(rand() % 256);
+		}
+	}
+
+	printf("best kernel: %s, pixel spacing: %d\n", display_expand_kernel_name(display_expand_best_kernel()), spacing);
+	printf("%5s %11s", "scale", "texels");
+	for (int k = 0; k < DISPLAY_EXPAND_KERNEL_COUNT; ++k) {
+		if (display_expand_kernel_supported((DISPLAY_EXPAND_KERNEL)k)) {
+			printf(" %10s us %7s", display_expand_kernel_name((DISPLAY_EXPAND_KERNEL)k), "Gtx/s");
+		}
+	}
+	printf("\n");
+
+	int result = 0;
+	for (int scale = BENCH_MIN_SCALE; scale <= BENCH_MAX_SCALE; ++scale) {
+
+		DISPLAY_EXPAND_PARAMS params = { 0 };
+		params.palette[0] = 0xFF000000;
+		params.palette[1] = 0xFF64FF69;
+		params.scale = scale;
+		params.spacing = spacing;
+
+		const int w = DISPLAY_EXPAND_WIDTH(&frame, &params);
+		const int h = DISPLAY_EXPAND_HEIGHT(&frame, &params);
+		const size_t size = (size_t)w * h * sizeof(uint32_t);
+
+		uint32_t* reference = (uint32_t*)malloc(size);
+		uint32_t* surface = (uint32_t*)malloc(size);
+		if (reference == NULL || surface == NULL) {
+			printf("Failed to allocate %dx%d surface\n", w, h);
+			exit(1);
+		}
+
+		display_expand_with(DISPLAY_EXPAND_SCALAR, &frame, reference, w * sizeof(uint32_t), w, h, 0, 0, &params);
+
+		printf("%4dx %5dx%-5d", scale, w, h);
+		for (int k = 0; k < DISPLAY_EXPAND_KERNEL_COUNT; ++k) {
+
+			const DISPLAY_EXPAND_KERNEL kernel = (DISPLAY_EXPAND_KERNEL)k;
+			if (!display_expand_kernel_supported(kernel))
+				continue;
+
+			memset(surface, 0, size);
+			const double us = bench_kernel(kernel, &frame, surface, w, h, &params, seconds);
+			printf(" %13.2f %7.2f", us, (double)w * h / us / 1000.0);
+
+			if (memcmp(surface, reference, size) != 0) {
+				printf(" (%s differs from scalar)", display_expand_kernel_name(kernel));
+				result = 2;
+			}
+		}
+		printf("\n");
+
+		free(surface);
+		free(reference);
+	}
+
+	return result;
+}
+
+static double bench_kernel(DISPLAY_EXPAND_KERNEL kernel, const CHIP8_FRAME* frame, uint32_t* surface, int w, int h, const DISPLAY_EXPAND_PARAMS* params, double seconds) {
+
+	/* returns microseconds per expansion */
+	uint64_t count = 0;
+	const double start = get_time_seconds();
+	double elapsed = 0.0;
+	do {
+		for (int i = 0; i < 16; ++i) {
+			display_expand_with(kernel, frame, surface, w * sizeof(uint32_t), w, h, 0, 0, params);
+		}
+		count += 16;
+		elapsed = get_time_seconds() - start;
+	} while (elapsed < seconds);
+
+	return elapsed * 1e6 / count;
+}
+
+static int parse_command_line(int argc, char* argv[], int* spacing, double* seconds) {
+	for (int i = 1; i < argc; ++i) {
+		const char* arg = argv[i];
+
+		if ((strcmp(arg, "-s") == 0 || strcmp(arg, "--spacing") == 0) && i + 1 < argc) {
+			*spacing = atoi(argv[++i]);
+			if (*spacing < 0)
+				return 1;
+		}
+		else if ((strcmp(arg, "-t") == 0 || strcmp(arg, "--time") == 0) && i + 1 < argc) {
+			*seconds = atof(argv[++i]);
+			if (*seconds <= 0.0)
+				return 1;
+		}
+		else {
+			return 1;
+		}
+	}
+	return 0;
+}
+static void print_usage(const char* exe) {
+	printf("usage: %s [options]\n", exe);
+	printf("  -s, --spacing <n>   pixel spacing in texels (default 0)\n");
+	printf("  -t, --time <s>      seconds per kernel per scale (default %.1f)\n", BENCH_DEFAULT_SECONDS);
+}
+
+static double get_time_seconds() {
+#ifdef _WIN32
+	LARGE_INTEGER counter;
+	LARGE_INTEGER frequency;
+	QueryPerformanceCounter(&counter);
+	QueryPerformanceFrequency(&frequency);
+	return counter.QuadPart / (double)frequency.QuadPart;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+#endif
+}
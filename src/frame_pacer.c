@@ -0,0 +1,93 @@
+/* frame_pacer.c
+* Sleeps the emulation thread until its next deadline.
+
+* SDL_Delay() only has millisecond resolution and the OS may oversleep, so
+* the pacer sleeps until a short spin window before the deadline and busy
+* waits the rest. The spin window tracks how late SDL_Delay() has been
+* waking up, so it stays small on hosts with a fine grained scheduler.
+
+* GitHub: https:\\github.com\tommojphillips
+*/
+
+#include <stdint.h>
+
+#include "SDL.h"
+
+#include "frame_pacer.h"
+
+#define PACER_MIN_SPIN_MS 0.2
+#define PACER_MAX_SPIN_MS 4.0
+#define PACER_AVERAGE_WEIGHT 0.05
+
+static uint64_t frequency = 1;
+static double oversleep_avg = 1.0; // ms SDL_Delay() wakes up late, moving average
+static FRAME_PACER_STATS stats = { 0 };
+
+static double ticks_to_ms(uint64_t ticks);
+static uint64_t ms_to_ticks(double ms);
+
+void frame_pacer_init() {
+	frequency = SDL_GetPerformanceFrequency();
+	oversleep_avg = 1.0;
+	frame_pacer_reset_stats();
+}
+
+void frame_pacer_wait_until(uint64_t deadline, int precise) {
+
+	const uint64_t start = SDL_GetPerformanceCounter();
+	uint64_t now = start;
+
+	double spin_ms = oversleep_avg * 2.0 + PACER_MIN_SPIN_MS;
+	if (spin_ms > PACER_MAX_SPIN_MS)
+		spin_ms = PACER_MAX_SPIN_MS;
+
+	const uint64_t spin_ticks = precise ? ms_to_ticks(spin_ms) : 0;
+
+	/* coarse sleep */
+	if (deadline > now + spin_ticks) {
+		const uint32_t sleep_ms = (uint32_t)ticks_to_ms(deadline - now - spin_ticks);
+		if (sleep_ms > 0) {
+			const uint64_t wake = now + ms_to_ticks(sleep_ms);
+			SDL_Delay(sleep_ms);
+			now = SDL_GetPerformanceCounter();
+
+			const double late = (now > wake) ? ticks_to_ms(now - wake) : 0.0;
+			oversleep_avg += (late - oversleep_avg) * PACER_AVERAGE_WEIGHT;
+		}
+	}
+
+	/* spin tail */
+	if (precise) {
+		while (now < deadline) {
+			now = SDL_GetPerformanceCounter();
+		}
+	}
+
+	/* stats; a wait without the spin is not meant to be on time */
+	if (!precise)
+		return;
+	const double jitter = (now > deadline) ? ticks_to_ms(now - deadline) : 0.0;
+	stats.jitter = jitter;
+	stats.jitter_avg += (jitter - stats.jitter_avg) * PACER_AVERAGE_WEIGHT;
+	if (jitter > stats.jitter_max)
+		stats.jitter_max = jitter;
+	stats.spin = precise ? spin_ms : 0.0;
+	stats.wait = ticks_to_ms(now - start);
+}
+
+void frame_pacer_reset_stats() {
+	stats.jitter = 0.0;
+	stats.jitter_avg = 0.0;
+	stats.jitter_max = 0.0;
+}
+
+void frame_pacer_get_stats(FRAME_PACER_STATS* out) {
+	*out = stats;
+}
+
+static double ticks_to_ms(uint64_t ticks) {
+	return ticks * 1000.0 / frequency;
+}
+static uint64_t ms_to_ticks(double ms) {
+	return (uint64_t)(ms * frequency / 1000.0);
+}
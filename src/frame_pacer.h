@@ -0,0 +1,40 @@
+/* frame_pacer.h
+* Sleeps the emulation thread until its next deadline.
+* GitHub: https:\\github.com\tommojphillips
+*/
+
+#ifndef FRAME_PACER_H
+#define FRAME_PACER_H
+
+#include <stdint.h>
+
+typedef struct {
+	double jitter; // ms the last wake up missed its deadline by
+	double jitter_avg;
+	double jitter_max;
+	double spin; // ms spun before the last deadline
+	double wait; // ms the last wait took
+} FRAME_PACER_STATS;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Init the pacer. Call after SDL_Init() */
+void frame_pacer_init();
+
+/* Wait until the performance counter reaches deadline. Sleeps most of the
+   wait then spins the tail. precise = 0 skips the spin (nothing is running) */
+void frame_pacer_wait_until(uint64_t deadline, int precise);
+
+/* Reset the worst case jitter. Call on the thread that waits */
+void frame_pacer_reset_stats();
+
+/* Copy the stats. Call on the thread that waits */
+void frame_pacer_get_stats(FRAME_PACER_STATS* out);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif
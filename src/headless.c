@@ -0,0 +1,550 @@
+/* headless.c
+* Headless batch runner. Drives the chip8 core without SDL or IMGUI.
+* GitHub: https:\\github.com\tommojphillips
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include "chip8.h" // chip8 cpu core
+#include "chip8_machine.h"
+#include "chip8_scheduler.h"
+#include "chip8_movie.h"
+
+#define HEADLESS_DEFAULT_CPU_TARGET 540
+#define HEADLESS_DEFAULT_FRAMES 600
+#define HEADLESS_FRAMES_PER_SLICE 60
+#define HEADLESS_DEFAULT_QUIRKS (CHIP8_QUIRK_CLS_ON_RESET | CHIP8_QUIRK_ZERO_VF_REGISTER | CHIP8_QUIRK_DISPLAY_CLIPPING | CHIP8_QUIRK_DISPLAY_WAIT)
+
+/* Headless run configuration */
+typedef struct {
+	const char** rom_filenames;
+	int rom_count;
+	uint64_t cycle_budget; // 0 = use frame budget
+	uint64_t frame_budget;
+	int cpu_target; // instructions per emulated second
+	int quirks;
+	int thread_count; // 0 = one per cpu
+	CHIP8_ENGINE engine;
+	CHIP8_PLATFORM platform;
+	int lockstep; // run a core engine machine alongside and compare every frame
+	int idle_skip;
+	uint64_t seed; // CXNN generator seed
+	const char* movie_filename; // replay a movie instead of running roms
+} HEADLESS_CONFIG;
+
+/* Per machine run results */
+typedef struct {
+	const char* rom_filename;
+	double elapsed_seconds;
+	CHIP8_MACHINE* reference; // lockstep only
+	const char* mismatch; // first field that differed, NULL if none
+	uint64_t mismatch_frame;
+	CHIP8_MOVIE* movie; // movie replay only
+	CHIP8_MOVIE* reference_movie; // movie replay with lockstep only
+} HEADLESS_JOB;
+
+static int parse_command_line(int argc, char* argv[], HEADLESS_CONFIG* config);
+static int parse_quirks(const char* str, int* quirks);
+static int parse_engine(const char* str, CHIP8_ENGINE* engine);
+static int parse_platform(const char* str, CHIP8_PLATFORM* platform);
+static int run_slice(CHIP8_MACHINE* machine, void* user_data);
+static int run_frame(const HEADLESS_CONFIG* config, CHIP8_MACHINE* machine);
+static int setup_movie(const HEADLESS_CONFIG* config, CHIP8_MACHINE* machine, CHIP8_MOVIE** movie);
+static void print_report(const HEADLESS_CONFIG* config, const CHIP8_MACHINE* machine);
+static void print_usage(const char* exe);
+static double get_time_seconds();
+
+int main(int argc, char* argv[]) {
+
+	HEADLESS_CONFIG config = { 0 };
+	config.frame_budget = HEADLESS_DEFAULT_FRAMES;
+	config.cpu_target = HEADLESS_DEFAULT_CPU_TARGET;
+	config.quirks = HEADLESS_DEFAULT_QUIRKS;
+	config.engine = CHIP8_ENGINE_CACHED;
+	config.platform = CHIP8_PLATFORM_CHIP8;
+
+	config.rom_filenames = (const char**)calloc(argc, sizeof(const char*));
+	if (config.rom_filenames == NULL) {
+		printf("Failed to allocate rom list\n");
+		return 1;
+	}
+
+	if (parse_command_line(argc, argv, &config) != 0) {
+		print_usage(argv[0]);
+		return 1;
+	}
+
+	if (config.movie_filename != NULL) {
+		/* one job; the movie has the program and the settings */
+		config.rom_filenames[0] = config.movie_filename;
+		config.rom_count = 1;
+	}
+
+	CHIP8_MACHINE** machines = (CHIP8_MACHINE**)calloc(config.rom_count, sizeof(CHIP8_MACHINE*));
+	HEADLESS_JOB* jobs = (HEADLESS_JOB*)calloc(config.rom_count, sizeof(HEADLESS_JOB));
+	if (machines == NULL || jobs == NULL) {
+		printf("Failed to allocate machines\n");
+		return 1;
+	}
+
+	int result = 0;
+	for (int i = 0; i < config.rom_count; ++i) {
+		machines[i] = chip8_machine_create();
+		if (machines[i] == NULL) {
+			printf("Failed to allocate chip8 machine.\n");
+			return 1;
+		}
+
+		jobs[i].rom_filename = config.rom_filenames[i];
+		machines[i]->user_data = &jobs[i];
+		machines[i]->cpu_target = config.cpu_target;
+		chip8_machine_set_engine(machines[i], config.engine);
+		chip8_machine_set_quirks(machines[i], config.quirks);
+		chip8_machine_set_platform(machines[i], config.platform);
+		chip8_machine_seed_random(machines[i], config.seed);
+		machines[i]->idle_skip = config.idle_skip;
+
+		if (config.movie_filename != NULL) {
+			if (setup_movie(&config, machines[i], &jobs[i].movie) != 0) {
+				return 1;
+			}
+			/* run to where the recording stopped */
+			config.frame_budget = jobs[i].movie->end.frame_count + 1;
+			config.cycle_budget = 0;
+		}
+		else if (chip8_machine_load_program(machines[i], config.rom_filenames[i]) != 0) {
+			result = 1;
+		}
+
+		if (config.lockstep) {
+			CHIP8_MACHINE* reference = chip8_machine_create();
+			if (reference == NULL) {
+				printf("Failed to allocate chip8 machine.\n");
+				return 1;
+			}
+			reference->cpu_target = config.cpu_target;
+			chip8_machine_set_engine(reference, CHIP8_ENGINE_CORE);
+			chip8_machine_set_quirks(reference, config.quirks);
+			chip8_machine_set_platform(reference, config.platform);
+			chip8_machine_seed_random(reference, config.seed);
+			if (config.movie_filename != NULL) {
+				if (setup_movie(&config, reference, &jobs[i].reference_movie) != 0) {
+					return 1;
+				}
+			}
+			else {
+				chip8_machine_load_program(reference, config.rom_filenames[i]);
+			}
+			jobs[i].reference = reference;
+		}
+	}
+
+	const double start = get_time_seconds();
+	chip8_scheduler_run(machines, config.rom_count, config.thread_count, run_slice, &config);
+	const double elapsed = get_time_seconds() - start;
+
+	uint64_t total_instructions = 0;
+	for (int i = 0; i < config.rom_count; ++i) {
+		print_report(&config, machines[i]);
+		total_instructions += machines[i]->instruction_count;
+
+		if (machines[i]->cpu.cpu_state == CHIP8_STATE_ERROR_OPCODE) {
+			result = 2;
+		}
+		if (jobs[i].mismatch != NULL) {
+			result = 3;
+		}
+		if (jobs[i].movie != NULL && (jobs[i].movie->mode != CHIP8_MOVIE_FINISHED || jobs[i].movie->mismatch != NULL)) {
+			result = 3;
+		}
+		chip8_machine_destroy(jobs[i].reference);
+		chip8_machine_destroy(machines[i]);
+		chip8_movie_destroy(jobs[i].reference_movie);
+		chip8_movie_destroy(jobs[i].movie);
+	}
+
+	if (config.rom_count > 1) {
+		printf("\ntotal:        %d roms, %llu instructions, %.6f s, %.0f instr/sec\n",
+			config.rom_count, (unsigned long long)total_instructions, elapsed,
+			elapsed > 0.0 ? total_instructions / elapsed : 0.0);
+	}
+
+	free(machines);
+	free(jobs);
+	free(config.rom_filenames);
+	return result;
+}
+
+static int run_slice(CHIP8_MACHINE* machine, void* user_data) {
+
+	/* Emulated time is kept in frames; each frame runs cpu_target / 60
+	   instructions and steps the timers once, exactly as they would at full
+	   speed in the windowed frontend. The host is never waited on. */
+
+	const HEADLESS_CONFIG* config = (const HEADLESS_CONFIG*)user_data;
+	HEADLESS_JOB* job = (HEADLESS_JOB*)machine->user_data;
+
+	const double start = get_time_seconds();
+
+	for (int i = 0; i < HEADLESS_FRAMES_PER_SLICE; ++i) {
+
+		if (job->movie != NULL) {
+			/* the recording may go on past a halt; its frames still count */
+			if (job->movie->mode == CHIP8_MOVIE_FINISHED)
+				break;
+		}
+		else if (machine->cpu.cpu_state != CHIP8_STATE_EXE) {
+			break;
+		}
+
+		if (config->cycle_budget != 0) {
+			if (machine->instruction_count >= config->cycle_budget)
+				break;
+		}
+		else if (machine->frame_count >= config->frame_budget) {
+			break;
+		}
+
+		if (run_frame(config, machine) != 0)
+			break;
+	}
+
+	job->elapsed_seconds += get_time_seconds() - start;
+
+	if (job->mismatch != NULL)
+		return 0;
+
+	if (job->movie != NULL) {
+		if (job->movie->mode == CHIP8_MOVIE_FINISHED)
+			return 0;
+	}
+	else if (machine->cpu.cpu_state != CHIP8_STATE_EXE) {
+		return 0;
+	}
+	if (config->cycle_budget != 0)
+		return machine->instruction_count < config->cycle_budget;
+	return machine->frame_count < config->frame_budget;
+}
+
+static int run_frame(const HEADLESS_CONFIG* config, CHIP8_MACHINE* machine) {
+
+	/* the last frame of a cycle budget only runs what is left of it */
+	uint64_t limit = UINT64_MAX;
+	if (config->cycle_budget != 0) {
+		limit = config->cycle_budget - machine->instruction_count;
+	}
+
+	if (!config->lockstep) {
+		chip8_machine_run_frame_limit(machine, limit);
+		return 0;
+	}
+
+	/* both machines were seeded alike; their generators stay in step */
+	HEADLESS_JOB* job = (HEADLESS_JOB*)machine->user_data;
+	chip8_machine_run_frame_limit(job->reference, limit);
+	chip8_machine_run_frame_limit(machine, limit);
+
+	job->mismatch = chip8_machine_compare(job->reference, machine);
+	if (job->mismatch != NULL) {
+		job->mismatch_frame = machine->frame_count;
+		return 1;
+	}
+	return 0;
+}
+
+static int setup_movie(const HEADLESS_CONFIG* config, CHIP8_MACHINE* machine, CHIP8_MOVIE** movie) {
+
+	/* the start state has the program, quirks, platform and clock */
+	*movie = chip8_movie_create();
+	if (*movie == NULL) {
+		printf("Failed to allocate movie\n");
+		return 1;
+	}
+	if (chip8_movie_read_file(*movie, config->movie_filename) != 0) {
+		printf("Error: could not read movie: %s\n", config->movie_filename);
+		return 1;
+	}
+	if (chip8_movie_play(*movie, machine) != 0) {
+		printf("Error: movie does not start from a valid state: %s\n", config->movie_filename);
+		return 1;
+	}
+	/* a recording may start paused */
+	if (machine->cpu.cpu_state == CHIP8_STATE_HLT) {
+		machine->cpu.cpu_state = CHIP8_STATE_EXE;
+	}
+	return 0;
+}
+
+static void print_report(const HEADLESS_CONFIG* config, const CHIP8_MACHINE* machine) {
+
+	const CHIP8* chip8 = &machine->cpu;
+	const HEADLESS_JOB* job = (const HEADLESS_JOB*)machine->user_data;
+
+	double ips = 0.0;
+	if (job->elapsed_seconds > 0.0) {
+		ips = machine->instruction_count / job->elapsed_seconds;
+	}
+
+	printf("%-14s%s\n", (job->movie != NULL) ? "movie:" : "rom:", job->rom_filename);
+	printf("quirks:       0x%02x\n", chip8->quirks);
+	printf("engine:       %s\n", chip8_machine_engine_name(machine->engine));
+	printf("platform:     %s\n", chip8_machine_platform_name(machine->platform));
+	printf("instructions: %llu\n", (unsigned long long)machine->instruction_count);
+	printf("frames:       %llu\n", (unsigned long long)machine->frame_count);
+	printf("elapsed:      %.6f s\n", job->elapsed_seconds);
+	printf("instr/sec:    %.0f\n", ips);
+	printf("display hash: %08x\n", chip8_machine_display_hash(machine));
+	if (machine->idle_skip) {
+		printf("idle skips:   %llu (%llu instructions)\n", (unsigned long long)machine->idle_skips, (unsigned long long)machine->idle_instructions);
+	}
+
+	if (job->movie != NULL) {
+		if (job->movie->mode != CHIP8_MOVIE_FINISHED) {
+			printf("replay:       stopped before the end of the recording (%llu / %llu instructions)\n",
+				(unsigned long long)machine->instruction_count, (unsigned long long)job->movie->end.instruction_count);
+		}
+		else if (job->movie->mismatch != NULL) {
+			printf("replay:       %s differs from the recording\n", job->movie->mismatch);
+		}
+		else {
+			printf("replay:       matches the recording\n");
+		}
+	}
+
+	if (config->lockstep) {
+		if (job->mismatch != NULL) {
+			const CHIP8* ref = &job->reference->cpu;
+			printf("lockstep:     %s differs from core at frame %llu\n", job->mismatch, (unsigned long long)job->mismatch_frame);
+			printf("core PC: %04x I: %04x SP: %02x DT: %02x ST: %02x instructions: %llu\n",
+				ref->pc, ref->i, ref->sp, ref->delay_timer, ref->sound_timer,
+				(unsigned long long)job->reference->instruction_count);
+		}
+		else {
+			printf("lockstep:     matches core\n");
+		}
+	}
+
+	switch (chip8->cpu_state) {
+		case CHIP8_STATE_EXE:
+			printf("cpu state:    run\n");
+			break;
+		case CHIP8_STATE_HLT:
+			printf("cpu state:    halt\n");
+			break;
+		case CHIP8_STATE_ERROR_OPCODE:
+			printf("cpu state:    opcode error\n");
+			break;
+		default:
+			printf("cpu state:    %d\n", chip8->cpu_state);
+			break;
+	}
+
+	printf("PC: %04x I: %04x SP: %02x DT: %02x ST: %02x\n",
+		chip8->pc, chip8->i, chip8->sp, chip8->delay_timer, chip8->sound_timer);
+
+	for (int i = 0; i < CHIP8_REGISTER_COUNT; ++i) {
+		printf("V%X: %02x%c", i, chip8->v[i], ((i + 1) % 8 == 0) ? '\n' : ' ');
+	}
+}
+
+static int parse_quirks(const char* str, int* quirks) {
+
+	/* Either a raw mask (0x63) or a comma separated list of names */
+
+	if (str[0] >= '0' && str[0] <= '9') {
+		*quirks = (int)strtol(str, NULL, 0);
+		return 0;
+	}
+
+	static const struct {
+		const char* name;
+		int quirk;
+	} quirk_names[] = {
+		{ "cls", CHIP8_QUIRK_CLS_ON_RESET },
+		{ "vf", CHIP8_QUIRK_ZERO_VF_REGISTER },
+		{ "shift", CHIP8_QUIRK_SHIFT_X_REGISTER },
+		{ "inc", CHIP8_QUIRK_INCREMENT_I_REGISTER },
+		{ "jump", CHIP8_QUIRK_JUMP_VX },
+		{ "clip", CHIP8_QUIRK_DISPLAY_CLIPPING },
+		{ "wait", CHIP8_QUIRK_DISPLAY_WAIT },
+	};
+
+	*quirks = 0;
+
+	const char* s = str;
+	while (*s != '\0') {
+		const char* end = strchr(s, ',');
+		size_t len = (end != NULL) ? (size_t)(end - s) : strlen(s);
+
+		int found = 0;
+		for (size_t i = 0; i < sizeof(quirk_names) / sizeof(quirk_names[0]); ++i) {
+			if (strlen(quirk_names[i].name) == len && strncmp(quirk_names[i].name, s, len) == 0) {
+				*quirks |= quirk_names[i].quirk;
+				found = 1;
+				break;
+			}
+		}
+
+		if (!found && len > 0) {
+			printf("Error: unknown quirk: %.*s\n", (int)len, s);
+			return 1;
+		}
+
+		s += len;
+		if (*s == ',')
+			s++;
+	}
+	return 0;
+}
+
+static int parse_engine(const char* str, CHIP8_ENGINE* engine) {
+	for (int i = 0; i < CHIP8_ENGINE_COUNT; ++i) {
+		const char* name = chip8_machine_engine_name((CHIP8_ENGINE)i);
+		if (strlen(name) == strlen(str)) {
+			int match = 1;
+			for (size_t j = 0; name[j] != '\0'; ++j) {
+				if ((name[j] | 0x20) != (str[j] | 0x20)) {
+					match = 0;
+					break;
+				}
+			}
+			if (match) {
+				*engine = (CHIP8_ENGINE)i;
+				return 0;
+			}
+		}
+	}
+	printf("Error: unknown engine: %s\n", str);
+	return 1;
+}
+static int parse_platform(const char* str, CHIP8_PLATFORM* platform) {
+	if (strcmp(str, "chip8") == 0) {
+		*platform = CHIP8_PLATFORM_CHIP8;
+		return 0;
+	}
+	if (strcmp(str, "schip") == 0) {
+		*platform = CHIP8_PLATFORM_SCHIP;
+		return 0;
+	}
+	if (strcmp(str, "xochip") == 0) {
+		*platform = CHIP8_PLATFORM_XOCHIP;
+		return 0;
+	}
+	printf("Error: unknown platform: %s\n", str);
+	return 1;
+}
+
+static int parse_command_line(int argc, char* argv[], HEADLESS_CONFIG* config) {
+
+	for (int i = 1; i < argc; ++i) {
+		const char* arg = argv[i];
+		const char* value = (i + 1 < argc) ? argv[i + 1] : NULL;
+
+		if (strcmp(arg, "-c") == 0 || strcmp(arg, "--cycles") == 0) {
+			if (value == NULL) return 1;
+			config->cycle_budget = strtoull(value, NULL, 0);
+			i++;
+		}
+		else if (strcmp(arg, "-f") == 0 || strcmp(arg, "--frames") == 0) {
+			if (value == NULL) return 1;
+			config->frame_budget = strtoull(value, NULL, 0);
+			config->cycle_budget = 0;
+			i++;
+		}
+		else if (strcmp(arg, "-q") == 0 || strcmp(arg, "--quirks") == 0) {
+			if (value == NULL) return 1;
+			if (parse_quirks(value, &config->quirks) != 0) return 1;
+			i++;
+		}
+		else if (strcmp(arg, "-j") == 0 || strcmp(arg, "--jobs") == 0) {
+			if (value == NULL) return 1;
+			config->thread_count = atoi(value);
+			i++;
+		}
+		else if (strcmp(arg, "-e") == 0 || strcmp(arg, "--engine") == 0) {
+			if (value == NULL) return 1;
+			if (parse_engine(value, &config->engine) != 0) return 1;
+			i++;
+		}
+		else if (strcmp(arg, "-p") == 0 || strcmp(arg, "--platform") == 0) {
+			if (value == NULL) return 1;
+			if (parse_platform(value, &config->platform) != 0) return 1;
+			i++;
+		}
+		else if (strcmp(arg, "--lockstep") == 0) {
+			config->lockstep = 1;
+		}
+		else if (strcmp(arg, "--idle-skip") == 0) {
+			config->idle_skip = 1;
+		}
+		else if (strcmp(arg, "--seed") == 0) {
+			if (value == NULL) return 1;
+			config->seed = strtoull(value, NULL, 0);
+			i++;
+		}
+		else if (strcmp(arg, "-m") == 0 || strcmp(arg, "--movie") == 0) {
+			if (value == NULL) return 1;
+			config->movie_filename = value;
+			i++;
+		}
+		else if (strcmp(arg, "--cpu-hz") == 0) {
+			if (value == NULL) return 1;
+			config->cpu_target = atoi(value);
+			if (config->cpu_target <= 0) return 1;
+			i++;
+		}
+		else if (arg[0] == '-') {
+			printf("Error: unknown option: %s\n", arg);
+			return 1;
+		}
+		else {
+			config->rom_filenames[config->rom_count++] = arg;
+		}
+	}
+
+	if (config->movie_filename != NULL) {
+		return (config->rom_count == 0) ? 0 : 1;
+	}
+	if (config->rom_count == 0) {
+		return 1;
+	}
+	return 0;
+}
+
+static void print_usage(const char* exe) {
+	printf("usage: %s [options] <c8_file> [c8_file ...]\n", exe);
+	printf("       %s [options] --movie <c8m_file>\n", exe);
+	printf("  -c, --cycles <n>    run for n instructions\n");
+	printf("  -f, --frames <n>    run for n 60hz frames (default %d)\n", HEADLESS_DEFAULT_FRAMES);
+	printf("  -q, --quirks <q>    quirk mask (0x63) or list: cls,vf,shift,inc,jump,clip,wait\n");
+	printf("  -j, --jobs <n>      worker threads (default one per cpu)\n");
+	printf("  -e, --engine <e>    execution engine: core, cached, threaded, jit (default cached)\n");
+	printf("  -p, --platform <p>  display platform: chip8, schip, xochip (default chip8)\n");
+	printf("      --cpu-hz <n>    emulated clock used to pace timers (default %d)\n", HEADLESS_DEFAULT_CPU_TARGET);
+	printf("      --lockstep      check the engine against the core every frame\n");
+	printf("      --idle-skip     skip idle loops to the next timer period\n");
+	printf("      --seed <n>      CXNN random seed (default 0)\n");
+	printf("  -m, --movie <file>  replay a recorded movie to its end and compare against the recording\n");
+}
+
+static double get_time_seconds() {
+#ifdef _WIN32
+	LARGE_INTEGER counter;
+	LARGE_INTEGER frequency;
+	QueryPerformanceCounter(&counter);
+	QueryPerformanceFrequency(&frequency);
+	return counter.QuadPart / (double)frequency.QuadPart;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+#endif
+}
@@ -14,55 +14,55 @@ void imgui_toggle_menu();
 static void keypad_input(uint8_t v) {
 	switch (sdl.e.key.keysym.sym) {
 	case SDLK_1:
-		CHIP8_KEYPAD_SET(chip8->keypad, 0x1, v);
+		chip8_post_command(CHIP8_COMMAND_SET_KEY, 0x1, v);
 		break;
 	case SDLK_2:
-		CHIP8_KEYPAD_SET(chip8->keypad, 0x2, v);
+		chip8_post_command(CHIP8_COMMAND_SET_KEY, 0x2, v);
 		break;
 	case SDLK_3:
-		CHIP8_KEYPAD_SET(chip8->keypad, 0x3, v);
+		chip8_post_command(CHIP8_COMMAND_SET_KEY, 0x3, v);
 		break;
 	case SDLK_4:
-		CHIP8_KEYPAD_SET(chip8->keypad, 0xD, v);
+		chip8_post_command(CHIP8_COMMAND_SET_KEY, 0xD, v);
 		break;
 
 	case SDLK_q:
-		CHIP8_KEYPAD_SET(chip8->keypad, 0x4, v);
+		chip8_post_command(CHIP8_COMMAND_SET_KEY, 0x4, v);
 		break;
 	case SDLK_w:
-		CHIP8_KEYPAD_SET(chip8->keypad, 0x5, v);
+		chip8_post_command(CHIP8_COMMAND_SET_KEY, 0x5, v);
 		break;
 	case SDLK_e:
-		CHIP8_KEYPAD_SET(chip8->keypad, 0x6, v);
+		chip8_post_command(CHIP8_COMMAND_SET_KEY, 0x6, v);
 		break;
 	case SDLK_r:
-		CHIP8_KEYPAD_SET(chip8->keypad, 0xC, v);
+		chip8_post_command(CHIP8_COMMAND_SET_KEY, 0xC, v);
 		break;
 
 	case SDLK_a:
-		CHIP8_KEYPAD_SET(chip8->keypad, 0x7, v);
+		chip8_post_command(CHIP8_COMMAND_SET_KEY, 0x7, v);
 		break;
 	case SDLK_s:
-		CHIP8_KEYPAD_SET(chip8->keypad, 0x8, v);
+		chip8_post_command(CHIP8_COMMAND_SET_KEY, 0x8, v);
 		break;
 	case SDLK_d:
-		CHIP8_KEYPAD_SET(chip8->keypad, 0x9, v);
+		chip8_post_command(CHIP8_COMMAND_SET_KEY, 0x9, v);
 		break;
 	case SDLK_f:
-		CHIP8_KEYPAD_SET(chip8->keypad, 0xE, v);
+		chip8_post_command(CHIP8_COMMAND_SET_KEY, 0xE, v);
 		break;
 
 	case SDLK_z:
-		CHIP8_KEYPAD_SET(chip8->keypad, 0xA, v);
+		chip8_post_command(CHIP8_COMMAND_SET_KEY, 0xA, v);
 		break;
 	case SDLK_x:
-		CHIP8_KEYPAD_SET(chip8->keypad, 0x0, v);
+		chip8_post_command(CHIP8_COMMAND_SET_KEY, 0x0, v);
 		break;
 	case SDLK_c:
-		CHIP8_KEYPAD_SET(chip8->keypad, 0xB, v);
+		chip8_post_command(CHIP8_COMMAND_SET_KEY, 0xB, v);
 		break;
 	case SDLK_v:
-		CHIP8_KEYPAD_SET(chip8->keypad, 0xF, v);
+		chip8_post_command(CHIP8_COMMAND_SET_KEY, 0xF, v);
 		break;
 	}
 }
@@ -73,6 +73,23 @@ static void system_input() {
 		case SDLK_r: { // RESET
 			chip8_reset();
 		} break;
+
+		case SDLK_f: { // TOGGLE FAST FORWARD
+			thread_atomic_exchange(&chip8_state.fast_forward_toggled, !thread_atomic_load(&chip8_state.fast_forward_toggled));
+		} break;
+
+		case SDLK_m: { // RECORD / STOP MOVIE
+			if (chip8_state.movie_mode == CHIP8_MOVIE_IDLE) {
+				chip8_post_command(CHIP8_COMMAND_MOVIE_RECORD, 0, 0);
+			}
+			else {
+				chip8_post_command(CHIP8_COMMAND_MOVIE_STOP, 0, 0);
+			}
+		} break;
+
+		case SDLK_p: { // PLAY MOVIE
+			chip8_post_command(CHIP8_COMMAND_MOVIE_PLAY, 0, 0);
+		} break;
 		}
 	}
 
@@ -80,10 +97,10 @@ static void system_input() {
 
 	case SDLK_SPACE: { // PAUSE
 		if (chip8->cpu_state == CHIP8_STATE_EXE) {
-			chip8->cpu_state = CHIP8_STATE_HLT;
+			chip8_post_command(CHIP8_COMMAND_SET_STATE, 0, CHIP8_STATE_HLT);
 		}
 		else {
-			chip8->cpu_state = CHIP8_STATE_EXE;
+			chip8_post_command(CHIP8_COMMAND_SET_STATE, 0, CHIP8_STATE_EXE);
 		}
 	} break;
 
@@ -99,6 +116,14 @@ static void system_input() {
 		}
 		break;
 
+	case SDLK_TAB: // FAST FORWARD WHILE HELD
+		thread_atomic_exchange(&chip8_state.fast_forward_held, 1);
+		break;
+
+	case SDLK_BACKSPACE: // REWIND WHILE HELD
+		thread_atomic_exchange(&chip8_state.rewind_held, 1);
+		break;
+
 	case SDLK_ESCAPE: { // MENU
 		imgui_toggle_menu();
 	} break;
@@ -106,7 +131,30 @@ static void system_input() {
 	case SDLK_RETURN:
 	case SDLK_KP_ENTER: { // STEP
 		if (chip8->cpu_state == CHIP8_STATE_HLT) {
-			chip8_state.single_step = SINGLE_STEP_EXE;
+			chip8_post_command(CHIP8_COMMAND_SINGLE_STEP, 0, 0);
+		}
+	} break;
+
+	case SDLK_F10: { // STEP OVER
+		if (chip8->cpu_state == CHIP8_STATE_HLT) {
+			chip8_post_command(CHIP8_COMMAND_DEBUG_STEP_OVER, 0, 0);
+		}
+	} break;
+
+	case SDLK_F1:
+	case SDLK_F2:
+	case SDLK_F3:
+	case SDLK_F4:
+	case SDLK_F5:
+	case SDLK_F6:
+	case SDLK_F7:
+	case SDLK_F8: { // LOAD STATE; SHIFT SAVES
+		const uint16_t slot = (uint16_t)(sdl.e.key.keysym.sym - SDLK_F1);
+		if (sdl.e.key.keysym.mod & KMOD_SHIFT) {
+			chip8_post_command(CHIP8_COMMAND_SAVE_STATE, slot, 0);
+		}
+		else {
+			chip8_post_command(CHIP8_COMMAND_LOAD_STATE, slot, 0);
 		}
 	} break;
 
@@ -122,6 +170,18 @@ static void system_input() {
 	} break;
 	}
 }
+static void system_input_up() {
+	switch (sdl.e.key.keysym.sym) {
+
+	case SDLK_TAB: // FAST FORWARD WHILE HELD
+		thread_atomic_exchange(&chip8_state.fast_forward_held, 0);
+		break;
+
+	case SDLK_BACKSPACE: // REWIND WHILE HELD
+		thread_atomic_exchange(&chip8_state.rewind_held, 0);
+		break;
+	}
+}
 void input_process_event() {
 	switch (sdl.e.type) {
 
@@ -132,6 +192,7 @@ void input_process_event() {
 
 	case SDL_KEYUP:
 		keypad_input(CHIP8_KEY_STATE_KEY_UP);
+		system_input_up();
 		break;
 	}
 }
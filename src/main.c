@@ -9,6 +9,11 @@
 #include "chip8_sdl2.h"
 #include "chip8.h" // chip8 cpu core
 #include "display.h"
+#include "frame_pacer.h"
+#include "save_state.h"
+
+/* ms the main loop waits for input while the guest waits on a key */
+#define MAIN_BLOCKED_WAIT_MS 250
 
 void loadini_init(); 
 void loadini_destroy();
@@ -45,28 +50,75 @@ int main(int argc, char* argv[]) {
 	
 	sdl_create_window();
 	imgui_create_renderer();
+	frame_pacer_init();
+	save_state_init();
+
+	/* the cpu and timers run on their own thread from here */
+	chip8_start_thread();
+
+	const uint64_t frequency = SDL_GetPerformanceFrequency();
+	uint64_t last_render = SDL_GetPerformanceCounter();
+	uint64_t next_render = last_render;
 
 	while (window_state->window_open) {
 		
 		start_frame();
 
 		sdl_update();
-		chip8_update();
-		
-		const double render_duration = (1000.0 / chip8_config.render_target);
-		window_stats->render_elapsed_time += window_stats->delta_time;
-		window_stats->render_fps = 1.0 / window_stats->render_elapsed_time * 1000.0;
-		if (render_duration < window_stats->render_elapsed_time) {
-			imgui_update();
-			sdl_render();
-			chip8_render(chip8);
-			window_stats->render_elapsed_time -= render_duration;
-			window_stats->instructions_per_frame = 0;
+		sdl_update_vsync();
+		chip8_sync_status();
+
+		/* with vsync the present blocks until the display refresh */
+		const uint64_t now = SDL_GetPerformanceCounter();
+		const uint64_t render_period = frequency / (chip8_config.render_target > 0 ? chip8_config.render_target : 1);
+		int presented = 0;
+		if (window_state->vsync || now >= next_render) {
+			if (sdl_needs_render()) {
+				sdl_render();
+				imgui_update();
+				sdl_present();
+				presented = 1;
+
+				window_stats->render_elapsed_time = (now - last_render) * 1000.0 / frequency;
+				window_stats->render_fps = 1000.0 / window_stats->render_elapsed_time;
+				last_render = now;
+			}
+			else {
+				/* static screen and no ui; the last present still stands */
+				window_stats->skipped_renders++;
+			}
+
+			next_render += render_period;
+			if (next_render < now) {
+				/* fell behind; don't render a burst to catch up */
+				next_render = now + render_period;
+			}
 		}
 
 		end_frame();
+
+		if (!window_state->vsync || !presented) {
+			/* the emulation thread keeps its own deadlines; only the render rate
+			   matters here. Input wakes the wait early */
+			const uint64_t after = SDL_GetPerformanceCounter();
+			uint32_t wait_ms = 0;
+			if (next_render > after) {
+				/* round up; a sub ms remainder must still sleep, not spin */
+				wait_ms = (uint32_t)(((next_render - after) * 1000 + frequency - 1) / frequency);
+			}
+			if (chip8_status.blocked == CHIP8_BLOCKED_KEY && !sdl_needs_render()) {
+				/* the display can not change until a key is pressed */
+				wait_ms = MAIN_BLOCKED_WAIT_MS;
+			}
+			if (wait_ms > 0) {
+				SDL_WaitEventTimeout(NULL, wait_ms);
+			}
+		}
 	}
 
+	chip8_stop_thread();
+	save_state_destroy();
+
 	loadini_save_settings();
 
 	// Cleanup
@@ -0,0 +1,154 @@
+/* save_state.c
+* Save state slots. States are taken and restored in memory on the thread
+* that runs the machine; a writer thread copies saved slots to snapshot files.
+* GitHub: https:\\github.com\tommojphillips
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "SDL.h"
+
+#include "save_state.h"
+#include "chip8_snapshot.h"
+#include "chip8_machine.h"
+#include "thread.h"
+
+/* Slot file name. %d is the slot number from 1 */
+#define SAVE_STATE_FILENAME "chip8_slot%d.sav"
+
+/* Save state slot */
+typedef struct {
+	CHIP8_SNAPSHOT snapshot;
+	int valid; // holds a state
+	int dirty; // saved since it was last written to its file
+} SAVE_STATE_SLOT;
+
+/* slots are shared by the machine thread, the writer and the ui. The lock
+   is only held for a snapshot copy; never across file io */
+static SAVE_STATE_SLOT slots[SAVE_STATE_SLOT_COUNT] = { 0 };
+static SDL_mutex* slot_mutex = NULL;
+static SDL_sem* writer_wake = NULL; // posted with every save
+static SDL_Thread* writer_thread = NULL;
+static volatile long writer_running = 0;
+static CHIP8_SNAPSHOT writer_snapshot; // writer thread only
+
+static int writer_thread_main(void* arg);
+static void writer_flush();
+static void slot_filename(int slot, char* filename, size_t size);
+
+void save_state_init() {
+
+	slot_mutex = SDL_CreateMutex();
+	writer_wake = SDL_CreateSemaphore(0);
+	if (slot_mutex == NULL || writer_wake == NULL) {
+		printf("Failed to create save state lock\n");
+		exit(1);
+	}
+
+	char filename[32];
+	for (int i = 0; i < SAVE_STATE_SLOT_COUNT; ++i) {
+		slot_filename(i, filename, sizeof(filename));
+		slots[i].valid = (chip8_snapshot_read_file(filename, &slots[i].snapshot) == 0);
+		slots[i].dirty = 0;
+	}
+
+	thread_atomic_exchange(&writer_running, 1);
+	writer_thread = SDL_CreateThread(writer_thread_main, "chip8 save state", NULL);
+	if (writer_thread == NULL) {
+		printf("Failed to create save state thread\n");
+		exit(1);
+	}
+}
+void save_state_destroy() {
+
+	if (writer_thread != NULL) {
+		thread_atomic_exchange(&writer_running, 0);
+		SDL_SemPost(writer_wake);
+		SDL_WaitThread(writer_thread, NULL);
+		writer_thread = NULL;
+	}
+
+	if (writer_wake != NULL) {
+		SDL_DestroySemaphore(writer_wake);
+		writer_wake = NULL;
+	}
+	if (slot_mutex != NULL) {
+		SDL_DestroyMutex(slot_mutex);
+		slot_mutex = NULL;
+	}
+}
+int save_state_save(const CHIP8_MACHINE* machine, int slot) {
+	if (slot < 0 || slot >= SAVE_STATE_SLOT_COUNT)
+		return 1;
+
+	SDL_LockMutex(slot_mutex);
+	chip8_snapshot_save(machine, &slots[slot].snapshot);
+	slots[slot].valid = 1;
+	slots[slot].dirty = 1;
+	SDL_UnlockMutex(slot_mutex);
+
+	SDL_SemPost(writer_wake);
+	return 0;
+}
+int save_state_load(CHIP8_MACHINE* machine, int slot) {
+	if (slot < 0 || slot >= SAVE_STATE_SLOT_COUNT)
+		return 1;
+
+	int result = 1;
+	SDL_LockMutex(slot_mutex);
+	if (slots[slot].valid) {
+		result = chip8_snapshot_load(machine, &slots[slot].snapshot);
+	}
+	SDL_UnlockMutex(slot_mutex);
+	return result;
+}
+int save_state_get_slot(int slot, uint64_t* frame_count) {
+	if (slot < 0 || slot >= SAVE_STATE_SLOT_COUNT)
+		return 0;
+
+	SDL_LockMutex(slot_mutex);
+	const int valid = slots[slot].valid;
+	if (valid && frame_count != NULL) {
+		*frame_count = slots[slot].snapshot.frame_count;
+	}
+	SDL_UnlockMutex(slot_mutex);
+	return valid;
+}
+
+static int writer_thread_main(void* arg) {
+	(void)arg;
+	for (;;) {
+		SDL_SemWait(writer_wake);
+		writer_flush();
+		if (thread_atomic_load(&writer_running) == 0) {
+			break;
+		}
+	}
+	return 0;
+}
+static void writer_flush() {
+	char filename[32];
+	for (int i = 0; i < SAVE_STATE_SLOT_COUNT; ++i) {
+
+		int write = 0;
+		SDL_LockMutex(slot_mutex);
+		if (slots[i].dirty) {
+			writer_snapshot = slots[i].snapshot;
+			slots[i].dirty = 0;
+			write = 1;
+		}
+		SDL_UnlockMutex(slot_mutex);
+
+		if (write) {
+			slot_filename(i, filename, sizeof(filename));
+			if (chip8_snapshot_write_file(filename, &writer_snapshot) != 0) {
+				printf("Could not write save state to %s\n", filename);
+			}
+		}
+	}
+}
+static void slot_filename(int slot, char* filename, size_t size) {
+	snprintf(filename, size, SAVE_STATE_FILENAME, slot + 1);
+}
@@ -0,0 +1,41 @@
+/* save_state.h
+* Save state slots. States are taken and restored in memory on the thread
+* that runs the machine; a writer thread copies saved slots to snapshot files.
+* GitHub: https:\\github.com\tommojphillips
+*/
+
+#ifndef SAVE_STATE_H
+#define SAVE_STATE_H
+
+#include <stdint.h>
+
+#include "chip8_machine.h"
+
+/* Number of save state slots */
+#define SAVE_STATE_SLOT_COUNT 8
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Read the slot files and start the writer thread */
+void save_state_init();
+
+/* Write any unwritten slots and stop the writer thread */
+void save_state_destroy();
+
+/* Save a machine to a slot. The file is written in the background.
+   returns 0 on success */
+int save_state_save(const CHIP8_MACHINE* machine, int slot);
+
+/* Load a machine from a slot. returns 0 on success, 1 if the slot is empty */
+int save_state_load(CHIP8_MACHINE* machine, int slot);
+
+/* Get the frame count a slot was saved at. returns 1 if the slot holds a state */
+int save_state_get_slot(int slot, uint64_t* frame_count);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif
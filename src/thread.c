@@ -0,0 +1,160 @@
+/* thread.c
+* Minimal thread, mutex and atomic wrappers (win32 / pthreads)
+* GitHub: https:\\github.com\tommojphillips
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifndef _WIN32
+#include <sched.h>
+#include <unistd.h>
+#endif
+
+#include "thread.h"
+
+/* Thread start trampoline */
+typedef struct {
+	THREAD_FN fn;
+	void* arg;
+} THREAD_START;
+
+#ifdef _WIN32
+static DWORD WINAPI thread_start(LPVOID p) {
+#else
+static void* thread_start(void* p) {
+#endif
+	THREAD_START start = *(THREAD_START*)p;
+	free(p);
+	start.fn(start.arg);
+	return 0;
+}
+
+int thread_create(THREAD* thread, THREAD_FN fn, void* arg) {
+
+	THREAD_START* start = (THREAD_START*)malloc(sizeof(THREAD_START));
+	if (start == NULL) {
+		return 1;
+	}
+	start->fn = fn;
+	start->arg = arg;
+
+#ifdef _WIN32
+	*thread = CreateThread(NULL, 0, thread_start, start, 0, NULL);
+	if (*thread == NULL) {
+		free(start);
+		return 1;
+	}
+#else
+	if (pthread_create(thread, NULL, thread_start, start) != 0) {
+		free(start);
+		return 1;
+	}
+#endif
+	return 0;
+}
+void thread_join(THREAD thread) {
+#ifdef _WIN32
+	WaitForSingleObject(thread, INFINITE);
+	CloseHandle(thread);
+#else
+	pthread_join(thread, NULL);
+#endif
+}
+void thread_yield() {
+#ifdef _WIN32
+	SwitchToThread();
+#else
+	sched_yield();
+#endif
+}
+int thread_cpu_count() {
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return (int)info.dwNumberOfProcessors;
+#else
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n > 0 ? (int)n : 1;
+#endif
+}
+
+void thread_mutex_init(THREAD_MUTEX* mutex) {
+#ifdef _WIN32
+	InitializeCriticalSection(mutex);
+#else
+	pthread_mutex_init(mutex, NULL);
+#endif
+}
+void thread_mutex_destroy(THREAD_MUTEX* mutex) {
+#ifdef _WIN32
+	DeleteCriticalSection(mutex);
+#else
+	pthread_mutex_destroy(mutex);
+#endif
+}
+void thread_mutex_lock(THREAD_MUTEX* mutex) {
+#ifdef _WIN32
+	EnterCriticalSection(mutex);
+#else
+	pthread_mutex_lock(mutex);
+#endif
+}
+void thread_mutex_unlock(THREAD_MUTEX* mutex) {
+#ifdef _WIN32
+	LeaveCriticalSection(mutex);
+#else
+	pthread_mutex_unlock(mutex);
+#endif
+}
+
+void thread_cond_init(THREAD_COND* cond) {
+#ifdef _WIN32
+	InitializeConditionVariable(cond);
+#else
+	pthread_cond_init(cond, NULL);
+#endif
+}
+void thread_cond_destroy(THREAD_COND* cond) {
+#ifdef _WIN32
+	(void)cond; // win32 condition variables hold no resources
+#else
+	pthread_cond_destroy(cond);
+#endif
+}
+void thread_cond_wait(THREAD_COND* cond, THREAD_MUTEX* mutex) {
+#ifdef _WIN32
+	SleepConditionVariableCS(cond, mutex, INFINITE);
+#else
+	pthread_cond_wait(cond, mutex);
+#endif
+}
+void thread_cond_broadcast(THREAD_COND* cond) {
+#ifdef _WIN32
+	WakeAllConditionVariable(cond);
+#else
+	pthread_cond_broadcast(cond);
+#endif
+}
+
+long thread_atomic_add(volatile long* p, long v) {
+#ifdef _WIN32
+	return InterlockedExchangeAdd(p, v) + v;
+#else
+	return __atomic_add_fetch(p, v, __ATOMIC_SEQ_CST);
+#endif
+}
+long thread_atomic_load(volatile long* p) {
+#ifdef _WIN32
+	return InterlockedCompareExchange(p, 0, 0);
+#else
+	return __atomic_load_n(p, __ATOMIC_SEQ_CST);
+#endif
+}
+long thread_atomic_exchange(volatile long* p, long v) {
+#ifdef _WIN32
+	return InterlockedExchange(p, v);
+#else
+	return __atomic_exchange_n(p, v, __ATOMIC_SEQ_CST);
+#endif
+}
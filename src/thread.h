@@ -0,0 +1,75 @@
+/* thread.h
+* Minimal thread, mutex and atomic wrappers (win32 / pthreads)
+* GitHub: https:\\github.com\tommojphillips
+*/
+
+#ifndef THREAD_H
+#define THREAD_H
+
+#include <stdint.h>
+
+#ifdef _WIN32
+#include <windows.h>
+typedef HANDLE THREAD;
+typedef CRITICAL_SECTION THREAD_MUTEX;
+typedef CONDITION_VARIABLE THREAD_COND;
+#else
+#include <pthread.h>
+typedef pthread_t THREAD;
+typedef pthread_mutex_t THREAD_MUTEX;
+typedef pthread_cond_t THREAD_COND;
+#endif
+
+typedef void (*THREAD_FN)(void* arg);
+
+/* Thread local storage */
+#ifdef _MSC_VER
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Create a thread running fn(arg). returns 0 on success */
+int thread_create(THREAD* thread, THREAD_FN fn, void* arg);
+
+/* Wait for a thread to exit */
+void thread_join(THREAD thread);
+
+/* Give up the rest of the time slice */
+void thread_yield();
+
+/* Number of logical cpus */
+int thread_cpu_count();
+
+void thread_mutex_init(THREAD_MUTEX* mutex);
+void thread_mutex_destroy(THREAD_MUTEX* mutex);
+void thread_mutex_lock(THREAD_MUTEX* mutex);
+void thread_mutex_unlock(THREAD_MUTEX* mutex);
+
+void thread_cond_init(THREAD_COND* cond);
+void thread_cond_destroy(THREAD_COND* cond);
+
+/* Unlock mutex, wait for a wake and lock it again. May wake spuriously */
+void thread_cond_wait(THREAD_COND* cond, THREAD_MUTEX* mutex);
+
+/* Wake every thread waiting on cond */
+void thread_cond_broadcast(THREAD_COND* cond);
+
+/* Atomically add v to *p. returns the new value */
+long thread_atomic_add(volatile long* p, long v);
+
+/* Atomic load of *p */
+long thread_atomic_load(volatile long* p);
+
+/* Atomically store v to *p. returns the previous value */
+long thread_atomic_exchange(volatile long* p, long v);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif
@@ -8,11 +8,18 @@
 #include "imgui_memory_editor/imgui_memory_editor.h"
 using namespace ImGui;
 
+#include <algorithm>
+#include <math.h>
+
 #include "ui.h"
 #include "chip8_sdl2.h"
 #include "chip8.h"
 #include "chip8_mnem.h"
+#include "chip8_debug.h"
+#include "chip8_profile.h"
 #include "display.h"
+#include "chip8_display.h"
+#include "save_state.h"
 
 #define renderer_new_frame \
 	ImGui_ImplSDLRenderer2_NewFrame(); \
@@ -48,6 +55,20 @@ typedef struct {
 	MemoryEditor* video_editor; 
 	ImGuiIO* io;
 	char tmp_s[32];
+
+	/* debugger inputs */
+	int breakpoint_addr;
+	int run_to_addr;
+	int run_count;
+	char watch_s[CHIP8_DEBUG_MAX_SOURCE];
+	char condition_s[CHIP8_DEBUG_MAX_SOURCE];
+	const char* expression_error; // why the last watch or condition did not compile
+	uint64_t debug_stops; // debugger stops seen; a new one opens the debug window
+
+	uint64_t profile_max; // highest address count this frame; the heat map scale
+
+	int rewind_buffer_mb; // rewind slider value; the config takes it on release
+	int rewind_buffer_active; // the rewind slider is being dragged
 } IMGUI_STATE;
 
 static IMGUI_STATE imgui = { 0 };
@@ -55,10 +76,18 @@ static IMGUI_STATE imgui = { 0 };
 extern "C" UI_STATE ui_state = { 0 };
 
 static void ram_window_follow_pc(uint16_t pc, int force);
+static void ram_window_write(ImU8* data, size_t off, ImU8 d, void* user_data);
+static void video_ram_window_write(ImU8* data, size_t off, ImU8 d, void* user_data);
+static ImU32 ram_window_heat(const ImU8* data, size_t off, void* user_data);
 static void outline_test();
 static void stats_window();
 static void registers_window();
 static void debug_window();
+static void debugger_section();
+static void debug_expression_input(const char* label, char* buffer, CHIP8_COMMAND_TYPE type);
+static void profile_window();
+static void profile_class_table(const CHIP8_PROFILE* profile);
+static void profile_address_table(const CHIP8_PROFILE* profile);
 static void window_settings_window();
 static void chip8_settings_window();
 static void menu_window();
@@ -69,6 +98,9 @@ static void set_default_settings();
 
 void imgui_init() {
 	set_default_settings();
+	imgui.breakpoint_addr = CHIP8_PROGRAM_ADDR;
+	imgui.run_to_addr = CHIP8_PROGRAM_ADDR;
+	imgui.run_count = 1;
 }
 void imgui_create_renderer() {
 
@@ -90,12 +122,15 @@ void imgui_create_renderer() {
 	mem_edit.Cols = ui_state.cols_ram_window;
 	mem_edit.OptShowAscii = ui_state.ascii_ram_window;
 	mem_edit.GotoAddr = CHIP8_PROGRAM_ADDR;
+	mem_edit.WriteFn = ram_window_write;
+	mem_edit.BgColorFn = ram_window_heat;
 	imgui.mem_editor = &mem_edit;
 
 	static MemoryEditor video_edit;
 	video_edit.Open = ui_state.show_video_ram_window;
 	video_edit.Cols = ui_state.cols_video_ram_window;
 	video_edit.OptShowAscii = ui_state.ascii_video_ram_window;
+	video_edit.WriteFn = video_ram_window_write;
 	imgui.video_editor = &video_edit;
 
 	ImGui_ImplSDL2_InitForSDLRenderer(sdl.game_window, sdl.game_renderer);
@@ -123,6 +158,14 @@ void imgui_update() {
 		}
 
 		if (imgui.mem_editor->Open) {
+			imgui.profile_max = 0;
+			if (ui_state.profile_heat_map) {
+				const CHIP8_PROFILE* profile = chip8_get_profile();
+				for (int i = 0; i < CHIP8_MEMORY_BYTES; ++i) {
+					if (profile->address_counts[i] > imgui.profile_max)
+						imgui.profile_max = profile->address_counts[i];
+				}
+			}
 			imgui.mem_editor->DrawWindow("RAM", chip8->ram, CHIP8_MEMORY_BYTES, 0);
 		}
 
@@ -138,9 +181,16 @@ void imgui_update() {
 	if (ui_state.show_stats_window) {
 		stats_window();
 	}
+	if (chip8_status.debug.stops != imgui.debug_stops) {
+		imgui.debug_stops = chip8_status.debug.stops;
+		ui_state.show_debug_window = 1;
+	}
 	if (ui_state.show_debug_window) {
 		debug_window();
 	}
+	if (ui_state.show_profile_window) {
+		profile_window();
+	}
 	
 	
 	Render();	
@@ -152,6 +202,12 @@ void imgui_process_event() {
 void imgui_toggle_menu() {
 	ui_state.show_menu_window ^= 1;
 }
+int imgui_is_active() {
+	/* open windows show live state; they repaint every render tick */
+	return ui_state.show_menu_window || ui_state.show_stats_window || ui_state.show_debug_window ||
+		ui_state.show_registers_window || ui_state.show_video_button_window || ui_state.show_profile_window ||
+		imgui.mem_editor->Open || imgui.video_editor->Open;
+}
 
 void imgui_refresh_ui_state() {
 	/* Save off ui state so they can be saved to a file */
@@ -173,6 +229,8 @@ static void set_default_settings() {
 	ui_state.show_stats_window = 0;
 	ui_state.show_registers_window = 0;
 	ui_state.show_video_button_window = 0;
+	ui_state.show_profile_window = 0;
+	ui_state.profile_heat_map = 1;
 	ui_state.show_ram_window = 0;
 	ui_state.cols_ram_window = 16;
 	ui_state.ascii_ram_window = 0;
@@ -186,7 +244,43 @@ static void stats_window() {
 	Text("%.2f dt", window_stats->delta_time);
 	Text("%.2f ms/frame ", window_stats->render_elapsed_time);
 	Text("%.2f fps ", window_stats->render_fps);
-	Text("Instr/frame  %u", window_stats->instructions_per_frame);
+	static const char* blocked_names[] = { "-", "key", "vblank" };
+	Text("Blocked on  %s", blocked_names[chip8_status.blocked]);
+	Text("MIPS  %.2f", chip8_state.mips);
+	Text("Speed  %.2fx%s", chip8_state.speed, CHIP8_FAST_FORWARD ? "  fast forward" : "");
+	Text("Instr/frame  %u", machine->instructions_per_frame);
+	Text("Timer periods  %llu", (unsigned long long)machine->frame_count);
+	Text("Dropped periods  %llu", (unsigned long long)machine->dropped_periods);
+	Text("Idle skips  %llu (%llu instr)", (unsigned long long)machine->idle_skips, (unsigned long long)machine->idle_instructions);
+	if (machine->instruction_count > 0) {
+		SameLine();
+		Text(" %.1f%%", machine->idle_instructions * 100.0 / machine->instruction_count);
+	}
+	SetItemTooltip("Instructions the idle skip did not have to run");
+	if (chip8_config.rewind_buffer_mb > 0) {
+		Text("Rewind capture  %.2f us  %u bytes", chip8_state.rewind_capture_us, chip8_state.rewind_capture_bytes);
+		SetItemTooltip("Average cost of a rewind capture and the encoded size of the last one");
+		Text("Rewind buffer  %.2f / %d MB  %.1f s (%u states)", chip8_state.rewind_bytes / (1024.0 * 1024.0), chip8_config.rewind_buffer_mb,
+			chip8_state.rewind_seconds, chip8_state.rewind_entries);
+	}
+	if (chip8_config.run_ahead > 0) {
+		Text("Run-ahead  %d frames  %.2f us  %.1f%% of a frame", chip8_config.run_ahead, chip8_state.run_ahead_us, chip8_state.run_ahead_load);
+		SetItemTooltip("Average cost of running ahead and rolling back, against the timer period it has to fit in");
+	}
+	Text("Uploaded rows  %d", window_stats->uploaded_rows);
+	Text("Skipped renders  %llu", (unsigned long long)window_stats->skipped_renders);
+	if (window_state->vsync) {
+		Text("Pacing  vsync");
+	}
+	else {
+		Text("Pacing jitter  %.3f ms (avg %.3f, max %.3f)", chip8_status.pacing.jitter, chip8_status.pacing.jitter_avg, chip8_status.pacing.jitter_max);
+		Text("Pacing spin  %.2f ms  wait %.2f ms", chip8_status.pacing.spin, chip8_status.pacing.wait);
+		SameLine();
+		if (SmallButton("Reset")) {
+			chip8_post_command(CHIP8_COMMAND_PACING_RESET, 0, 0);
+		}
+		SetItemTooltip("Reset the worst case jitter");
+	}
 	//Text("cycles/frame  %u", chip8->cycles);
 	End();
 }
@@ -199,28 +293,28 @@ static void registers_window() {
 	SameLine();
 	tmp_int = chip8->sp;
 	if (InputInt("###stack_pointer", &tmp_int, 0, 1, ImGuiInputTextFlags_CharsHexadecimal)) {
-		chip8->sp = tmp_int % 65536;
+		chip8_post_command(CHIP8_COMMAND_SET_REGISTER, CHIP8_COMMAND_REGISTER_SP, tmp_int % 65536);
 	}
 
 	Text("I:  ");
 	SameLine();
 	tmp_int = chip8->i;
 	if (InputInt("###i_register", &tmp_int, 0, 1, ImGuiInputTextFlags_CharsHexadecimal)) {
-		chip8->i = tmp_int % 65536;
+		chip8_post_command(CHIP8_COMMAND_SET_REGISTER, CHIP8_COMMAND_REGISTER_I, tmp_int % 65536);
 	}
 
 	Text("DT: ");
 	SameLine();
 	tmp_int = chip8->delay_timer;
 	if (InputInt("###dt", &tmp_int, 0, 1, ImGuiInputTextFlags_CharsHexadecimal)) {
-		chip8->delay_timer = tmp_int % 256;
+		chip8_post_command(CHIP8_COMMAND_SET_REGISTER, CHIP8_COMMAND_REGISTER_DT, tmp_int % 256);
 	}
 
 	Text("ST: ");
 	SameLine();
 	tmp_int = chip8->sound_timer;
 	if (InputInt("###st", &tmp_int, 0, 1, ImGuiInputTextFlags_CharsHexadecimal)) {
-		chip8->sound_timer = tmp_int % 256;
+		chip8_post_command(CHIP8_COMMAND_SET_REGISTER, CHIP8_COMMAND_REGISTER_ST, tmp_int % 256);
 	}
 
 	for (int i = 0; i < CHIP8_REGISTER_COUNT; ++i) {
@@ -230,7 +324,7 @@ static void registers_window() {
 		tmp_int = chip8->v[i];
 		if (InputInt("", &tmp_int, 0, 1, ImGuiInputTextFlags_CharsHexadecimal)) {
 			if (tmp_int < 256 && tmp_int > 0) {
-				chip8->v[i] = tmp_int % 256;
+				chip8_post_command(CHIP8_COMMAND_SET_REGISTER, i, tmp_int % 256);
 			}
 		}
 		PopID();
@@ -248,6 +342,8 @@ static void debug_window() {
 	Checkbox("Video Editor", (bool*)&ui_state.show_video_button_window);
 	SameLine();
 	Checkbox("Registers", (bool*)&ui_state.show_registers_window);
+	SameLine();
+	Checkbox("Profile", (bool*)&ui_state.show_profile_window);
 
 	if (chip8->cpu_state == CHIP8_STATE_ERROR_OPCODE) {
 		SeparatorText("Opcode error!");
@@ -280,13 +376,13 @@ static void debug_window() {
 
 	if (chip8->cpu_state != CHIP8_STATE_EXE) {
 		if (ArrowButton("Continue", ImGuiDir_Right)) {
-			chip8->cpu_state = CHIP8_STATE_EXE;
+			chip8_post_command(CHIP8_COMMAND_SET_STATE, 0, CHIP8_STATE_EXE);
 		}
 		SetItemTooltip("Continue");
 	}
 	else {
 		if (Button("||")) {
-			chip8->cpu_state = CHIP8_STATE_HLT;
+			chip8_post_command(CHIP8_COMMAND_SET_STATE, 0, CHIP8_STATE_HLT);
 		}
 
 		SetItemTooltip("Break All");
@@ -302,7 +398,7 @@ static void debug_window() {
 
 		SameLine();
 		if (Button(">>")) {
-			chip8_state.single_step = SINGLE_STEP_EXE;
+			chip8_post_command(CHIP8_COMMAND_SINGLE_STEP, 0, 0);
 			uint16_t next_pc = 0;
 			chip8_mnem_find_next(chip8, &next_pc);
 			ram_window_follow_pc(next_pc, 0);
@@ -313,24 +409,28 @@ static void debug_window() {
 		InputInt("###program_counter", (int*)&tmp_uint, 0, 100, ImGuiInputTextFlags_CharsHexadecimal);
 		if (IsItemDeactivatedAfterEdit()) {
 			if (tmp_uint < CHIP8_MEMORY_BYTES) {
-				chip8->pc = (uint32_t)tmp_uint;
-				ram_window_follow_pc(0, 1);
+				chip8_post_command(CHIP8_COMMAND_SET_REGISTER, CHIP8_COMMAND_REGISTER_PC, tmp_uint);
+				ram_window_follow_pc((uint16_t)tmp_uint, 1);
 			}
 		}
 
 		SameLine();
 		if (ArrowButton("pc_dec", ImGuiDir_Left)) {
-			if (chip8->pc >= ui_state.pc_increment)
-				chip8->pc -= ui_state.pc_increment;
-			ram_window_follow_pc(0, 1);
+			if (chip8->pc >= ui_state.pc_increment) {
+				const uint16_t pc = chip8->pc - ui_state.pc_increment;
+				chip8_post_command(CHIP8_COMMAND_SET_REGISTER, CHIP8_COMMAND_REGISTER_PC, pc);
+				ram_window_follow_pc(pc, 1);
+			}
 		}
 		SetItemTooltip("Decrement program counter ( PC )");
 
 		SameLine();
 		if (ArrowButton("pc_inc", ImGuiDir_Right)) {
-			if (chip8->pc < CHIP8_MEMORY_BYTES - ui_state.pc_increment)
-				chip8->pc += ui_state.pc_increment;
-			ram_window_follow_pc(0, 1);
+			if (chip8->pc < CHIP8_MEMORY_BYTES - ui_state.pc_increment) {
+				const uint16_t pc = chip8->pc + ui_state.pc_increment;
+				chip8_post_command(CHIP8_COMMAND_SET_REGISTER, CHIP8_COMMAND_REGISTER_PC, pc);
+				ram_window_follow_pc(pc, 1);
+			}
 		}
 		SetItemTooltip("Increment program counter ( PC )");
 
@@ -346,34 +446,379 @@ static void debug_window() {
 		SetItemTooltip("Follow program counter in RAM window ( PC )");
 	}
 
+	debugger_section();
+
+	SeparatorText("Movie");
+	if (chip8_state.movie_mode == CHIP8_MOVIE_IDLE) {
+		if (Button("Record")) {
+			chip8_post_command(CHIP8_COMMAND_MOVIE_RECORD, 0, 0);
+		}
+		SetItemTooltip("Record the keypad from the current state ( Ctrl + M )");
+	}
+	else {
+		if (Button("Stop")) {
+			chip8_post_command(CHIP8_COMMAND_MOVIE_STOP, 0, 0);
+		}
+		SetItemTooltip("Stop the movie. A recording is saved ( Ctrl + M )");
+	}
+	SameLine();
+	if (Button("Play")) {
+		chip8_post_command(CHIP8_COMMAND_MOVIE_PLAY, 0, 0);
+	}
+	SetItemTooltip("Replay the last recording from its start state ( Ctrl + P )");
+	SameLine();
+	switch (chip8_state.movie_mode) {
+		case CHIP8_MOVIE_RECORDING:
+			Text("Recording  %u key changes", chip8_state.movie_events);
+			break;
+		case CHIP8_MOVIE_PLAYING:
+			Text("Playing  %u key changes left", chip8_state.movie_events);
+			break;
+		default:
+			Text("-");
+			break;
+	}
+
+	SeparatorText("Save states");
+	for (int i = 0; i < SAVE_STATE_SLOT_COUNT; ++i) {
+		uint64_t frame_count = 0;
+		const int valid = save_state_get_slot(i, &frame_count);
+
+		PushID(i);
+		if (Button("Save")) {
+			chip8_post_command(CHIP8_COMMAND_SAVE_STATE, (uint16_t)i, 0);
+		}
+		SetItemTooltip("Save state ( Shift + F%d )", i + 1);
+
+		SameLine();
+		BeginDisabled(!valid);
+		if (Button("Load")) {
+			chip8_post_command(CHIP8_COMMAND_LOAD_STATE, (uint16_t)i, 0);
+		}
+		EndDisabled();
+		SetItemTooltip("Load state ( F%d )", i + 1);
+
+		SameLine();
+		if (valid) {
+			Text("%d: frame %llu", i + 1, (unsigned long long)frame_count);
+		}
+		else {
+			Text("%d: empty", i + 1);
+		}
+		PopID();
+	}
+
 	End();
 }
+static void debugger_section() {
+	/* the copy published with the status; the debugger is the emulation thread's */
+	const CHIP8_DEBUG_STATUS* debug = &chip8_status.debug;
+
+	SeparatorText("Debugger");
+	if (debug->stops > 0) {
+		Text("Stopped: %s", debug->stop);
+	}
+
+	if (chip8->cpu_state == CHIP8_STATE_HLT) {
+		if (Button("Step over")) {
+			chip8_post_command(CHIP8_COMMAND_DEBUG_STEP_OVER, 0, 0);
+		}
+		SetItemTooltip("Step; a call runs until it returns ( F10 )");
+
+		SameLine();
+		SetNextItemWidth(GetFontSize() * 6);
+		InputInt("###run_count", &imgui.run_count, 0);
+		if (imgui.run_count < 1) {
+			imgui.run_count = 1;
+		}
+		SameLine();
+		if (Button("Run N")) {
+			chip8_post_command(CHIP8_COMMAND_DEBUG_RUN_COUNT, 0, (uint32_t)imgui.run_count);
+		}
+		SetItemTooltip("Run this many instructions");
+	}
+
+	SetNextItemWidth(GetFontSize() * 6);
+	InputInt("###run_to", &imgui.run_to_addr, 0, 100, ImGuiInputTextFlags_CharsHexadecimal);
+	imgui.run_to_addr &= CHIP8_MEMORY_BYTES - 1;
+	SameLine();
+	BeginDisabled(chip8->cpu_state == CHIP8_STATE_ERROR_OPCODE);
+	if (Button("Run to")) {
+		chip8_post_command(CHIP8_COMMAND_DEBUG_RUN_TO, (uint16_t)imgui.run_to_addr, 0);
+	}
+	EndDisabled();
+	SetItemTooltip("Run until the program counter reaches this address");
+
+	/* breakpoints */
+	SetNextItemWidth(GetFontSize() * 6);
+	InputInt("###breakpoint", &imgui.breakpoint_addr, 0, 100, ImGuiInputTextFlags_CharsHexadecimal);
+	imgui.breakpoint_addr &= CHIP8_MEMORY_BYTES - 1;
+	SameLine();
+	if (Button("Add breakpoint")) {
+		chip8_post_command(CHIP8_COMMAND_DEBUG_BREAKPOINT, (uint16_t)imgui.breakpoint_addr, 1);
+	}
+	SameLine();
+	if (Button("Toggle at PC")) {
+		chip8_post_command(CHIP8_COMMAND_DEBUG_BREAKPOINT, chip8->pc, debug->breakpoints[chip8->pc & (CHIP8_MEMORY_BYTES - 1)] ? 0 : 1);
+	}
+
+	if (debug->breakpoint_count > 0) {
+		int shown = 0;
+		for (int addr = 0; addr < CHIP8_MEMORY_BYTES && shown < debug->breakpoint_count; ++addr) {
+			if (!debug->breakpoints[addr])
+				continue;
+
+			PushID(addr);
+			if (shown % 4 != 0) {
+				SameLine();
+			}
+			if (SmallButton("x")) {
+				chip8_post_command(CHIP8_COMMAND_DEBUG_BREAKPOINT, (uint16_t)addr, 0);
+			}
+			SetItemTooltip("Remove breakpoint");
+			SameLine();
+			Text("%04x", addr);
+			PopID();
+			shown++;
+		}
+	}
+
+	/* watches; stop when the value changes */
+	debug_expression_input("Watch", imgui.watch_s, CHIP8_COMMAND_DEBUG_WATCH);
+	SetItemTooltip("Stop when the value changes. e.g. v3, [0x300], i + v0");
+	for (int i = 0; i < debug->watch_count; ++i) {
+		PushID(i);
+		if (SmallButton("x")) {
+			chip8_post_command(CHIP8_COMMAND_DEBUG_REMOVE, CHIP8_COMMAND_DEBUG_WATCH, (uint32_t)i);
+		}
+		SameLine();
+		const uint32_t value = debug->watch_values[i];
+		Text("%s = %u (0x%x)", debug->watch_sources[i], value, value);
+		PopID();
+	}
+
+	/* conditions; stop when true */
+	debug_expression_input("Condition", imgui.condition_s, CHIP8_COMMAND_DEBUG_CONDITION);
+	SetItemTooltip("Stop when true. e.g. v0 == 5 && pc >= 0x300");
+	for (int i = 0; i < debug->condition_count; ++i) {
+		PushID(CHIP8_DEBUG_MAX_WATCHES + i);
+		if (SmallButton("x")) {
+			chip8_post_command(CHIP8_COMMAND_DEBUG_REMOVE, CHIP8_COMMAND_DEBUG_CONDITION, (uint32_t)i);
+		}
+		SameLine();
+		Text("%s", debug->condition_sources[i]);
+		PopID();
+	}
+
+	if (imgui.expression_error != NULL) {
+		TextDisabled("%s", imgui.expression_error);
+	}
+
+	if (Button("Clear all")) {
+		chip8_post_command(CHIP8_COMMAND_DEBUG_CLEAR, 0, 0);
+	}
+	SetItemTooltip("Remove every breakpoint, watch and condition");
+}
+static void debug_expression_input(const char* label, char* buffer, CHIP8_COMMAND_TYPE type) {
+
+	PushID(label);
+	SetNextItemWidth(GetFontSize() * 14);
+	const bool enter = InputText("###expression", buffer, CHIP8_DEBUG_MAX_SOURCE, ImGuiInputTextFlags_EnterReturnsTrue);
+	SameLine();
+	const bool add = Button(label);
+	PopID();
+
+	if ((enter || add) && buffer[0] != '\0') {
+
+		/* compile here too, so the error shows next to the input */
+		CHIP8_DEBUG_EXPR expr;
+		imgui.expression_error = chip8_debug_compile(&expr, buffer);
+		if (imgui.expression_error == NULL) {
+			chip8_post_debug_expression(type, buffer);
+			buffer[0] = '\0';
+		}
+	}
+}
+static void profile_window() {
+	Begin("Profile", (bool*)&ui_state.show_profile_window);
+
+	const CHIP8_PROFILE* profile = chip8_get_profile();
+
+	bool enabled = profile->enabled != 0;
+	if (Checkbox("Count", &enabled)) {
+		chip8_post_command(CHIP8_COMMAND_PROFILE_ENABLE, 0, enabled ? 1 : 0);
+	}
+	SetItemTooltip("Count every instruction. Runs an instruction at a time with idle skipping off");
+	SameLine();
+	if (Button("Reset")) {
+		chip8_post_command(CHIP8_COMMAND_PROFILE_RESET, 0, 0);
+	}
+	SameLine();
+	if (Button("Export CSV")) {
+		chip8_post_command(CHIP8_COMMAND_PROFILE_EXPORT, 0, 0);
+	}
+	SetItemTooltip("Write the address counts to chip8_profile.csv");
+	SameLine();
+	Checkbox("Heat map", (bool*)&ui_state.profile_heat_map);
+	SetItemTooltip("Tint the RAM window by how often each instruction ran");
+
+	const uint64_t draws = profile->class_counts[CHIP8_PROFILE_CLASS_DRAW];
+	Text("Instructions  %llu", (unsigned long long)profile->instructions);
+	if (profile->instructions > 0) {
+		Text("DXYN  %llu instr  %.1f%%", (unsigned long long)draws, draws * 100.0 / profile->instructions);
+	}
+	if (profile->run_ns > 0) {
+		const uint64_t draw_ns = (profile->draw_ns < profile->run_ns) ? profile->draw_ns : profile->run_ns;
+		Text("Host time  DXYN %.2f ms (%.1f%%)  other %.2f ms", draw_ns / 1e6, draw_ns * 100.0 / profile->run_ns, (profile->run_ns - draw_ns) / 1e6);
+		SetItemTooltip("Host time spent running DXYN against every other instruction while counting");
+	}
+
+	if (profile->instructions > 0) {
+		if (CollapsingHeader("Opcode classes", ImGuiTreeNodeFlags_DefaultOpen)) {
+			profile_class_table(profile);
+		}
+		if (CollapsingHeader("Addresses", ImGuiTreeNodeFlags_DefaultOpen)) {
+			profile_address_table(profile);
+		}
+	}
+	End();
+}
+static void profile_class_table(const CHIP8_PROFILE* profile) {
+
+	/* rows sorted by the table's sort spec; class order by default */
+	int rows[CHIP8_PROFILE_CLASSES];
+	for (int i = 0; i < CHIP8_PROFILE_CLASSES; ++i) {
+		rows[i] = i;
+	}
+
+	const ImGuiTableFlags flags = ImGuiTableFlags_Sortable | ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingFixedFit;
+	if (!BeginTable("profile_classes", 3, flags))
+		return;
+
+	TableSetupColumn("Class", ImGuiTableColumnFlags_DefaultSort);
+	TableSetupColumn("Count", ImGuiTableColumnFlags_PreferSortDescending);
+	TableSetupColumn("%", ImGuiTableColumnFlags_PreferSortDescending);
+	TableHeadersRow();
+
+	const ImGuiTableSortSpecs* sort = TableGetSortSpecs();
+	if (sort != NULL && sort->SpecsCount > 0 && sort->Specs[0].ColumnIndex > 0) {
+		const int descending = (sort->Specs[0].SortDirection == ImGuiSortDirection_Descending);
+		std::sort(rows, rows + CHIP8_PROFILE_CLASSES, [profile, descending](int a, int b) {
+			return descending ? profile->class_counts[a] > profile->class_counts[b] : profile->class_counts[a] < profile->class_counts[b];
+		});
+	}
+	else if (sort != NULL && sort->SpecsCount > 0 && sort->Specs[0].SortDirection == ImGuiSortDirection_Descending) {
+		std::reverse(rows, rows + CHIP8_PROFILE_CLASSES);
+	}
+
+	for (int i = 0; i < CHIP8_PROFILE_CLASSES; ++i) {
+		const uint64_t count = profile->class_counts[rows[i]];
+		TableNextRow();
+		TableNextColumn();
+		Text("%s", chip8_profile_class_name(rows[i]));
+		TableNextColumn();
+		Text("%llu", (unsigned long long)count);
+		TableNextColumn();
+		Text("%.2f", count * 100.0 / profile->instructions);
+	}
+	EndTable();
+}
+static void profile_address_table(const CHIP8_PROFILE* profile) {
+
+	/* executed addresses, sorted by the table's sort spec; hottest first by default */
+	static uint16_t rows[CHIP8_MEMORY_BYTES];
+	int row_count = 0;
+	for (int addr = 0; addr < CHIP8_MEMORY_BYTES; ++addr) {
+		if (profile->address_counts[addr] > 0) {
+			rows[row_count++] = (uint16_t)addr;
+		}
+	}
+
+	const ImGuiTableFlags flags = ImGuiTableFlags_Sortable | ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg |
+		ImGuiTableFlags_SizingFixedFit | ImGuiTableFlags_ScrollY;
+	if (!BeginTable("profile_addresses", 4, flags, ImVec2(0, GetFontSize() * 20)))
+		return;
+
+	TableSetupScrollFreeze(0, 1);
+	TableSetupColumn("Address");
+	TableSetupColumn("Opcode", ImGuiTableColumnFlags_NoSort);
+	TableSetupColumn("Count", ImGuiTableColumnFlags_DefaultSort | ImGuiTableColumnFlags_PreferSortDescending);
+	TableSetupColumn("%", ImGuiTableColumnFlags_PreferSortDescending);
+	TableHeadersRow();
+
+	const ImGuiTableSortSpecs* sort = TableGetSortSpecs();
+	const int by_count = (sort == NULL || sort->SpecsCount == 0 || sort->Specs[0].ColumnIndex >= 2);
+	const int descending = (sort == NULL || sort->SpecsCount == 0 || sort->Specs[0].SortDirection == ImGuiSortDirection_Descending);
+	if (by_count) {
+		std::stable_sort(rows, rows + row_count, [profile, descending](uint16_t a, uint16_t b) {
+			return descending ? profile->address_counts[a] > profile->address_counts[b] : profile->address_counts[a] < profile->address_counts[b];
+		});
+	}
+	else if (descending) {
+		std::reverse(rows, rows + row_count);
+	}
+
+	ImGuiListClipper clipper;
+	clipper.Begin(row_count);
+	while (clipper.Step()) {
+		for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; ++i) {
+			const uint16_t addr = rows[i];
+			const uint64_t count = profile->address_counts[addr];
+			TableNextRow();
+			TableNextColumn();
+			sprintf_s(imgui.tmp_s, "%03x", addr);
+			if (Selectable(imgui.tmp_s, false, ImGuiSelectableFlags_SpanAllColumns)) {
+				imgui.mem_editor->Open = true;
+				imgui.mem_editor->GotoAddrAndHighlight(addr, addr + 2);
+			}
+			TableNextColumn();
+			Text("%04x", (chip8->ram[addr] << 8) | chip8->ram[(addr + 1) & (CHIP8_MEMORY_BYTES - 1)]);
+			TableNextColumn();
+			Text("%llu", (unsigned long long)count);
+			TableNextColumn();
+			Text("%.2f", count * 100.0 / profile->instructions);
+		}
+	}
+	EndTable();
+}
 static void keypad_window() {
 
 }
 static void video_memory_window() {
 	Begin("video_editor", (bool*)&ui_state.show_video_button_window);
 
+	/* the frame the presenter drew; lit if any plane is set */
+	const CHIP8_FRAME* frame = sdl.frame;
+	if (frame == NULL) {
+		End();
+		return;
+	}
+
 	const ImU32 on = IM_COL32(chip8_config.on_color.r, chip8_config.on_color.g, chip8_config.on_color.b, 255);
 	const ImU32 off = IM_COL32(chip8_config.off_color.r, chip8_config.off_color.g, chip8_config.off_color.b, 255);
-	const ImVec2 scale = ImVec2(10, 10);
-	int click = 0;
-	int click_id = 0;
-	int pixel_state = 0;
-	for (int i = 0; i < CHIP8_NUM_PIXELS; ++i) {
-		PushID(i);
-		PushStyleColor(ImGuiCol_Button, CHIP8_DISPLAY_GET_PX(chip8->display, i) ? on : off);
-		Button("", scale);
+	const ImVec2 scale = (frame->width > CHIP8_FRAME_LORES_WIDTH) ? ImVec2(5, 5) : ImVec2(10, 10);
+	for (int y = 0; y < frame->height; ++y) {
+		for (int x = 0; x < frame->width; ++x) {
+			int lit = 0;
+			for (int p = 0; p < frame->planes; ++p) {
+				lit |= (int)CHIP8_DISPLAY_ROW_PX(frame->rows[p][y][x / 64], x & 63);
+			}
 
-		if (IsItemActivated()) {
-			CHIP8_DISPLAY_TOGGLE_PX(chip8->display, i);
-		}
+			const int i = y * frame->width + x;
+			PushID(i);
+			PushStyleColor(ImGuiCol_Button, lit ? on : off);
+			Button("", scale);
 
-		PopStyleColor();
-		PopID();
+			if (IsItemActivated()) {
+				chip8_post_command(CHIP8_COMMAND_TOGGLE_PIXEL, i, 0);
+			}
 
-		if ((i+1) % CHIP8_DISPLAY_WIDTH != 0)
-			SameLine();
+			PopStyleColor();
+			PopID();
+
+			if (x + 1 < frame->width)
+				SameLine();
+		}
 	}
 	End();
 }
@@ -387,6 +832,12 @@ static void window_settings_window() {
 	
 	/* chip8 window */
 
+	const int last_x = chip8_config.win_x;
+	const int last_y = chip8_config.win_y;
+	const int last_w = chip8_config.win_w;
+	const int last_h = chip8_config.win_h;
+	const int last_spacing = chip8_config.pixel_spacing;
+
 	int limit = DISPLAY_X_LIMIT;
 	SliderInt("Display X", &chip8_config.win_x, -limit, limit);
 
@@ -401,8 +852,20 @@ static void window_settings_window() {
 		chip8_config.pixel_spacing = pixel_spacing;
 	}
 
+	bool texture_renderer = chip8_config.texture_renderer;
+	if (Checkbox("Texture Renderer", &texture_renderer)) {
+		chip8_config.texture_renderer = texture_renderer;
+	}
+	SetItemTooltip("Draw the display with one streaming texture instead of a rect per pixel");
+
 	resize_display();
 
+	if (chip8_config.win_x != last_x || chip8_config.win_y != last_y ||
+		chip8_config.win_w != last_w || chip8_config.win_h != last_h ||
+		chip8_config.pixel_spacing != last_spacing) {
+		sdl_update_layout();
+	}
+
 	/* pixel colors */
 	ImVec4 tmp_vec4;
 	tmp_vec4.x = (float)(chip8_config.on_color.r / 255.0f);
@@ -429,17 +892,17 @@ static void chip8_settings_window() {
 
 	/* Chip8 quirks */
 
-	tmp = (chip8->quirks & CHIP8_QUIRK_CLS_ON_RESET);
+	tmp = (chip8_status.quirks & CHIP8_QUIRK_CLS_ON_RESET);
 	if (Checkbox("CLS On reset", &tmp)) {
-		chip8->quirks ^= CHIP8_QUIRK_CLS_ON_RESET;
+		chip8_post_command(CHIP8_COMMAND_TOGGLE_QUIRKS, 0, CHIP8_QUIRK_CLS_ON_RESET);
 		chip8_config.quirk_cls_on_reset = tmp;
 	}
 	SetItemTooltip("Clear the display on reset and on program load.");
 
 	SameLine();
-	tmp = (chip8->quirks & CHIP8_QUIRK_ZERO_VF_REGISTER);
+	tmp = (chip8_status.quirks & CHIP8_QUIRK_ZERO_VF_REGISTER);
 	if (Checkbox("VF Zero", &tmp)) {
-		chip8->quirks ^= CHIP8_QUIRK_ZERO_VF_REGISTER;
+		chip8_post_command(CHIP8_COMMAND_TOGGLE_QUIRKS, 0, CHIP8_QUIRK_ZERO_VF_REGISTER);
 		chip8_config.quirk_zero_vf_register = tmp;
 	}
 	if (chip8_config.quirk_zero_vf_register) {
@@ -450,24 +913,24 @@ static void chip8_settings_window() {
 	}
 
 	SameLine();
-	tmp = (chip8->quirks & CHIP8_QUIRK_DISPLAY_CLIPPING);
+	tmp = (chip8_status.quirks & CHIP8_QUIRK_DISPLAY_CLIPPING);
 	if (Checkbox("Display Clipping", &tmp)) {
-		chip8->quirks ^= CHIP8_QUIRK_DISPLAY_CLIPPING;
+		chip8_post_command(CHIP8_COMMAND_TOGGLE_QUIRKS, 0, CHIP8_QUIRK_DISPLAY_CLIPPING);
 		chip8_config.quirk_display_clipping = tmp;
 	}
 	SetItemTooltip("DXYN clips pixels that are off screen (out of bounds)");
 
 	SameLine();
-	tmp = (chip8->quirks & CHIP8_QUIRK_DISPLAY_WAIT);
+	tmp = (chip8_status.quirks & CHIP8_QUIRK_DISPLAY_WAIT);
 	if (Checkbox("Display Wait", &tmp)) {
-		chip8->quirks ^= CHIP8_QUIRK_DISPLAY_WAIT;
-		chip8_config.quirk_display_clipping = tmp;
+		chip8_post_command(CHIP8_COMMAND_TOGGLE_QUIRKS, 0, CHIP8_QUIRK_DISPLAY_WAIT);
+		chip8_config.quirk_display_wait = tmp;
 	}
 	SetItemTooltip("DXYN waits for VBlank");
 
-	tmp = (chip8->quirks & CHIP8_QUIRK_SHIFT_X_REGISTER);
+	tmp = (chip8_status.quirks & CHIP8_QUIRK_SHIFT_X_REGISTER);
 	if (Checkbox("Shift X Register", &tmp)) {
-		chip8->quirks ^= CHIP8_QUIRK_SHIFT_X_REGISTER;
+		chip8_post_command(CHIP8_COMMAND_TOGGLE_QUIRKS, 0, CHIP8_QUIRK_SHIFT_X_REGISTER);
 		chip8_config.quirk_shift_x_register = tmp;
 	}
 	if (chip8_config.quirk_shift_x_register) {
@@ -478,9 +941,9 @@ static void chip8_settings_window() {
 	}
 
 	SameLine();
-	tmp = (chip8->quirks & CHIP8_QUIRK_INCREMENT_I_REGISTER);
+	tmp = (chip8_status.quirks & CHIP8_QUIRK_INCREMENT_I_REGISTER);
 	if (Checkbox("LD Inc I", &tmp)) {
-		chip8->quirks ^= CHIP8_QUIRK_INCREMENT_I_REGISTER;
+		chip8_post_command(CHIP8_COMMAND_TOGGLE_QUIRKS, 0, CHIP8_QUIRK_INCREMENT_I_REGISTER);
 		chip8_config.quirk_increment_i_register = tmp;
 	}
 	if (chip8_config.quirk_increment_i_register) {
@@ -491,12 +954,30 @@ static void chip8_settings_window() {
 	}
 
 	SameLine();
-	tmp = (chip8->quirks & CHIP8_QUIRK_JUMP_VX);
+	tmp = (chip8_status.quirks & CHIP8_QUIRK_JUMP_VX);
 	if (Checkbox("JUMP VX", &tmp)) {
-		chip8->quirks ^= CHIP8_QUIRK_JUMP_VX;
+		chip8_post_command(CHIP8_COMMAND_TOGGLE_QUIRKS, 0, CHIP8_QUIRK_JUMP_VX);
 		chip8_config.quirk_jump = tmp;
 	}
 	SetItemTooltip("JMP NNN, V0 instead of JMP XNN, VX");
+
+	const char* engines[CHIP8_ENGINE_COUNT];
+	for (int i = 0; i < CHIP8_ENGINE_COUNT; ++i) {
+		engines[i] = chip8_machine_engine_name((CHIP8_ENGINE)i);
+	}
+	PushItemWidth(GetFontSize() * 8);
+	Combo("Engine", &chip8_config.engine, engines, CHIP8_ENGINE_COUNT);
+	PopItemWidth();
+	SetItemTooltip("Execution engine. Core runs chip8_execute() for every instruction");
+
+	const char* platforms[CHIP8_PLATFORM_COUNT];
+	for (int i = 0; i < CHIP8_PLATFORM_COUNT; ++i) {
+		platforms[i] = chip8_machine_platform_name((CHIP8_PLATFORM)i);
+	}
+	PushItemWidth(GetFontSize() * 8);
+	Combo("Platform", &chip8_config.platform, platforms, CHIP8_PLATFORM_COUNT);
+	PopItemWidth();
+	SetItemTooltip("SUPER-CHIP adds 128x64 hires and scrolling, XO-CHIP adds bitplanes. Clears the display");
 	
 
 	const int limit = 1000;
@@ -563,6 +1044,50 @@ static void chip8_settings_window() {
 	SliderInt("###Render_Target_Hz", &chip8_config.render_target, 1, limit);
 	PopItemWidth();
 	SetItemTooltip("Render Hz Target");
+
+	tmp = chip8_config.vsync;
+	if (Checkbox("VSync", &tmp)) {
+		chip8_config.vsync = tmp;
+	}
+	SetItemTooltip("Present on the display refresh instead of the Render Hz Target");
+
+	SameLine();
+	tmp = chip8_config.idle_skip;
+	if (Checkbox("Idle Skip", &tmp)) {
+		chip8_config.idle_skip = tmp;
+	}
+	SetItemTooltip("Skip loops that wait on the delay timer or keys to the next timer tick");
+
+	tmp = (int)thread_atomic_load(&chip8_state.fast_forward_toggled);
+	if (Checkbox("Fast Forward", &tmp)) {
+		thread_atomic_exchange(&chip8_state.fast_forward_toggled, tmp);
+	}
+	SetItemTooltip("Hold Tab or press Ctrl+F to fast forward");
+
+	PushItemWidth(GetFontSize() * 8);
+	SliderInt("Speed###Fast_Forward_Speed", &chip8_config.fast_forward_speed, 0, 64, chip8_config.fast_forward_speed > 0 ? "%dx" : "Uncapped");
+	SetItemTooltip("Fast forward multiplier. Timers are scaled with it. 0 runs as fast as the host allows");
+	SameLine();
+	SliderInt("Frame skip###Fast_Forward_Render_Interval", &chip8_config.fast_forward_render_interval, 0, 64, chip8_config.fast_forward_render_interval > 0 ? "1 in %d" : "Auto");
+	SetItemTooltip("Present every Nth frame while fast forwarding. Auto presents about Render Hz frames a second");
+
+	/* a new size drops the buffer and its history; resize once on release */
+	if (!imgui.rewind_buffer_active) {
+		imgui.rewind_buffer_mb = chip8_config.rewind_buffer_mb;
+	}
+	SliderInt("Rewind###Rewind_Buffer_MB", &imgui.rewind_buffer_mb, 0, 256, imgui.rewind_buffer_mb > 0 ? "%d MB" : "Off");
+	imgui.rewind_buffer_active = IsItemActive();
+	if (IsItemDeactivatedAfterEdit()) {
+		chip8_config.rewind_buffer_mb = imgui.rewind_buffer_mb;
+	}
+	SetItemTooltip("Rewind buffer size. Hold Backspace to rewind. The oldest states are dropped to stay in it");
+	SameLine();
+	SliderInt("Capture###Rewind_Interval", &chip8_config.rewind_interval, 1, 60, "1 in %d");
+	SetItemTooltip("Capture a rewind state every Nth frame");
+
+	SliderInt("Run-ahead###Run_Ahead", &chip8_config.run_ahead, 0, CHIP8_RUN_AHEAD_MAX, chip8_config.run_ahead > 0 ? "%d frames" : "Off");
+	SetItemTooltip("Present the frame N frames ahead with the keys held now, then roll back. Hides the frames programs take to react to a key at N + 1 times the emulation cost");
+	PopItemWidth();
 }
 static void menu_window() {
 	Begin("Menu", (bool*)&ui_state.show_menu_window);
@@ -575,6 +1100,10 @@ static void menu_window() {
 		ui_state.show_debug_window ^= 1;
 	}
 	SameLine();
+	if (Button("Profile")) {
+		ui_state.show_profile_window ^= 1;
+	}
+	SameLine();
 	if (Button("Window Settings")) {
 		if (ui_state.settings_window != WINDOW_SETTINGS)
 			ui_state.settings_window = WINDOW_SETTINGS;
@@ -608,6 +1137,29 @@ static void ram_window_follow_pc(uint16_t pc, int force) {
 		imgui.mem_editor->GotoAddrAndHighlight(pc, 2);
 	}
 }
+static void ram_window_write(ImU8* data, size_t off, ImU8 d, void* user_data) {
+	/* applied on the emulation thread; keeps the predecoded op cache in sync */
+	chip8_post_command(CHIP8_COMMAND_WRITE_RAM, (uint16_t)off, d);
+}
+static void video_ram_window_write(ImU8* data, size_t off, ImU8 d, void* user_data) {
+	chip8_post_command(CHIP8_COMMAND_WRITE_DISPLAY, (uint16_t)off, d);
+}
+static ImU32 ram_window_heat(const ImU8* data, size_t off, void* user_data) {
+	if (!ui_state.profile_heat_map || imgui.profile_max == 0)
+		return 0;
+
+	/* both bytes of an instruction; a log scale so cold code still shows */
+	const CHIP8_PROFILE* profile = chip8_get_profile();
+	uint64_t count = profile->address_counts[off];
+	if (off > 0 && profile->address_counts[off - 1] > count) {
+		count = profile->address_counts[off - 1];
+	}
+	if (count == 0)
+		return 0;
+
+	const float heat = logf((float)count + 1.0f) / logf((float)imgui.profile_max + 1.0f);
+	return IM_COL32(255, (int)(200 * (1.0f - heat)), 0, 40 + (int)(160 * heat));
+}
 static void outline_test() {
 
 	for (int i = 0; i < CHIP8_DISPLAY_WIDTH; ++i) {
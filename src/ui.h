@@ -13,6 +13,8 @@ typedef struct {
 	int show_video_ram_window;
 	int show_registers_window;
 	int show_video_button_window;
+	int show_profile_window;
+	int profile_heat_map;
 	int settings_window;
 	int cols_video_ram_window;
 	int ascii_video_ram_window;
@@ -44,6 +46,9 @@ void imgui_process_event();
 // imgui toggle menu ui
 void imgui_toggle_menu();
 
+// returns 1 if any imgui window is open
+int imgui_is_active();
+
 void imgui_refresh_ui_state();
 
 #ifdef __cplusplus
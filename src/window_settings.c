@@ -29,6 +29,8 @@ static const LOADINI_SETTING_MAP settings_map[] = {
 	{ "show_ram_window", LOADINI_SETTING_TYPE_INT },
 	{ "show_registers_window", LOADINI_SETTING_TYPE_INT },
 	{ "show_video_button_window", LOADINI_SETTING_TYPE_INT },
+	{ "show_profile_window", LOADINI_SETTING_TYPE_INT },
+	{ "profile_heat_map", LOADINI_SETTING_TYPE_INT },
 	{ "pc_increment", LOADINI_SETTING_TYPE_INT },
 	{ "ram_window_cols", LOADINI_SETTING_TYPE_INT },
 	{ "video_window_cols", LOADINI_SETTING_TYPE_INT },
@@ -52,6 +54,16 @@ static const LOADINI_SETTING_MAP settings_map[] = {
 	{ "cpu_target", LOADINI_SETTING_TYPE_INT },
 	{ "timer_target", LOADINI_SETTING_TYPE_INT },
 	{ "render_target", LOADINI_SETTING_TYPE_INT },
+	{ "engine", LOADINI_SETTING_TYPE_INT },
+	{ "platform", LOADINI_SETTING_TYPE_INT },
+	{ "vsync", LOADINI_SETTING_TYPE_INT },
+	{ "texture_renderer", LOADINI_SETTING_TYPE_INT },
+	{ "fast_forward_speed", LOADINI_SETTING_TYPE_INT },
+	{ "fast_forward_render_interval", LOADINI_SETTING_TYPE_INT },
+	{ "idle_skip", LOADINI_SETTING_TYPE_INT },
+	{ "rewind_buffer_mb", LOADINI_SETTING_TYPE_INT },
+	{ "rewind_interval", LOADINI_SETTING_TYPE_INT },
+	{ "run_ahead", LOADINI_SETTING_TYPE_INT },
 	
 	{ "on_color_r", LOADINI_SETTING_TYPE_CHAR },
 	{ "on_color_g", LOADINI_SETTING_TYPE_CHAR },
@@ -142,6 +154,8 @@ void loadini_init() {
 	set_var(&ui_state.show_ram_window);
 	set_var(&ui_state.show_registers_window);
 	set_var(&ui_state.show_video_button_window);
+	set_var(&ui_state.show_profile_window);
+	set_var(&ui_state.profile_heat_map);
 	set_var(&ui_state.pc_increment);
 	set_var(&ui_state.cols_ram_window);
 	set_var(&ui_state.cols_video_ram_window);
@@ -165,6 +179,16 @@ void loadini_init() {
 	set_var(&chip8_config.cpu_target);
 	set_var(&chip8_config.timer_target);
 	set_var(&chip8_config.render_target);
+	set_var(&chip8_config.engine);
+	set_var(&chip8_config.platform);
+	set_var(&chip8_config.vsync);
+	set_var(&chip8_config.texture_renderer);
+	set_var(&chip8_config.fast_forward_speed);
+	set_var(&chip8_config.fast_forward_render_interval);
+	set_var(&chip8_config.idle_skip);
+	set_var(&chip8_config.rewind_buffer_mb);
+	set_var(&chip8_config.rewind_interval);
+	set_var(&chip8_config.run_ahead);
 
 	set_var(&chip8_config.on_color.r);
 	set_var(&chip8_config.on_color.g);